@@ -0,0 +1,721 @@
+//
+// This file is part of the Max Network Extensions Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Loopback benchmark for the networking core. Runs client and server sessions
+// in one process (or only one side of them) and prints the results as JSON.
+//
+//   maxnet_bench [--sizes 64,1024,16384,1048576] [--sessions 4] [--rate 0] [--window 64]
+//                [--duration 5] [--warmup 1] [--threads 2] [--port 9876]
+//                [--mode loopback|server|client] [--host 127.0.0.1]
+//                [--auto-fragment 1] [--write-buffer 4096]
+//                [--read-buffer pooled|flat|multi]
+//                [--read-message-max 16777216] [--matrix 0]
+//
+// --rate is in messages per second and session, 0 sends as fast as the
+// window of unanswered messages allows. The default sizes end with a message
+// that is read in many frames and grows the read buffer past the pooled sizes.
+//
+// The stream tuning options apply to the sessions on both ends. --matrix 1
+// ignores them and runs every combination of auto fragmentation, a small and
+// a large write buffer and all read buffer types, one JSON object per run.
+
+#include "codecs/frame_message.h"
+#include "devices/listener.h"
+#include "net_url.h"
+#include "session.h"
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bench {
+
+    using clock = std::chrono::steady_clock;
+
+    using message_type = o::frame_message;
+
+    using stream_type = boost::beast::websocket::stream< boost::asio::ip::tcp::socket >;
+
+    using client_session = o::session< stream_type, message_type >;
+
+    using server_session = o::session< stream_type, message_type, o::sessions::roles::server >;
+
+    struct options {
+        std::vector< size_t > sizes{ 64, 1024, 16384, 1024 * 1024 };
+        size_t sessions = 4;
+        double rate = 0;
+        size_t window = 64;
+        double duration = 5;
+        double warmup = 1;
+        size_t threads = 2;
+        unsigned short port = 9876;
+        std::string host = "127.0.0.1";
+        std::string mode = "loopback";
+        o::stream_tuning tuning;
+        bool matrix = false;
+    };
+
+    // every benchmark message starts with this header, the rest is padding
+    struct frame_header {
+        std::uint32_t phase;
+        std::uint32_t sequence;
+        std::int64_t sent_ns;
+    };
+
+    constexpr size_t max_latency_samples = size_t( 1 ) << 22;
+
+    // sessions that still have operations pending at shutdown are destroyed with
+    // the io_context, so everything they reference must outlive it
+    message_type::factory& shared_factory() {
+        static message_type::factory factory;
+        return factory;
+    }
+
+    std::atomic< int >& session_count() {
+        static std::atomic< int > count{ 0 };
+        return count;
+    }
+
+    std::int64_t now_ns() {
+        return std::chrono::duration_cast< std::chrono::nanoseconds >(
+                   clock::now().time_since_epoch() )
+            .count();
+    }
+
+    /// reports a failed session operation, regular closes and cancellations are not errors
+    void report_error( const char* what, boost::system::error_code ec ) {
+        if ( !ec || ec == boost::beast::websocket::error::closed ||
+             ec == boost::asio::error::operation_aborted || ec == boost::asio::error::eof )
+            return;
+
+        static std::mutex mtx;
+        std::lock_guard< std::mutex > lock{ mtx };
+        std::cerr << what << " failed: " << ec.message() << std::endl;
+    }
+
+    /// percentile of a sorted sample set
+    double percentile( const std::vector< std::int64_t >& sorted, double fraction ) {
+        if ( sorted.empty() )
+            return 0;
+        auto index = static_cast< size_t >( fraction * ( sorted.size() - 1 ) + 0.5 );
+        return static_cast< double >( sorted[std::min( index, sorted.size() - 1 )] );
+    }
+
+    /// echoes every message back to its sender
+    class echo_server {
+      public:
+        explicit echo_server( boost::asio::io_context& ctx ) : ctx_( ctx ), listener_( ctx ) {}
+
+        /// used for all sessions accepted from now on
+        void set_tuning( const o::stream_tuning& tuning ) {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            tuning_ = tuning;
+        }
+
+        boost::system::error_code start( const boost::asio::ip::tcp::endpoint& endpoint ) {
+            return listener_.start_listen(
+                endpoint, [this]( boost::system::error_code ec,
+                                  boost::asio::ip::tcp::socket&& socket ) {
+                    if ( ec )
+                        return;
+
+                    auto session = std::make_shared< server_session >(
+                        std::move( socket ), ctx_, shared_factory(), &session_count() );
+
+                    std::weak_ptr< server_session > weak = session;
+
+                    session->on_read( [this, weak]( boost::system::error_code ec,
+                                                    message_type* msg, size_t ) {
+                        auto self = weak.lock();
+
+                        if ( msg == nullptr ) {
+                            report_error( "server read", ec );
+                            return;
+                        }
+
+                        if ( self )
+                            self->write( msg );
+                        else
+                            shared_factory().deallocate( msg );
+                    } );
+
+                    session->on_ready( []( boost::system::error_code ) {} );
+
+                    {
+                        std::lock_guard< std::mutex > lock{ mtx_ };
+                        session->set_stream_tuning( tuning_ );
+                        sessions_.push_back( session );
+                    }
+
+                    session->accept();
+                } );
+        }
+
+        void stop() {
+            if ( listener_.status() == o::listener::status_codes::OPEN )
+                listener_.stop_listen();
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            for ( auto& session : sessions_ )
+                session->close();
+        }
+
+        /// true while any session has operations in flight
+        bool busy() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            return std::any_of( sessions_.begin(), sessions_.end(),
+                                []( auto& session ) { return session.use_count() > 1; } );
+        }
+
+        void clear() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            sessions_.clear();
+        }
+
+      private:
+        boost::asio::io_context& ctx_;
+        o::listener listener_;
+
+        std::mutex mtx_;
+        std::vector< std::shared_ptr< server_session > > sessions_;
+        o::stream_tuning tuning_;
+    };
+
+    /// one benchmark connection, sends timestamped frames and measures the echo
+    class bench_client {
+      public:
+        explicit bench_client( boost::asio::io_context& ctx )
+            : factory_( shared_factory() )
+            , timer_( ctx )
+            , session_(
+                  std::make_shared< client_session >( ctx, factory_, &session_count() ) ) {}
+
+        void connect( net_url<> url, const o::stream_tuning& tuning,
+                      std::function< void( boost::system::error_code ) > ready ) {
+
+            session_->set_stream_tuning( tuning );
+
+            session_->on_ready( [this, ready]( boost::system::error_code ec ) {
+                if ( !ec )
+                    session_->stream().binary( true );
+                ready( ec );
+            } );
+
+            session_->on_read(
+                [this]( boost::system::error_code ec, message_type* msg, size_t bytes ) {
+                    if ( msg != nullptr )
+                        handle_echo( msg, bytes );
+                    else
+                        report_error( "client read", ec );
+                } );
+
+            session_->connect( url );
+        }
+
+        /// start a new phase, frames of older phases are ignored from now on
+        void start_phase( std::uint32_t phase, size_t size, const options& opts ) {
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+                phase_ = phase;
+                size_ = std::max( size, sizeof( frame_header ) );
+                window_ = std::max< size_t >( opts.window, 1 );
+                recording_ = false;
+                received_ = 0;
+                received_bytes_ = 0;
+                latencies_.clear();
+            }
+
+            in_flight_ = 0;
+
+            if ( opts.rate > 0 ) {
+                period_ = std::chrono::duration_cast< clock::duration >(
+                    std::chrono::duration< double >( 1.0 / opts.rate ) );
+                deadline_ = clock::now();
+                schedule();
+            } else {
+                for ( size_t i = 0; i < window_; ++i )
+                    send_one();
+            }
+        }
+
+        void set_recording( bool recording ) {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            recording_ = recording;
+        }
+
+        void stop_phase() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            phase_ = 0;
+            recording_ = false;
+            timer_.cancel();
+        }
+
+        /// move the results of the current phase into the given totals
+        void collect( std::uint64_t& msgs, std::uint64_t& bytes,
+                      std::vector< std::int64_t >& latencies ) {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            msgs += received_;
+            bytes += received_bytes_;
+            latencies.insert( latencies.end(), latencies_.begin(), latencies_.end() );
+        }
+
+        void close() {
+            timer_.cancel();
+            session_->close();
+        }
+
+        bool busy() const { return session_.use_count() > 1; }
+
+      private:
+        void schedule() {
+            deadline_ += period_;
+            timer_.expires_at( deadline_ );
+            timer_.async_wait( [this]( boost::system::error_code ec ) {
+                if ( ec )
+                    return;
+
+                if ( in_flight_.load() < window_ )
+                    send_one();
+
+                schedule();
+            } );
+        }
+
+        void send_one() {
+
+            frame_header header;
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+                if ( phase_ == 0 )
+                    return;
+                header.phase = phase_;
+                header.sequence = ++sequence_;
+            }
+
+            auto msg = factory_.allocate();
+            msg->storage().resize( size_ );
+
+            header.sent_ns = now_ns();
+            std::memcpy( msg->data(), &header, sizeof( header ) );
+
+            in_flight_++;
+            session_->write( msg );
+        }
+
+        void handle_echo( message_type* msg, size_t bytes ) {
+
+            auto now = now_ns();
+            bool closed_loop = period_.count() == 0;
+            bool current = false;
+
+            if ( msg->size() >= sizeof( frame_header ) ) {
+
+                frame_header header;
+                std::memcpy( &header, msg->data(), sizeof( header ) );
+
+                std::lock_guard< std::mutex > lock{ mtx_ };
+
+                current = header.phase == phase_ && phase_ != 0;
+
+                if ( current && recording_ ) {
+                    received_++;
+                    received_bytes_ += bytes;
+
+                    if ( latencies_.size() < max_latency_samples )
+                        latencies_.push_back( now - header.sent_ns );
+                }
+            }
+
+            factory_.deallocate( msg );
+
+            if ( current ) {
+                in_flight_--;
+                if ( closed_loop )
+                    send_one();
+            }
+        }
+
+        message_type::factory& factory_;
+
+        boost::asio::steady_timer timer_;
+        clock::duration period_{};
+        clock::time_point deadline_;
+
+        std::shared_ptr< client_session > session_;
+
+        std::atomic< size_t > in_flight_{ 0 };
+
+        std::mutex mtx_;
+        std::uint32_t phase_ = 0;
+        std::uint32_t sequence_ = 0;
+        size_t size_ = 0;
+        size_t window_ = 1;
+        bool recording_ = false;
+        std::uint64_t received_ = 0;
+        std::uint64_t received_bytes_ = 0;
+        std::vector< std::int64_t > latencies_;
+    };
+
+    bool parse_options( int argc, char** argv, options& opts ) {
+
+        for ( int i = 1; i < argc; ++i ) {
+
+            std::string arg = argv[i];
+
+            if ( i + 1 >= argc ) {
+                std::cerr << "missing value for " << arg << std::endl;
+                return false;
+            }
+
+            std::string value = argv[++i];
+
+            try {
+                if ( arg == "--sizes" ) {
+                    opts.sizes.clear();
+                    std::stringstream list( value );
+                    std::string item;
+                    while ( std::getline( list, item, ',' ) )
+                        opts.sizes.push_back( std::stoul( item ) );
+                } else if ( arg == "--sessions" ) {
+                    opts.sessions = std::stoul( value );
+                } else if ( arg == "--rate" ) {
+                    opts.rate = std::stod( value );
+                } else if ( arg == "--window" ) {
+                    opts.window = std::stoul( value );
+                } else if ( arg == "--duration" ) {
+                    opts.duration = std::stod( value );
+                } else if ( arg == "--warmup" ) {
+                    opts.warmup = std::stod( value );
+                } else if ( arg == "--threads" ) {
+                    opts.threads = std::max< size_t >( std::stoul( value ), 1 );
+                } else if ( arg == "--port" ) {
+                    opts.port = static_cast< unsigned short >( std::stoul( value ) );
+                } else if ( arg == "--host" ) {
+                    opts.host = value;
+                } else if ( arg == "--mode" ) {
+                    opts.mode = value;
+                } else if ( arg == "--auto-fragment" ) {
+                    opts.tuning.auto_fragment = std::stoi( value ) != 0;
+                } else if ( arg == "--write-buffer" ) {
+                    opts.tuning.write_buffer_bytes = std::stoul( value );
+                } else if ( arg == "--read-message-max" ) {
+                    opts.tuning.read_message_max = std::stoul( value );
+                } else if ( arg == "--read-buffer" ) {
+                    if ( value == "multi" )
+                        opts.tuning.read_buffer = o::stream_tuning::read_buffer_type::multi;
+                    else if ( value == "flat" )
+                        opts.tuning.read_buffer = o::stream_tuning::read_buffer_type::flat;
+                    else if ( value == "pooled" )
+                        opts.tuning.read_buffer = o::stream_tuning::read_buffer_type::pooled;
+                    else
+                        return false;
+                } else if ( arg == "--matrix" ) {
+                    opts.matrix = std::stoi( value ) != 0;
+                } else {
+                    std::cerr << "unknown option " << arg << std::endl;
+                    return false;
+                }
+            } catch ( std::exception& ex ) {
+                std::cerr << "invalid value for " << arg << ": " << value << std::endl;
+                return false;
+            }
+        }
+
+        return !opts.sizes.empty() &&
+               ( opts.mode == "loopback" || opts.mode == "server" || opts.mode == "client" );
+    }
+
+    void sleep_for( double seconds ) {
+        std::this_thread::sleep_for( std::chrono::duration< double >( seconds ) );
+    }
+
+    const char* read_buffer_name( o::stream_tuning::read_buffer_type type ) {
+        switch ( type ) {
+        case o::stream_tuning::read_buffer_type::flat:
+            return "flat";
+        case o::stream_tuning::read_buffer_type::multi:
+            return "multi";
+        default:
+            return "pooled";
+        }
+    }
+
+    int run_clients( boost::asio::io_context& ctx, const options& opts,
+                     std::vector< std::unique_ptr< bench_client > >& clients ) {
+
+        net_url<>::error_code url_ec;
+        net_url<> url( opts.host + ":" + std::to_string( opts.port ), url_ec );
+
+        if ( url_ec != net_url<>::error_code::SUCCESS || !url.is_resolved() ) {
+            std::cerr << "invalid host " << opts.host << std::endl;
+            return 1;
+        }
+
+        std::atomic< size_t > ready{ 0 };
+        std::atomic< size_t > failed{ 0 };
+
+        for ( size_t i = 0; i < opts.sessions; ++i ) {
+            clients.push_back( std::make_unique< bench_client >( ctx ) );
+            clients.back()->connect( url, opts.tuning, [&]( boost::system::error_code ec ) {
+                if ( ec ) {
+                    report_error( "connect", ec );
+                    failed++;
+                } else
+                    ready++;
+            } );
+        }
+
+        auto connect_deadline = clock::now() + std::chrono::seconds( 10 );
+
+        while ( ready + failed < opts.sessions && clock::now() < connect_deadline )
+            sleep_for( 0.01 );
+
+        if ( ready < opts.sessions ) {
+            std::cerr << "only " << ready << " of " << opts.sessions << " sessions connected"
+                      << std::endl;
+            return 1;
+        }
+
+        std::cout << "{\n  \"config\": { \"sessions\": " << opts.sessions
+                  << ", \"rate\": " << opts.rate << ", \"window\": " << opts.window
+                  << ", \"duration\": " << opts.duration << ", \"threads\": " << opts.threads
+                  << ", \"auto_fragment\": " << opts.tuning.auto_fragment
+                  << ", \"write_buffer\": " << opts.tuning.write_buffer_bytes
+                  << ", \"read_buffer\": \"" << read_buffer_name( opts.tuning.read_buffer )
+                  << "\" },\n  \"results\": [";
+
+        std::uint32_t phase = 0;
+
+        for ( auto size : opts.sizes ) {
+
+            ++phase;
+
+            for ( auto& client : clients )
+                client->start_phase( phase, size, opts );
+
+            sleep_for( opts.warmup );
+
+            for ( auto& client : clients )
+                client->set_recording( true );
+
+            auto begin = clock::now();
+            sleep_for( opts.duration );
+
+            for ( auto& client : clients )
+                client->set_recording( false );
+
+            double elapsed = std::chrono::duration< double >( clock::now() - begin ).count();
+
+            std::uint64_t msgs = 0;
+            std::uint64_t bytes = 0;
+            std::vector< std::int64_t > latencies;
+
+            for ( auto& client : clients ) {
+                client->collect( msgs, bytes, latencies );
+                client->stop_phase();
+            }
+
+            std::sort( latencies.begin(), latencies.end() );
+
+            char result[512];
+            std::snprintf( result, sizeof( result ),
+                           "%s\n    { \"size\": %zu, \"msgs\": %llu, \"msgs_per_sec\": %.1f, "
+                           "\"mb_per_sec\": %.3f, \"latency_us\": { \"p50\": %.1f, "
+                           "\"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f } }",
+                           phase > 1 ? "," : "", size,
+                           static_cast< unsigned long long >( msgs ), msgs / elapsed,
+                           bytes / elapsed / ( 1024. * 1024. ),
+                           percentile( latencies, 0.5 ) / 1e3,
+                           percentile( latencies, 0.9 ) / 1e3,
+                           percentile( latencies, 0.99 ) / 1e3,
+                           percentile( latencies, 0.999 ) / 1e3,
+                           percentile( latencies, 1.0 ) / 1e3 );
+
+            std::cout << result << std::flush;
+
+            // let the last echoes of this phase drain
+            sleep_for( 0.1 );
+        }
+
+        std::cout << "\n  ]\n}" << std::endl;
+
+        return 0;
+    }
+
+    void close_clients( std::vector< std::unique_ptr< bench_client > >& clients ) {
+
+        for ( auto& client : clients )
+            client->close();
+
+        auto deadline = clock::now() + std::chrono::seconds( 2 );
+
+        while ( clock::now() < deadline &&
+                std::any_of( clients.begin(), clients.end(),
+                             []( auto& client ) { return client->busy(); } ) )
+            sleep_for( 0.01 );
+    }
+
+    /// one run per combination of fragmentation, write buffer and read buffer type
+    int run_matrix( boost::asio::io_context& ctx, options opts, echo_server& server,
+                    std::vector< std::unique_ptr< bench_client > >& clients,
+                    std::vector< std::unique_ptr< bench_client > >& retired ) {
+
+        const std::size_t write_buffers[] = { 4096, 1024 * 1024 };
+        const o::stream_tuning::read_buffer_type read_buffers[] = {
+            o::stream_tuning::read_buffer_type::multi, o::stream_tuning::read_buffer_type::flat,
+            o::stream_tuning::read_buffer_type::pooled
+        };
+
+        bool first = true;
+
+        std::cout << "[\n";
+
+        for ( bool fragment : { true, false } ) {
+            for ( auto write_buffer : write_buffers ) {
+                for ( auto read_buffer : read_buffers ) {
+
+                    opts.tuning.auto_fragment = fragment;
+                    opts.tuning.write_buffer_bytes = write_buffer;
+                    opts.tuning.read_buffer = read_buffer;
+
+                    server.set_tuning( opts.tuning );
+
+                    if ( !first )
+                        std::cout << ",\n";
+                    first = false;
+
+                    int result = run_clients( ctx, opts, clients );
+
+                    // the sessions may still call back into closed clients, keep them
+                    close_clients( clients );
+                    std::move( clients.begin(), clients.end(), std::back_inserter( retired ) );
+                    clients.clear();
+
+                    if ( result != 0 )
+                        return result;
+                }
+            }
+        }
+
+        std::cout << "]" << std::endl;
+
+        return 0;
+    }
+} // namespace bench
+
+int main( int argc, char** argv ) {
+
+    bench::options opts;
+
+    if ( !bench::parse_options( argc, argv, opts ) ) {
+        std::cerr << "usage: maxnet_bench [--sizes a,b,c] [--sessions n] [--rate hz] "
+                     "[--window n] [--duration s] [--warmup s] [--threads n] [--port p] "
+                     "[--host h] [--mode loopback|server|client] [--auto-fragment 0|1] "
+                     "[--write-buffer bytes] [--read-buffer pooled|flat|multi] "
+                     "[--read-message-max bytes] [--matrix 0|1]"
+                  << std::endl;
+        return 1;
+    }
+
+    boost::asio::io_context ctx;
+    auto work = boost::asio::make_work_guard( ctx );
+
+    std::vector< std::thread > workers;
+    for ( size_t i = 0; i < opts.threads; ++i )
+        workers.emplace_back( [&ctx]() { ctx.run(); } );
+
+    int result = 0;
+
+    // both outlive the io threads, the sessions call back into them until they are closed
+    bench::echo_server server{ ctx };
+    std::vector< std::unique_ptr< bench::bench_client > > clients;
+    std::vector< std::unique_ptr< bench::bench_client > > retired;
+
+    server.set_tuning( opts.tuning );
+
+    if ( opts.mode != "client" ) {
+
+        auto ec = server.start( boost::asio::ip::tcp::endpoint(
+            boost::asio::ip::make_address( opts.mode == "server" ? "0.0.0.0" : opts.host ),
+            opts.port ) );
+
+        if ( ec ) {
+            std::cerr << "could not listen on port " << opts.port << ": " << ec.message()
+                      << std::endl;
+            result = 1;
+        }
+    }
+
+    if ( result == 0 ) {
+        if ( opts.mode == "server" ) {
+            std::cerr << "echoing on port " << opts.port << ", press enter to quit"
+                      << std::endl;
+            std::cin.get();
+        } else if ( opts.matrix ) {
+            result = bench::run_matrix( ctx, opts, server, clients, retired );
+        } else {
+            result = bench::run_clients( ctx, opts, clients );
+        }
+    }
+
+    for ( auto& client : clients )
+        client->close();
+
+    server.stop();
+
+    // give the sessions some time to finish their close handshakes
+    auto deadline = bench::clock::now() + std::chrono::seconds( 2 );
+
+    while ( bench::clock::now() < deadline &&
+            ( server.busy() || std::any_of( clients.begin(), clients.end(),
+                                            []( auto& client ) { return client->busy(); } ) ) )
+        bench::sleep_for( 0.01 );
+
+    work.reset();
+    ctx.stop();
+
+    for ( auto& worker : workers )
+        worker.join();
+
+    server.clear();
+
+    return result;
+}
@@ -0,0 +1,756 @@
+//
+// This file is part of the Max Network Extensions Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Opens many concurrent client sessions against a websocket server and
+// reports connect latency, handshake failures, throughput and how evenly
+// the sessions were served. Pair it with maxnet_testserver --mode echo or
+// a websocketserver object.
+//
+//   maxnet_loadgen [--host 127.0.0.1] [--port 8080] [--sessions 1000]
+//                  [--connect-rate 500] [--rate 10] [--size 64] [--duration 10]
+//                  [--threads 4] [--max-in-flight 64] [--tls 0] [--ca file]
+//                  [--verify 1] [--ciphers auto|aes-gcm|chacha20]
+//                  [--codecs protobuf,osc,json]
+//
+// --connect-rate is in new sessions per second, --rate in messages per second
+// and session. The summary is printed as JSON, progress goes to stderr.
+// --tls 1 connects with wss:// (only in builds with enable_tls) and adds the
+// handshake times of full and resumed tls sessions to the summary. --ca
+// trusts the certificate written by maxnet_testserver --cert-out, --verify 0
+// accepts any certificate.
+// --codecs offers the listed codecs through Sec-WebSocket-Protocol, in order
+// of preference, and counts the negotiated ones in the summary.
+
+#include "codecs/frame_message.h"
+#include "net_url.h"
+#include "session.h"
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace loadgen {
+
+    using clock = std::chrono::steady_clock;
+
+    using message_type = o::frame_message;
+
+    using stream_type = boost::beast::websocket::stream< boost::asio::ip::tcp::socket >;
+
+#ifdef MAXNET_ENABLE_TLS
+    using tls_stream_type = o::tls_websocket_stream;
+#endif
+
+    struct options {
+        std::string host = "127.0.0.1";
+        unsigned short port = 8080;
+        size_t sessions = 1000;
+        double connect_rate = 500;
+        double rate = 10;
+        size_t size = 64;
+        double duration = 10;
+        size_t threads = 4;
+        size_t max_in_flight = 64;
+        bool tls = false;
+        std::string ca_file;
+        bool verify = true;
+        std::string ciphers = "auto";
+        std::vector< o::codec > codecs;
+    };
+
+    // interval of the send loop, per-session rates are spread over these ticks
+    constexpr auto send_tick = std::chrono::milliseconds( 10 );
+
+    constexpr size_t max_rtt_samples = size_t( 1 ) << 20;
+
+    // sessions that are still closing at exit are destroyed with the io_context,
+    // so everything they reference must outlive it
+    message_type::factory& shared_factory() {
+        static message_type::factory factory;
+        return factory;
+    }
+
+    std::atomic< int >& session_count() {
+        static std::atomic< int > count{ 0 };
+        return count;
+    }
+
+    std::int64_t now_ns() {
+        return std::chrono::duration_cast< std::chrono::nanoseconds >(
+                   clock::now().time_since_epoch() )
+            .count();
+    }
+
+    double percentile( std::vector< double >& values, double fraction ) {
+        if ( values.empty() )
+            return 0;
+        auto index = static_cast< size_t >( fraction * ( values.size() - 1 ) + 0.5 );
+        std::nth_element( values.begin(), values.begin() + index, values.end() );
+        return values[index];
+    }
+
+    /// Jain's fairness index, 1 if all values are equal, 1/n if one value has everything
+    double fairness( const std::vector< double >& values ) {
+
+        double sum = 0;
+        double squares = 0;
+
+        for ( auto v : values ) {
+            sum += v;
+            squares += v * v;
+        }
+
+        return squares > 0 ? ( sum * sum ) / ( values.size() * squares ) : 1.0;
+    }
+
+    template < typename Session >
+    struct client {
+
+        enum class state { connecting, online, failed, closed };
+
+        std::shared_ptr< Session > session;
+
+        std::atomic< state > status{ state::connecting };
+
+        clock::time_point connect_started;
+        double connect_ms = 0;
+
+        // tls only, the session does one handshake
+        double tls_ms = 0;
+        bool resumed = false;
+
+        o::codec codec = o::codec::protobuf_v1;
+
+        double credit = 0;
+        std::uint64_t sequence = 0;
+
+        std::atomic< size_t > in_flight{ 0 };
+        std::atomic< std::uint64_t > sent{ 0 };
+        std::atomic< std::uint64_t > received{ 0 };
+        std::atomic< std::uint64_t > received_bytes{ 0 };
+    };
+
+    template < typename Stream >
+    class load_generator {
+
+        using session_type = o::session< Stream, message_type >;
+        using client = loadgen::client< session_type >;
+
+        static constexpr bool is_tls =
+            o::stream_layer< typename Stream::next_layer_type >::is_tls;
+
+      public:
+        load_generator( boost::asio::io_context& ctx, const options& opts )
+            : ctx_( ctx ), opts_( opts ), connect_timer_( ctx ), report_timer_( ctx ) {
+
+#ifdef MAXNET_ENABLE_TLS
+            if ( is_tls ) {
+                o::tls_options tls;
+                tls.ca_file = opts.ca_file;
+                tls.verify_peer = opts.verify;
+
+                if ( opts.ciphers == "aes-gcm" )
+                    tls.ciphers = o::tls_ciphers::aes_gcm;
+                else if ( opts.ciphers == "chacha20" )
+                    tls.ciphers = o::tls_ciphers::chacha20;
+
+                // one context for all sessions, so they share the session cache
+                tls_ = std::make_unique< o::tls_context >( o::tls_context::role::client, tls,
+                                                           tls_error_ );
+            }
+#endif
+
+            clients_.reserve( opts.sessions );
+
+            for ( size_t i = 0; i < opts.sessions; ++i ) {
+                clients_.push_back( std::make_unique< client >() );
+                clients_.back()->session = make_session();
+            }
+
+            // one send loop per io thread, each owns a slice of the sessions
+            for ( size_t i = 0; i < opts.threads; ++i )
+                shards_.push_back( std::make_unique< shard >( ctx ) );
+
+            for ( size_t i = 0; i < clients_.size(); ++i )
+                shards_[i % shards_.size()]->clients.push_back( clients_[i].get() );
+        }
+
+        bool start() {
+
+            if ( tls_error_ ) {
+                std::cerr << "tls setup failed: " << tls_error_.message() << std::endl;
+                return false;
+            }
+
+            net_url<>::error_code ec;
+            url_ = net_url<>( opts_.host + ":" + std::to_string( opts_.port ), ec );
+
+            if ( ec != net_url<>::error_code::SUCCESS || !url_.is_resolved() ) {
+                std::cerr << "invalid host " << opts_.host << std::endl;
+                return false;
+            }
+
+            started_ = clock::now();
+            last_report_ = started_;
+
+            schedule_connects();
+            schedule_report();
+
+            for ( auto& sh : shards_ ) {
+                sh->deadline = started_;
+                schedule_sends( sh.get() );
+            }
+
+            return true;
+        }
+
+        /// stop sending and close all sessions
+        void stop() {
+
+            stopped_ = true;
+            finished_ = clock::now();
+
+            connect_timer_.cancel();
+            report_timer_.cancel();
+
+            for ( auto& sh : shards_ )
+                sh->timer.cancel();
+
+            for ( auto& cl : clients_ ) {
+                if ( cl->status == client::state::online )
+                    cl->session->close();
+            }
+        }
+
+        bool busy() const {
+            return std::any_of( clients_.begin(), clients_.end(), []( auto& cl ) {
+                return cl->session.use_count() > 1;
+            } );
+        }
+
+        void print_summary() {
+
+            double elapsed = std::chrono::duration< double >( finished_ - started_ ).count();
+
+            std::vector< double > connect_ms;
+            std::vector< double > per_session;
+            std::vector< double > full_tls_ms;
+            std::vector< double > resumed_tls_ms;
+            std::array< size_t, o::all_codecs.size() > codecs{};
+
+            std::uint64_t sent = 0;
+            std::uint64_t received = 0;
+            std::uint64_t received_bytes = 0;
+            size_t online = 0;
+
+            for ( auto& cl : clients_ ) {
+
+                sent += cl->sent;
+                received += cl->received;
+                received_bytes += cl->received_bytes;
+
+                if ( cl->connect_ms > 0 )
+                    connect_ms.push_back( cl->connect_ms );
+
+                if ( cl->tls_ms > 0 )
+                    ( cl->resumed ? resumed_tls_ms : full_tls_ms ).push_back( cl->tls_ms );
+
+                if ( cl->status == client::state::online ||
+                     cl->status == client::state::closed ) {
+                    ++online;
+                    per_session.push_back( static_cast< double >( cl->received ) );
+                    codecs[static_cast< size_t >( cl->codec )]++;
+                }
+            }
+
+            std::vector< double > rtts;
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+                rtts = rtt_ms_;
+            }
+
+            double fair = fairness( per_session );
+
+            char buffer[1024];
+
+            std::snprintf(
+                buffer, sizeof( buffer ),
+                "{\n  \"config\": { \"sessions\": %zu, \"connect_rate\": %.1f, \"rate\": %.1f, "
+                "\"size\": %zu, \"duration\": %.1f, \"threads\": %zu },\n"
+                "  \"connected\": %zu,\n  \"handshake_failures\": %llu,\n"
+                "  \"connect_ms\": { \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f "
+                "},\n"
+                "  \"throughput\": { \"sent_msgs_per_sec\": %.1f, \"received_msgs_per_sec\": "
+                "%.1f, \"received_mb_per_sec\": %.3f },\n"
+                "  \"rtt_ms\": { \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f },\n"
+                "  \"fairness\": { \"jain_index\": %.4f, \"min\": %.0f, \"p10\": %.0f, \"p50\": "
+                "%.0f, \"p90\": %.0f, \"max\": %.0f },\n",
+                opts_.sessions, opts_.connect_rate, opts_.rate, opts_.size, opts_.duration,
+                opts_.threads, online, static_cast< unsigned long long >( failures_.load() ),
+                percentile( connect_ms, 0.5 ), percentile( connect_ms, 0.9 ),
+                percentile( connect_ms, 0.99 ), percentile( connect_ms, 1.0 ), sent / elapsed,
+                received / elapsed, received_bytes / elapsed / ( 1024. * 1024. ),
+                percentile( rtts, 0.5 ), percentile( rtts, 0.9 ), percentile( rtts, 0.99 ),
+                percentile( rtts, 1.0 ), fair, percentile( per_session, 0 ),
+                percentile( per_session, 0.1 ), percentile( per_session, 0.5 ),
+                percentile( per_session, 0.9 ), percentile( per_session, 1.0 ) );
+
+            std::cout << buffer;
+
+            if ( is_tls ) {
+                std::snprintf( buffer, sizeof( buffer ),
+                               "  \"tls\": { \"full\": %zu, \"resumed\": %zu, "
+                               "\"full_ms\": { \"p50\": %.2f, \"p99\": %.2f }, "
+                               "\"resumed_ms\": { \"p50\": %.2f, \"p99\": %.2f } },\n",
+                               full_tls_ms.size(), resumed_tls_ms.size(),
+                               percentile( full_tls_ms, 0.5 ), percentile( full_tls_ms, 0.99 ),
+                               percentile( resumed_tls_ms, 0.5 ),
+                               percentile( resumed_tls_ms, 0.99 ) );
+                std::cout << buffer;
+            }
+
+            if ( !opts_.codecs.empty() ) {
+                std::cout << "  \"codecs\": {";
+
+                for ( size_t i = 0; i < codecs.size(); ++i )
+                    std::cout << ( i ? ", " : " " ) << "\""
+                              << o::codec_name( o::all_codecs[i] ) << "\": " << codecs[i];
+
+                std::cout << " },\n";
+            }
+
+            std::cout << "  \"errors\": {";
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+
+            bool first = true;
+            for ( auto& error : errors_ ) {
+                std::cout << ( first ? " " : ", " ) << "\"" << error.first
+                          << "\": " << error.second;
+                first = false;
+            }
+
+            std::cout << " }\n}" << std::endl;
+        }
+
+      private:
+        struct shard {
+            explicit shard( boost::asio::io_context& ctx ) : timer( ctx ) {}
+
+            boost::asio::steady_timer timer;
+            clock::time_point deadline;
+            std::vector< client* > clients;
+        };
+
+        // ------------------------- connecting
+
+        std::shared_ptr< session_type > make_session() {
+#ifdef MAXNET_ENABLE_TLS
+            if constexpr ( is_tls )
+                return std::make_shared< session_type >( ctx_, *tls_, shared_factory(),
+                                                          &session_count() );
+            else
+#endif
+                return std::make_shared< session_type >( ctx_, shared_factory(),
+                                                          &session_count() );
+        }
+
+        void schedule_connects() {
+            connect_timer_.expires_after( std::chrono::milliseconds( 1 ) );
+            connect_timer_.async_wait( [this]( boost::system::error_code ec ) {
+                if ( ec || stopped_ )
+                    return;
+
+                // ramp up at the connect rate
+                double since_start =
+                    std::chrono::duration< double >( clock::now() - started_ ).count();
+
+                auto due = opts_.connect_rate > 0
+                               ? std::min( opts_.sessions, static_cast< size_t >(
+                                                               since_start * opts_.connect_rate ) +
+                                                               1 )
+                               : opts_.sessions;
+
+                while ( next_connect_ < due )
+                    connect( clients_[next_connect_++].get() );
+
+                if ( next_connect_ < opts_.sessions )
+                    schedule_connects();
+            } );
+        }
+
+        void connect( client* cl ) {
+
+            cl->connect_started = clock::now();
+
+            cl->session->on_ready( [this, cl]( boost::system::error_code ec ) {
+                if ( ec ) {
+                    cl->status = client::state::failed;
+                    failures_++;
+                    count_error( ec );
+                    return;
+                }
+
+                cl->connect_ms = std::chrono::duration< double, std::milli >(
+                                     clock::now() - cl->connect_started )
+                                     .count();
+
+                if ( is_tls ) {
+                    auto& stats = cl->session->stats();
+                    std::lock_guard< std::mutex > lock{ stats.mtx() };
+                    cl->tls_ms = stats.tls_handshakes().sum() / 1e3;
+                    cl->resumed = stats.resumed_handshakes() > 0;
+                }
+
+                cl->codec = cl->session->codec();
+                cl->session->stream().binary( true );
+                cl->status = client::state::online;
+            } );
+
+            cl->session->on_read(
+                [this, cl]( boost::system::error_code ec, message_type* msg, size_t bytes ) {
+                    if ( msg == nullptr ) {
+                        if ( cl->status == client::state::online ) {
+                            cl->status = client::state::closed;
+                            if ( !stopped_ )
+                                count_error( ec );
+                        }
+                        return;
+                    }
+
+                    handle_message( cl, msg, bytes );
+                } );
+
+            cl->session->set_codecs( opts_.codecs );
+
+            cl->session->on_write_done( [cl]( const message_type* msg ) {
+                cl->in_flight--;
+                shared_factory().deallocate( msg );
+            } );
+
+            cl->session->connect( url_ );
+        }
+
+        void count_error( boost::system::error_code ec ) {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            errors_[ec.message()]++;
+        }
+
+        // ------------------------- traffic
+
+        void schedule_sends( shard* sh ) {
+            sh->timer.expires_at( sh->deadline += send_tick );
+            sh->timer.async_wait( [this, sh]( boost::system::error_code ec ) {
+                if ( ec || stopped_ )
+                    return;
+
+                send_tick_for( sh );
+
+                // do not catch up with a burst after a stall
+                sh->deadline = std::max( sh->deadline, clock::now() - send_tick );
+
+                schedule_sends( sh );
+            } );
+        }
+
+        void send_tick_for( shard* sh ) {
+
+            double per_tick =
+                opts_.rate * std::chrono::duration< double >( send_tick ).count();
+
+            for ( auto cl : sh->clients ) {
+
+                if ( cl->status != client::state::online )
+                    continue;
+
+                cl->credit += per_tick;
+
+                while ( cl->credit >= 1 ) {
+                    cl->credit -= 1;
+
+                    if ( cl->in_flight.load() >= opts_.max_in_flight ) {
+                        throttled_++;
+                        continue;
+                    }
+
+                    auto msg = shared_factory().allocate();
+                    msg->storage().resize( std::max( opts_.size, sizeof( std::int64_t ) ) );
+
+                    auto sent_ns = now_ns();
+                    std::memcpy( msg->data(), &sent_ns, sizeof( sent_ns ) );
+
+                    cl->in_flight++;
+                    cl->sent++;
+                    cl->session->write( msg );
+                }
+            }
+        }
+
+        void handle_message( client* cl, message_type* msg, size_t bytes ) {
+
+            cl->received++;
+            cl->received_bytes += bytes;
+
+            // echoed messages carry our send time
+            if ( msg->size() >= sizeof( std::int64_t ) &&
+                 msg->size() == std::max( opts_.size, sizeof( std::int64_t ) ) ) {
+
+                std::int64_t sent_ns;
+                std::memcpy( &sent_ns, msg->data(), sizeof( sent_ns ) );
+
+                auto rtt = ( now_ns() - sent_ns ) / 1e6;
+
+                if ( rtt >= 0 && rtt < 60e3 ) {
+                    std::lock_guard< std::mutex > lock{ mtx_ };
+                    if ( rtt_ms_.size() < max_rtt_samples )
+                        rtt_ms_.push_back( rtt );
+                }
+            }
+
+            shared_factory().deallocate( msg );
+        }
+
+        // ------------------------- progress
+
+        void schedule_report() {
+            report_timer_.expires_after( std::chrono::seconds( 1 ) );
+            report_timer_.async_wait( [this]( boost::system::error_code ec ) {
+                if ( ec || stopped_ )
+                    return;
+
+                size_t online = 0;
+                std::uint64_t received = 0;
+
+                for ( auto& cl : clients_ ) {
+                    online += cl->status == client::state::online;
+                    received += cl->received;
+                }
+
+                auto now = clock::now();
+                double elapsed = std::chrono::duration< double >( now - last_report_ ).count();
+                last_report_ = now;
+
+                std::fprintf( stderr,
+                              "%6.1fs online: %zu failed: %llu received: %.0f msg/s "
+                              "throttled: %llu\n",
+                              std::chrono::duration< double >( now - started_ ).count(),
+                              online, static_cast< unsigned long long >( failures_.load() ),
+                              ( received - last_received_ ) / elapsed,
+                              static_cast< unsigned long long >( throttled_.exchange( 0 ) ) );
+
+                last_received_ = received;
+
+                schedule_report();
+            } );
+        }
+
+        boost::asio::io_context& ctx_;
+        const options& opts_;
+
+        net_url<> url_;
+
+        boost::asio::steady_timer connect_timer_;
+        boost::asio::steady_timer report_timer_;
+
+        std::vector< std::unique_ptr< client > > clients_;
+        std::vector< std::unique_ptr< shard > > shards_;
+
+        size_t next_connect_ = 0;
+
+        clock::time_point started_;
+        clock::time_point finished_;
+        clock::time_point last_report_;
+        std::uint64_t last_received_ = 0;
+
+        std::atomic< bool > stopped_{ false };
+        std::atomic< std::uint64_t > failures_{ 0 };
+        std::atomic< std::uint64_t > throttled_{ 0 };
+
+        std::mutex mtx_;
+        std::map< std::string, std::uint64_t > errors_;
+        std::vector< double > rtt_ms_;
+
+        boost::system::error_code tls_error_;
+#ifdef MAXNET_ENABLE_TLS
+        std::unique_ptr< o::tls_context > tls_;
+#endif
+    };
+
+    bool parse_options( int argc, char** argv, options& opts ) {
+
+        for ( int i = 1; i < argc; ++i ) {
+
+            std::string arg = argv[i];
+
+            if ( i + 1 >= argc ) {
+                std::cerr << "missing value for " << arg << std::endl;
+                return false;
+            }
+
+            std::string value = argv[++i];
+
+            try {
+                if ( arg == "--host" ) {
+                    opts.host = value;
+                } else if ( arg == "--port" ) {
+                    opts.port = static_cast< unsigned short >( std::stoul( value ) );
+                } else if ( arg == "--sessions" ) {
+                    opts.sessions = std::max< size_t >( std::stoul( value ), 1 );
+                } else if ( arg == "--connect-rate" ) {
+                    opts.connect_rate = std::stod( value );
+                } else if ( arg == "--rate" ) {
+                    opts.rate = std::stod( value );
+                } else if ( arg == "--size" ) {
+                    opts.size = std::stoul( value );
+                } else if ( arg == "--duration" ) {
+                    opts.duration = std::stod( value );
+                } else if ( arg == "--threads" ) {
+                    opts.threads = std::max< size_t >( std::stoul( value ), 1 );
+                } else if ( arg == "--max-in-flight" ) {
+                    opts.max_in_flight = std::max< size_t >( std::stoul( value ), 1 );
+                } else if ( arg == "--tls" ) {
+                    opts.tls = std::stoi( value ) != 0;
+                } else if ( arg == "--ca" ) {
+                    opts.ca_file = value;
+                } else if ( arg == "--verify" ) {
+                    opts.verify = std::stoi( value ) != 0;
+                } else if ( arg == "--ciphers" ) {
+                    if ( value != "auto" && value != "aes-gcm" && value != "chacha20" )
+                        return false;
+                    opts.ciphers = value;
+                } else if ( arg == "--codecs" ) {
+                    if ( !o::codec_parse_list( value, opts.codecs ) )
+                        return false;
+                } else {
+                    std::cerr << "unknown option " << arg << std::endl;
+                    return false;
+                }
+            } catch ( std::exception& ex ) {
+                std::cerr << "invalid value for " << arg << ": " << value << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// thousands of sessions need more file descriptors than most defaults allow
+    void raise_file_limit( size_t sessions ) {
+#ifndef _WIN32
+        rlimit limit;
+
+        if ( getrlimit( RLIMIT_NOFILE, &limit ) != 0 )
+            return;
+
+        if ( limit.rlim_cur < sessions + 64 ) {
+            limit.rlim_cur = std::min< rlim_t >( limit.rlim_max, sessions + 64 );
+            setrlimit( RLIMIT_NOFILE, &limit );
+        }
+#endif
+    }
+
+    template < typename Stream >
+    int run( const options& opts ) {
+
+        boost::asio::io_context ctx;
+        auto work = boost::asio::make_work_guard( ctx );
+
+        load_generator< Stream > generator{ ctx, opts };
+
+        std::vector< std::thread > workers;
+        for ( size_t i = 0; i < opts.threads; ++i )
+            workers.emplace_back( [&ctx]() { ctx.run(); } );
+
+        if ( generator.start() )
+            std::this_thread::sleep_for( std::chrono::duration< double >( opts.duration ) );
+
+        generator.stop();
+
+        // leave the sessions some time for their close handshakes
+        auto deadline = clock::now() + std::chrono::seconds( 2 );
+
+        while ( clock::now() < deadline && generator.busy() )
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+        work.reset();
+        ctx.stop();
+
+        for ( auto& worker : workers )
+            worker.join();
+
+        generator.print_summary();
+
+        return 0;
+    }
+} // namespace loadgen
+
+int main( int argc, char** argv ) {
+
+    loadgen::options opts;
+
+    if ( !loadgen::parse_options( argc, argv, opts ) ) {
+        std::cerr << "usage: maxnet_loadgen [--host h] [--port p] [--sessions n] "
+                     "[--connect-rate n] [--rate hz] [--size bytes] [--duration s] "
+                     "[--threads n] [--max-in-flight n] [--tls 0|1] [--ca file] "
+                     "[--verify 0|1] [--ciphers auto|aes-gcm|chacha20] "
+                     "[--codecs protobuf,osc,json]"
+                  << std::endl;
+        return 1;
+    }
+
+    loadgen::raise_file_limit( opts.sessions );
+
+#ifdef MAXNET_ENABLE_TLS
+    if ( opts.tls )
+        return loadgen::run< loadgen::tls_stream_type >( opts );
+#else
+    if ( opts.tls ) {
+        std::cerr << "built without tls support" << std::endl;
+        return 1;
+    }
+#endif
+
+    return loadgen::run< loadgen::stream_type >( opts );
+}
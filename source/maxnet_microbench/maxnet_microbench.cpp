@@ -0,0 +1,423 @@
+//
+// This file is part of the Max Network Extensions Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Microbenchmarks for the message encode / decode paths. Every benchmark
+// reports the time per operation and an allocs/op counter taken from the
+// global operator new below.
+//
+//   maxnet_microbench --benchmark_filter=max_message
+
+#include "c74_min.h"
+#include "codecs/json_atoms.h"
+#include "proto_messages/generic_max_message.h"
+#include "proto_messages/iiwa_message.h"
+#include "proto_messages/joint_stream.h"
+#include "proto_messages/wire_atoms_decoder.h"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// ------------------------- allocation counting
+
+namespace {
+    std::atomic< size_t > allocation_count{ 0 };
+}
+
+void* operator new( size_t size ) {
+    allocation_count.fetch_add( 1, std::memory_order_relaxed );
+    if ( void* ptr = std::malloc( size ? size : 1 ) )
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[]( size_t size ) { return operator new( size ); }
+
+void* operator new( size_t size, const std::nothrow_t& ) noexcept {
+    allocation_count.fetch_add( 1, std::memory_order_relaxed );
+    return std::malloc( size ? size : 1 );
+}
+
+void* operator new[]( size_t size, const std::nothrow_t& tag ) noexcept {
+    return operator new( size, tag );
+}
+
+void operator delete( void* ptr ) noexcept { std::free( ptr ); }
+void operator delete[]( void* ptr ) noexcept { std::free( ptr ); }
+void operator delete( void* ptr, size_t ) noexcept { std::free( ptr ); }
+void operator delete[]( void* ptr, size_t ) noexcept { std::free( ptr ); }
+
+namespace {
+
+    /// counts the allocations of the timed loop, use as first statement of a benchmark
+    class allocation_scope {
+      public:
+        explicit allocation_scope( benchmark::State& state ) : state_( state ) {}
+
+        ~allocation_scope() {
+            state_.counters["allocs/op"] = benchmark::Counter(
+                static_cast< double >( allocation_count.load() - begin_ ),
+                benchmark::Counter::kAvgIterations );
+        }
+
+        /// start counting here, after the setup of the benchmark
+        void start() { begin_ = allocation_count.load(); }
+
+      private:
+        benchmark::State& state_;
+        size_t begin_ = 0;
+    };
+
+    // ------------------------- test data
+
+    enum atom_mix { ints, floats, symbols, mixed, arrays };
+
+    const char* mix_name( int64_t mix ) {
+        switch ( mix ) {
+        case ints:
+            return "ints";
+        case floats:
+            return "floats";
+        case symbols:
+            return "symbols";
+        case mixed:
+            return "mixed";
+        default:
+            return "arrays";
+        }
+    }
+
+    c74::min::atoms make_atoms( size_t count, int64_t mix ) {
+
+        static const std::array< c74::min::symbol, 4 > syms{
+            c74::min::symbol( "position" ), c74::min::symbol( "velocity" ),
+            c74::min::symbol( "a_longer_symbol_name" ), c74::min::symbol( "x" )
+        };
+
+        c74::min::atoms out;
+        out.reserve( count );
+
+        for ( size_t i = 0; i < count; ++i ) {
+
+            int64_t kind = mix == mixed ? static_cast< int64_t >( i % 3 ) : mix;
+
+            switch ( kind ) {
+            case symbols:
+                out.emplace_back( syms[i % syms.size()] );
+                break;
+            case floats:
+                out.emplace_back( static_cast< double >( i ) * 0.25 );
+                break;
+            default:
+                out.emplace_back( static_cast< long >( i * 37 ) );
+            }
+        }
+
+        return out;
+    }
+
+    /// fill msg with count atoms, arrays are pushed as one int and one float array
+    void fill_message( o::max_message& msg, size_t count, int64_t mix ) {
+
+        msg.proto()->Clear();
+
+        if ( mix != arrays ) {
+            msg.push_atoms( make_atoms( count, mix ) );
+            return;
+        }
+
+        auto ints_part = make_atoms( ( count + 1 ) / 2, ints );
+        auto floats_part = make_atoms( count / 2, floats );
+
+        msg.push_atomarray( ints_part.begin(), ints_part.end(),
+                            c74::max::e_max_atomtypes::A_LONG );
+
+        if ( !floats_part.empty() )
+            msg.push_atomarray( floats_part.begin(), floats_part.end(),
+                                c74::max::e_max_atomtypes::A_FLOAT );
+    }
+
+    void atom_args( benchmark::internal::Benchmark* bench ) {
+        for ( int64_t mix = ints; mix <= arrays; ++mix )
+            for ( int64_t count : { 1, 8, 64, 512 } )
+                bench->Args( { count, mix } );
+    }
+
+    void set_label( benchmark::State& state ) { state.SetLabel( mix_name( state.range( 1 ) ) ); }
+
+    // ------------------------- max_message
+
+    void max_message_push_atoms( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        auto count = static_cast< size_t >( state.range( 0 ) );
+        auto atms = make_atoms( count, state.range( 1 ) == arrays ? mixed : state.range( 1 ) );
+
+        o::max_message msg;
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            msg.proto()->Clear();
+            msg.push_atoms( atms );
+            benchmark::DoNotOptimize( msg.proto() );
+        }
+
+        set_label( state );
+    }
+
+    void max_message_serialize( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        o::max_message msg;
+        fill_message( msg, static_cast< size_t >( state.range( 0 ) ), state.range( 1 ) );
+
+        size_t bytes = 0;
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            msg.serialize();
+            benchmark::DoNotOptimize( msg.data() );
+            bytes = msg.size();
+            msg.release_frame();
+        }
+
+        state.SetBytesProcessed( static_cast< int64_t >( state.iterations() * bytes ) );
+        set_label( state );
+    }
+
+    void max_message_deserialize( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        o::max_message msg;
+        fill_message( msg, static_cast< size_t >( state.range( 0 ) ), state.range( 1 ) );
+        msg.serialize();
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            benchmark::DoNotOptimize( msg.deserialize() );
+        }
+
+        state.SetBytesProcessed( static_cast< int64_t >( state.iterations() * msg.size() ) );
+        set_label( state );
+    }
+
+    void max_message_get_atoms( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        o::max_message msg;
+        fill_message( msg, static_cast< size_t >( state.range( 0 ) ), state.range( 1 ) );
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            auto atms = msg.get_atoms();
+            benchmark::DoNotOptimize( atms.data() );
+        }
+
+        set_label( state );
+    }
+
+    /// the path the outlets use: decode straight from the wire into reused atoms
+    void max_message_decode_atoms( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        o::max_message msg;
+        fill_message( msg, static_cast< size_t >( state.range( 0 ) ), state.range( 1 ) );
+        msg.serialize();
+
+        o::max_message::atoms_decoder decoder;
+        c74::min::atoms out;
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            msg.decode_atoms( decoder, out );
+            benchmark::DoNotOptimize( out.data() );
+        }
+
+        state.SetBytesProcessed( static_cast< int64_t >( state.iterations() * msg.size() ) );
+        set_label( state );
+    }
+
+    // ------------------------- json frames
+
+    void json_encode( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        auto atms = make_atoms( static_cast< size_t >( state.range( 0 ) ),
+                                state.range( 1 ) == arrays ? mixed : state.range( 1 ) );
+
+        o::max_message msg;
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            msg.serialize_json( atms );
+            benchmark::DoNotOptimize( msg.data() );
+        }
+
+        state.SetBytesProcessed( static_cast< int64_t >( state.iterations() * msg.size() ) );
+        set_label( state );
+    }
+
+    void json_decode( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        auto atms = make_atoms( static_cast< size_t >( state.range( 0 ) ),
+                                state.range( 1 ) == arrays ? mixed : state.range( 1 ) );
+
+        o::max_message msg;
+        msg.serialize_json( atms );
+
+        o::max_message::atoms_decoder decoder;
+        c74::min::atoms out;
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            msg.decode_atoms( decoder, out );
+            benchmark::DoNotOptimize( out.data() );
+        }
+
+        state.SetBytesProcessed( static_cast< int64_t >( state.iterations() * msg.size() ) );
+        set_label( state );
+    }
+
+    // ------------------------- iiwa
+
+    void iiwa_movement_serialize( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        iiwa_movement_message msg;
+
+        size_t bytes = 0;
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            msg.proto()->Clear();
+            msg.set_move_type( iiwa::Movement::JOINT );
+            msg.set_joint_params( 0.5, 0.2, 0.1, 0. );
+            msg.set_filter_params( 0.01, 0.2, 0.001 );
+            msg.add_joints( 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7 );
+            msg.serialize();
+            benchmark::DoNotOptimize( msg.data() );
+            bytes = msg.size();
+            msg.release_frame();
+        }
+
+        state.SetBytesProcessed( static_cast< int64_t >( state.iterations() * bytes ) );
+    }
+
+    void iiwa_joint_stream_encode( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        o::joint_stream_encoder<> encoder;
+        iiwa::JointStream frame;
+        iiwa::Movement::JointParameter joint_params;
+        iiwa::Movement::FilterParameter filter_params;
+        std::string out;
+
+        std::array< double, 7 > positions{ 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7 };
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            for ( auto& p : positions )
+                p += 1e-4;
+
+            encoder.encode( positions, joint_params, filter_params, &frame );
+            frame.SerializeToString( &out );
+            benchmark::DoNotOptimize( out.data() );
+        }
+
+        state.SetBytesProcessed( static_cast< int64_t >( state.iterations() * out.size() ) );
+    }
+
+    // cost on the calling thread, the flusher formats into a sink that drops the lines
+    void log_record( benchmark::State& state ) {
+
+        allocation_scope allocs{ state };
+
+        o::logging::global().set_sink( []( o::logging::level, std::string_view ) {} );
+        o::logging::set_level( o::logging::level::info );
+
+        std::string peer = "127.0.0.1:8080";
+        size_t bytes = 0;
+
+        allocs.start();
+
+        for ( auto _ : state ) {
+            O_LOG_INFO( "wrote ", ++bytes, " bytes to ", peer, " in ", 0.25, " ms" );
+        }
+
+        o::logging::global().flush();
+        state.counters["dropped"] = static_cast< double >( o::logging::global().dropped() );
+    }
+
+    void log_filtered( benchmark::State& state ) {
+
+        o::logging::set_level( o::logging::level::error );
+
+        size_t bytes = 0;
+
+        for ( auto _ : state ) {
+            O_LOG_INFO( "wrote ", ++bytes, " bytes" );
+            benchmark::DoNotOptimize( bytes );
+        }
+
+        o::logging::set_level( o::logging::level::info );
+    }
+} // namespace
+
+BENCHMARK( max_message_push_atoms )->Apply( atom_args );
+BENCHMARK( max_message_serialize )->Apply( atom_args );
+BENCHMARK( max_message_deserialize )->Apply( atom_args );
+BENCHMARK( max_message_get_atoms )->Apply( atom_args );
+BENCHMARK( max_message_decode_atoms )->Apply( atom_args );
+BENCHMARK( json_encode )->Apply( atom_args );
+BENCHMARK( json_decode )->Apply( atom_args );
+BENCHMARK( iiwa_movement_serialize );
+BENCHMARK( iiwa_joint_stream_encode );
+BENCHMARK( log_record );
+BENCHMARK( log_filtered );
+
+BENCHMARK_MAIN();
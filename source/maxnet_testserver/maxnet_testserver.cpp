@@ -0,0 +1,768 @@
+//
+// This file is part of the Max Network Extensions Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Test peer for the websocket objects and the benchmarks.
+//
+//   maxnet_testserver [--mode echo|sink|source|broadcast] [--port 8080]
+//                     [--address 0.0.0.0] [--rate 100] [--size 64]
+//                     [--payload zeros|random|sequence|generic_max]
+//                     [--max-in-flight 256] [--threads 2] [--quiet 0]
+//                     [--metrics 1] [--trim-idle 10] [--ping-interval 0]
+//                     [--max-missed 3] [--probe-interval 0] [--send-stamps 0]
+//                     [--tls 0] [--cert file] [--key file] [--cert-out file]
+//                     [--ciphers auto|aes-gcm|chacha20] [--codecs protobuf,osc,json]
+//
+// echo      sends every message back to its sender
+// sink      drops everything it receives
+// source    sends generated payloads to all sessions at --rate messages per second
+// broadcast relays every message to all other sessions
+//
+// Per-second statistics are printed to stderr until the server is stopped
+// with SIGINT or SIGTERM. With --metrics 1 a plain GET /metrics on the same
+// port returns the session stats in OpenMetrics text format. Read buffers of
+// sessions that received nothing for --trim-idle seconds go back to the pool.
+// With --ping-interval ms every session is pinged and closed after --max-missed
+// unanswered pings, so dead peers do not pile up during long runs.
+// --probe-interval ms measures clock offset and one-way latency to every peer,
+// --send-stamps 1 accepts per message send stamps from peers that ask for them.
+// Both show up in /metrics.
+// --tls 1 serves wss:// (only in builds with enable_tls). Without --cert the
+// server makes a self-signed certificate for localhost at startup, --cert-out
+// writes it to a file for clients to trust. Handshake times and resumed
+// sessions show up in /metrics.
+// --codecs accepts the listed codecs through Sec-WebSocket-Protocol, in order
+// of preference. Payloads are echoed as they are, whatever the codec.
+
+#include "codecs/frame_message.h"
+#include "devices/listener.h"
+#include "devices/openmetrics.h"
+#include "generated/generic_max.pb.h"
+#include "session.h"
+
+#include <boost/asio.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/beast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace testserver {
+
+    using clock = std::chrono::steady_clock;
+
+    using message_type = o::frame_message;
+
+    using stream_type = boost::beast::websocket::stream< boost::asio::ip::tcp::socket >;
+
+#ifdef MAXNET_ENABLE_TLS
+    using tls_stream_type = o::tls_websocket_stream;
+#endif
+
+    enum class mode { echo, sink, source, broadcast };
+
+    enum class payload { zeros, random, sequence, generic_max };
+
+    struct options {
+        mode run_mode = mode::echo;
+        payload payload_type = payload::sequence;
+        std::string address = "0.0.0.0";
+        unsigned short port = 8080;
+        double rate = 100;
+        size_t size = 64;
+        size_t max_in_flight = 256;
+        size_t threads = 2;
+        bool quiet = false;
+        bool metrics = true;
+        double trim_idle = 10;
+        unsigned ping_interval = 0;
+        unsigned max_missed = 3;
+        unsigned probe_interval = 0;
+        bool send_stamps = false;
+        bool tls = false;
+        std::string certificate;
+        std::string private_key;
+        std::string certificate_out;
+        std::string ciphers = "auto";
+        std::vector< o::codec > codecs;
+    };
+
+    // sessions that are still closing when the server exits are destroyed with
+    // the io_context, so everything they reference must outlive it
+    message_type::factory& shared_factory() {
+        static message_type::factory factory;
+        return factory;
+    }
+
+    std::atomic< int >& session_count() {
+        static std::atomic< int > count{ 0 };
+        return count;
+    }
+
+    /// produces the payloads of source mode
+    class payload_generator {
+      public:
+        payload_generator( payload type, size_t size ) : type_( type ), size_( size ) {
+
+            if ( type_ == payload::random ) {
+                std::mt19937 rng{ 42 };
+                pool_.resize( size_ * 2 + 1 );
+                for ( auto& byte : pool_ )
+                    byte = static_cast< char >( rng() );
+            }
+        }
+
+        /// write the next payload into msg
+        void fill( message_type* msg ) {
+
+            ++sequence_;
+
+            switch ( type_ ) {
+            case payload::zeros:
+                msg->storage().resize( size_ );
+                std::memset( msg->data(), 0, size_ );
+                break;
+            case payload::random:
+                // a moving window over a pre-generated pool, so the data changes cheaply
+                msg->storage().assign( pool_.data() + ( sequence_ % ( size_ + 1 ) ), size_ );
+                break;
+            case payload::sequence:
+                fill_sequence( msg );
+                break;
+            case payload::generic_max:
+                fill_generic_max( msg );
+                break;
+            }
+        }
+
+      private:
+        // sequence number and send time in nanoseconds, padded to size
+        void fill_sequence( message_type* msg ) {
+
+            std::uint64_t header[2] = {
+                sequence_, static_cast< std::uint64_t >(
+                               std::chrono::duration_cast< std::chrono::nanoseconds >(
+                                   clock::now().time_since_epoch() )
+                                   .count() )
+            };
+
+            msg->storage().resize( std::max( size_, sizeof( header ) ) );
+            std::memset( msg->data(), 0, msg->size() );
+            std::memcpy( msg->data(), header, sizeof( header ) );
+        }
+
+        // a sequence number followed by float atoms, roughly size bytes long.
+        // websocketclient outputs these as regular max lists.
+        void fill_generic_max( message_type* msg ) {
+
+            atoms_.Clear();
+
+            auto counter = atoms_.add_atom();
+            counter->set_type( A_LONG );
+            counter->set_int_( static_cast< google::protobuf::int32 >( sequence_ ) );
+
+            for ( size_t i = 0; atoms_.ByteSizeLong() < size_; ++i ) {
+                auto value = atoms_.add_atom();
+                value->set_type( A_FLOAT );
+                value->set_float_( static_cast< float >( std::sin( sequence_ * 0.01 + i ) ) );
+            }
+
+            msg->storage().resize( atoms_.ByteSizeLong() );
+            atoms_.SerializeWithCachedSizesToArray(
+                reinterpret_cast< google::protobuf::uint8* >( msg->data() ) );
+        }
+
+        payload type_;
+        size_t size_;
+        std::uint64_t sequence_ = 0;
+        std::vector< char > pool_;
+        generic_max atoms_;
+    };
+
+    /// totals since the last report
+    struct counters {
+        std::atomic< std::uint64_t > in_msgs{ 0 };
+        std::atomic< std::uint64_t > in_bytes{ 0 };
+        std::atomic< std::uint64_t > out_msgs{ 0 };
+        std::atomic< std::uint64_t > out_bytes{ 0 };
+        std::atomic< std::uint64_t > dropped{ 0 };
+    };
+
+    template < typename Stream >
+    class test_server {
+
+        using session_type =
+            o::session< Stream, message_type, o::sessions::roles::server >;
+
+        struct connection {
+            std::shared_ptr< session_type > session;
+            std::atomic< size_t > in_flight{ 0 };
+        };
+
+        using connection_ptr = std::shared_ptr< connection >;
+
+      public:
+        test_server( boost::asio::io_context& ctx, const options& opts )
+            : ctx_( ctx )
+            , opts_( opts )
+            , listener_( ctx )
+            , source_timer_( ctx )
+            , stats_timer_( ctx )
+            , generator_( opts.payload_type, opts.size ) {}
+
+        boost::system::error_code start() {
+
+#ifdef MAXNET_ENABLE_TLS
+            if ( o::stream_layer< typename Stream::next_layer_type >::is_tls ) {
+                if ( auto ec = setup_tls() )
+                    return ec;
+            }
+#endif
+
+            auto ec = listener_.start_listen(
+                boost::asio::ip::tcp::endpoint( boost::asio::ip::make_address( opts_.address ),
+                                                opts_.port ),
+                [this]( boost::system::error_code ec, boost::asio::ip::tcp::socket&& socket ) {
+                    if ( !ec )
+                        accept( std::move( socket ) );
+                } );
+
+            if ( ec )
+                return ec;
+
+            started_ = clock::now();
+            last_report_ = started_;
+
+            schedule_stats();
+
+            if ( opts_.run_mode == mode::source && opts_.rate > 0 ) {
+                period_ = std::chrono::duration_cast< clock::duration >(
+                    std::chrono::duration< double >( 1.0 / opts_.rate ) );
+                deadline_ = clock::now();
+                schedule_source();
+            }
+
+            return ec;
+        }
+
+        void stop() {
+
+            stopped_ = true;
+
+            source_timer_.cancel();
+            stats_timer_.cancel();
+
+            if ( listener_.status() == o::listener::status_codes::OPEN )
+                listener_.stop_listen();
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+
+            for ( auto& conn : connections_ )
+                conn->session->close();
+        }
+
+      private:
+#ifdef MAXNET_ENABLE_TLS
+        boost::system::error_code setup_tls() {
+
+            boost::system::error_code ec;
+
+            o::tls_options tls;
+            tls.certificate_file = opts_.certificate;
+            tls.private_key_file = opts_.private_key;
+
+            if ( opts_.ciphers == "aes-gcm" )
+                tls.ciphers = o::tls_ciphers::aes_gcm;
+            else if ( opts_.ciphers == "chacha20" )
+                tls.ciphers = o::tls_ciphers::chacha20;
+
+            tls_ = std::make_unique< o::tls_context >( o::tls_context::role::server, tls, ec );
+
+            if ( ec || !opts_.certificate.empty() )
+                return ec;
+
+            auto cert = o::tls_certificate::self_signed( "localhost", ec );
+
+            if ( !ec )
+                ec = tls_->use_certificate( cert );
+
+            if ( !ec && !opts_.certificate_out.empty() )
+                std::ofstream( opts_.certificate_out ) << cert.certificate;
+
+            if ( !ec )
+                std::cerr << "using a self-signed certificate for localhost" << std::endl;
+
+            return ec;
+        }
+#endif
+
+        std::shared_ptr< session_type > make_session( boost::asio::ip::tcp::socket&& socket ) {
+#ifdef MAXNET_ENABLE_TLS
+            if constexpr ( o::stream_layer< typename Stream::next_layer_type >::is_tls )
+                return std::make_shared< session_type >(
+                    std::move( socket ), *tls_, ctx_, shared_factory(), &session_count() );
+            else
+#endif
+                return std::make_shared< session_type >( std::move( socket ), ctx_,
+                                                          shared_factory(), &session_count() );
+        }
+
+        void accept( boost::asio::ip::tcp::socket&& socket ) {
+
+            auto conn = std::make_shared< connection >();
+
+            conn->session = make_session( std::move( socket ) );
+
+            std::weak_ptr< connection > weak = conn;
+
+            if ( opts_.metrics )
+                conn->session->on_http_request(
+                    [this]( const typename session_type::http_request_t& req,
+                            typename session_type::http_response_t& res ) {
+                        metrics_.serve( req, res );
+                    } );
+
+            conn->session->on_close( [this, weak]( boost::system::error_code ) {
+                if ( auto conn = weak.lock() )
+                    remove( conn );
+            } );
+
+            conn->session->on_ready( [this, weak]( boost::system::error_code ec ) {
+                auto conn = weak.lock();
+
+                if ( !conn )
+                    return;
+
+                if ( ec ) {
+                    remove( conn );
+                    return;
+                }
+
+                conn->session->stream().binary( true );
+                metrics_.add( conn->session );
+
+                if ( !opts_.quiet )
+                    std::cerr << "new connection, codec "
+                              << o::codec_name( conn->session->codec() ) << std::endl;
+            } );
+
+            conn->session->on_read(
+                [this, weak]( boost::system::error_code ec, message_type* msg, size_t bytes ) {
+                    auto conn = weak.lock();
+
+                    if ( msg == nullptr ) {
+                        if ( conn ) {
+                            if ( !opts_.quiet )
+                                std::cerr << "connection closed: " << ec.message()
+                                          << std::endl;
+                            remove( conn );
+                        }
+                        return;
+                    }
+
+                    stats_.in_msgs++;
+                    stats_.in_bytes += bytes;
+
+                    if ( conn )
+                        handle_message( conn, msg );
+                    else
+                        shared_factory().deallocate( msg );
+                } );
+
+            conn->session->on_write_done( [this, weak]( const message_type* msg ) {
+                if ( auto conn = weak.lock() )
+                    conn->in_flight--;
+                shared_factory().deallocate( msg );
+            } );
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+
+                if ( stopped_ )
+                    return;
+
+                connections_.push_back( conn );
+            }
+
+            conn->session->set_keepalive( std::chrono::milliseconds( opts_.ping_interval ),
+                                          opts_.max_missed );
+            conn->session->set_latency_probes(
+                std::chrono::milliseconds( opts_.probe_interval ) );
+            conn->session->set_send_stamps( opts_.send_stamps );
+            conn->session->set_codecs( opts_.codecs );
+            conn->session->accept();
+        }
+
+        void remove( const connection_ptr& conn ) {
+            metrics_.remove( conn->session );
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            connections_.erase(
+                std::remove( connections_.begin(), connections_.end(), conn ),
+                connections_.end() );
+        }
+
+        void handle_message( const connection_ptr& conn, message_type* msg ) {
+
+            switch ( opts_.run_mode ) {
+            case mode::echo:
+                send( conn, msg );
+                break;
+            case mode::broadcast: {
+                for ( auto& other : snapshot() ) {
+                    if ( other == conn )
+                        continue;
+
+                    auto copy = shared_factory().allocate();
+                    copy->storage().assign( msg->data(), msg->size() );
+                    copy->set_text( msg->is_text() );
+                    send( other, copy );
+                }
+
+                shared_factory().deallocate( msg );
+                break;
+            }
+            default:
+                shared_factory().deallocate( msg );
+            }
+        }
+
+        /// write msg to conn unless too many writes are pending there
+        void send( const connection_ptr& conn, message_type* msg ) {
+
+            if ( conn->in_flight.load() >= opts_.max_in_flight ||
+                 conn->session->status() != session_type::status_t::ONLINE ) {
+                stats_.dropped++;
+                shared_factory().deallocate( msg );
+                return;
+            }
+
+            conn->in_flight++;
+
+            stats_.out_msgs++;
+            stats_.out_bytes += msg->size();
+
+            conn->session->write( msg );
+        }
+
+        std::vector< connection_ptr > snapshot() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            return connections_;
+        }
+
+        void schedule_source() {
+
+            deadline_ += period_;
+
+            source_timer_.expires_at( deadline_ );
+            source_timer_.async_wait( [this]( boost::system::error_code ec ) {
+                if ( ec || stopped_ )
+                    return;
+
+                // skip the periods we missed instead of sending a burst
+                auto now = clock::now();
+                if ( now - deadline_ > period_ )
+                    deadline_ += ( ( now - deadline_ ) / period_ ) * period_;
+
+                auto targets = snapshot();
+
+                if ( !targets.empty() ) {
+
+                    auto first = shared_factory().allocate();
+                    generator_.fill( first );
+
+                    // every session gets the same payload
+                    for ( size_t i = 1; i < targets.size(); ++i ) {
+                        auto copy = shared_factory().allocate();
+                        copy->storage().assign( first->data(), first->size() );
+                        send( targets[i], copy );
+                    }
+
+                    send( targets[0], first );
+                }
+
+                schedule_source();
+            } );
+        }
+
+        void schedule_stats() {
+            stats_timer_.expires_after( std::chrono::seconds( 1 ) );
+            stats_timer_.async_wait( [this]( boost::system::error_code ec ) {
+                if ( ec || stopped_ )
+                    return;
+
+                report();
+                trim_read_buffers();
+                schedule_stats();
+            } );
+        }
+
+        void trim_read_buffers() {
+
+            auto idle = std::chrono::duration_cast< clock::duration >(
+                std::chrono::duration< double >( opts_.trim_idle ) );
+
+            for ( auto& conn : snapshot() )
+                conn->session->trim_read_buffer( idle );
+        }
+
+        void report() {
+
+            auto now = clock::now();
+
+            double elapsed = std::chrono::duration< double >( now - last_report_ ).count();
+            double uptime = std::chrono::duration< double >( now - started_ ).count();
+
+            last_report_ = now;
+
+            auto in_msgs = stats_.in_msgs.exchange( 0 );
+            auto in_bytes = stats_.in_bytes.exchange( 0 );
+            auto out_msgs = stats_.out_msgs.exchange( 0 );
+            auto out_bytes = stats_.out_bytes.exchange( 0 );
+            auto dropped = stats_.dropped.exchange( 0 );
+
+            size_t sessions;
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+                sessions = connections_.size();
+            }
+
+            char line[256];
+            std::snprintf( line, sizeof( line ),
+                           "%8.1fs sessions: %zu in: %.0f msg/s %.3f MB/s out: %.0f msg/s "
+                           "%.3f MB/s dropped: %llu read buffers: %.1f KB",
+                           uptime, sessions, in_msgs / elapsed,
+                           in_bytes / elapsed / ( 1024. * 1024. ), out_msgs / elapsed,
+                           out_bytes / elapsed / ( 1024. * 1024. ),
+                           static_cast< unsigned long long >( dropped ),
+                           o::pooled_flat_buffer::held_bytes() / 1024. );
+
+            std::cerr << line << std::endl;
+        }
+
+        boost::asio::io_context& ctx_;
+        const options& opts_;
+
+        o::listener listener_;
+
+        boost::asio::steady_timer source_timer_;
+        boost::asio::steady_timer stats_timer_;
+
+        clock::duration period_{};
+        clock::time_point deadline_;
+        clock::time_point started_;
+        clock::time_point last_report_;
+
+        payload_generator generator_;
+        counters stats_;
+
+        std::atomic< bool > stopped_{ false };
+
+        std::mutex mtx_;
+        std::vector< connection_ptr > connections_;
+
+        o::metrics_registry< session_type > metrics_;
+
+#ifdef MAXNET_ENABLE_TLS
+        std::unique_ptr< o::tls_context > tls_;
+#endif
+    };
+
+    bool parse_options( int argc, char** argv, options& opts ) {
+
+        for ( int i = 1; i < argc; ++i ) {
+
+            std::string arg = argv[i];
+
+            if ( i + 1 >= argc ) {
+                std::cerr << "missing value for " << arg << std::endl;
+                return false;
+            }
+
+            std::string value = argv[++i];
+
+            try {
+                if ( arg == "--mode" ) {
+                    if ( value == "echo" )
+                        opts.run_mode = mode::echo;
+                    else if ( value == "sink" )
+                        opts.run_mode = mode::sink;
+                    else if ( value == "source" )
+                        opts.run_mode = mode::source;
+                    else if ( value == "broadcast" )
+                        opts.run_mode = mode::broadcast;
+                    else
+                        return false;
+                } else if ( arg == "--payload" ) {
+                    if ( value == "zeros" )
+                        opts.payload_type = payload::zeros;
+                    else if ( value == "random" )
+                        opts.payload_type = payload::random;
+                    else if ( value == "sequence" )
+                        opts.payload_type = payload::sequence;
+                    else if ( value == "generic_max" )
+                        opts.payload_type = payload::generic_max;
+                    else
+                        return false;
+                } else if ( arg == "--port" ) {
+                    opts.port = static_cast< unsigned short >( std::stoul( value ) );
+                } else if ( arg == "--address" ) {
+                    opts.address = value;
+                } else if ( arg == "--rate" ) {
+                    opts.rate = std::stod( value );
+                } else if ( arg == "--size" ) {
+                    opts.size = std::stoul( value );
+                } else if ( arg == "--max-in-flight" ) {
+                    opts.max_in_flight = std::max< size_t >( std::stoul( value ), 1 );
+                } else if ( arg == "--threads" ) {
+                    opts.threads = std::max< size_t >( std::stoul( value ), 1 );
+                } else if ( arg == "--quiet" ) {
+                    opts.quiet = std::stoi( value ) != 0;
+                } else if ( arg == "--metrics" ) {
+                    opts.metrics = std::stoi( value ) != 0;
+                } else if ( arg == "--trim-idle" ) {
+                    opts.trim_idle = std::stod( value );
+                } else if ( arg == "--ping-interval" ) {
+                    opts.ping_interval = std::stoul( value );
+                } else if ( arg == "--max-missed" ) {
+                    opts.max_missed = std::max< unsigned >( std::stoul( value ), 1 );
+                } else if ( arg == "--probe-interval" ) {
+                    opts.probe_interval = std::stoul( value );
+                } else if ( arg == "--send-stamps" ) {
+                    opts.send_stamps = std::stoi( value ) != 0;
+                } else if ( arg == "--tls" ) {
+                    opts.tls = std::stoi( value ) != 0;
+                } else if ( arg == "--cert" ) {
+                    opts.certificate = value;
+                } else if ( arg == "--key" ) {
+                    opts.private_key = value;
+                } else if ( arg == "--cert-out" ) {
+                    opts.certificate_out = value;
+                } else if ( arg == "--ciphers" ) {
+                    if ( value != "auto" && value != "aes-gcm" && value != "chacha20" )
+                        return false;
+                    opts.ciphers = value;
+                } else if ( arg == "--codecs" ) {
+                    if ( !o::codec_parse_list( value, opts.codecs ) )
+                        return false;
+                } else {
+                    std::cerr << "unknown option " << arg << std::endl;
+                    return false;
+                }
+            } catch ( std::exception& ex ) {
+                std::cerr << "invalid value for " << arg << ": " << value << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    template < typename Stream >
+    int run( const options& opts ) {
+
+        boost::asio::io_context ctx;
+
+        test_server< Stream > server{ ctx, opts };
+
+        auto ec = server.start();
+
+        if ( ec ) {
+            std::cerr << "could not listen on " << opts.address << ":" << opts.port << ": "
+                      << ec.message() << std::endl;
+            return 1;
+        }
+
+        std::cerr << "listening on " << opts.address << ":" << opts.port << std::endl;
+
+        boost::asio::steady_timer exit_timer{ ctx };
+        boost::asio::signal_set signals{ ctx, SIGINT, SIGTERM };
+
+        signals.async_wait( [&]( boost::system::error_code ec, int ) {
+            if ( ec )
+                return;
+
+            server.stop();
+
+            // leave the sessions some time for their close handshakes
+            exit_timer.expires_after( std::chrono::seconds( 1 ) );
+            exit_timer.async_wait( [&]( boost::system::error_code ) { ctx.stop(); } );
+        } );
+
+        std::vector< std::thread > workers;
+        for ( size_t i = 1; i < opts.threads; ++i )
+            workers.emplace_back( [&ctx]() { ctx.run(); } );
+
+        ctx.run();
+
+        for ( auto& worker : workers )
+            worker.join();
+
+        return 0;
+    }
+} // namespace testserver
+
+int main( int argc, char** argv ) {
+
+    testserver::options opts;
+
+    if ( !testserver::parse_options( argc, argv, opts ) ) {
+        std::cerr << "usage: maxnet_testserver [--mode echo|sink|source|broadcast] "
+                     "[--port p] [--address a] [--rate hz] [--size bytes] "
+                     "[--payload zeros|random|sequence|generic_max] [--max-in-flight n] "
+                     "[--threads n] [--quiet 0|1] [--metrics 0|1] "
+                     "[--trim-idle s] [--ping-interval ms] [--max-missed n] "
+                     "[--probe-interval ms] [--send-stamps 0|1] [--tls 0|1] [--cert file] "
+                     "[--key file] [--cert-out file] [--ciphers auto|aes-gcm|chacha20] "
+                     "[--codecs protobuf,osc,json]"
+                  << std::endl;
+        return 1;
+    }
+
+#ifdef MAXNET_ENABLE_TLS
+    if ( opts.tls )
+        return testserver::run< testserver::tls_stream_type >( opts );
+#else
+    if ( opts.tls ) {
+        std::cerr << "built without tls support" << std::endl;
+        return 1;
+    }
+#endif
+
+    return testserver::run< testserver::stream_type >( opts );
+}
@@ -64,6 +64,12 @@ namespace o {
             session_ = std::make_shared< session_impl_type >( this->context(), factory_,
                                                               &connections_refc_ );
 
+            session_->set_socket_options( socket_options_ );
+            session_->set_stream_tuning( stream_tuning_ );
+            session_->set_keepalive( keepalive_interval_, keepalive_max_missed_ );
+            session_->set_latency_probes( probe_interval_ );
+            session_->set_send_stamps( send_stamps_ );
+
             if ( !url.is_resolved() ) {
 
                 resolver_.resolve(
@@ -83,6 +89,40 @@ namespace o {
                 session_->close();
         }
 
+        /// options for the current and all following sessions
+        void set_socket_options( const socket_options& options ) {
+            socket_options_ = options;
+            if ( session_ )
+                session_->set_socket_options( options );
+        }
+
+        /**
+         * stream tuning for the current and all following sessions, false if the
+         * read buffer type only applies from the next session on
+         */
+        bool set_stream_tuning( const stream_tuning& tuning ) {
+            stream_tuning_ = tuning;
+            return !session_ || session_->set_stream_tuning( tuning );
+        }
+
+        /// keepalive for the current and all following sessions, see session::set_keepalive
+        void set_keepalive( std::chrono::milliseconds interval, unsigned max_missed ) {
+            keepalive_interval_ = interval;
+            keepalive_max_missed_ = max_missed;
+            if ( session_ )
+                session_->set_keepalive( interval, max_missed );
+        }
+
+        /// latency probes for the current and all following sessions
+        void set_latency_probes( std::chrono::milliseconds interval ) {
+            probe_interval_ = interval;
+            if ( session_ )
+                session_->set_latency_probes( interval );
+        }
+
+        /// send stamps for all following sessions, see session::set_send_stamps
+        void set_send_stamps( bool enabled ) { send_stamps_ = enabled; }
+
         void send( const MessageType* msg ) { session_->write( msg ); }
 
         MessageType* new_msg() { return factory_.allocate(); }
@@ -127,5 +167,14 @@ namespace o {
         multi_resolver< boost::asio::ip::tcp > resolver_{ this->context() };
 
         std::atomic< int > connections_refc_;
+
+        socket_options socket_options_;
+        stream_tuning stream_tuning_;
+
+        std::chrono::milliseconds keepalive_interval_{ 0 };
+        unsigned keepalive_max_missed_ = 3;
+
+        std::chrono::milliseconds probe_interval_{ 0 };
+        bool send_stamps_ = false;
     };
 } // namespace o
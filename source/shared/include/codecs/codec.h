@@ -0,0 +1,159 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace o {
+
+    /// message formats that can be negotiated through Sec-WebSocket-Protocol
+    enum class codec { protobuf_v1, osc, json };
+
+    static constexpr std::array< codec, 3 > all_codecs = { codec::protobuf_v1, codec::osc,
+                                                            codec::json };
+
+    /// the websocket subprotocol token for a codec
+    inline const char* codec_name( codec cd ) {
+        switch ( cd ) {
+        case codec::protobuf_v1:
+            return "maxnet.protobuf.v1";
+        case codec::osc:
+            return "maxnet.osc";
+        case codec::json:
+            return "maxnet.json";
+        default:
+            return "";
+        }
+    }
+
+    inline bool codec_from_name( std::string_view name, codec& out ) {
+        for ( auto cd : all_codecs ) {
+            if ( name == codec_name( cd ) ) {
+                out = cd;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// accepts the subprotocol token or the short name: protobuf, osc or json
+    inline bool codec_parse( std::string_view name, codec& out ) {
+
+        if ( name == "protobuf" ) {
+            out = codec::protobuf_v1;
+            return true;
+        }
+
+        if ( name == "osc" ) {
+            out = codec::osc;
+            return true;
+        }
+
+        if ( name == "json" ) {
+            out = codec::json;
+            return true;
+        }
+
+        return codec_from_name( name, out );
+    }
+
+    /// parse a comma or space separated list of codec names, false on unknown names
+    inline bool codec_parse_list( std::string_view list, std::vector< codec >& out ) {
+
+        out.clear();
+
+        while ( !list.empty() ) {
+
+            auto end = list.find_first_of( ", " );
+            auto name = list.substr( 0, end );
+
+            codec cd;
+
+            if ( !name.empty() ) {
+                if ( !codec_parse( name, cd ) )
+                    return false;
+                out.push_back( cd );
+            }
+
+            if ( end == std::string_view::npos )
+                break;
+
+            list.remove_prefix( end + 1 );
+        }
+
+        return true;
+    }
+
+    /// comma separated list of codec tokens for the Sec-WebSocket-Protocol header
+    inline std::string codec_list( const std::vector< codec >& codecs ) {
+        std::string out;
+        for ( auto cd : codecs ) {
+            if ( !out.empty() )
+                out.append( ", " );
+            out.append( codec_name( cd ) );
+        }
+        return out;
+    }
+
+    /**
+     * Pick the first codec of our preference list that the peer offered in its
+     * Sec-WebSocket-Protocol header. Returns false if there is no match.
+     */
+    inline bool codec_negotiate( std::string_view offered,
+                                 const std::vector< codec >& preference, codec& out ) {
+
+        for ( auto cd : preference ) {
+
+            std::string_view rest = offered;
+
+            while ( !rest.empty() ) {
+
+                auto comma = rest.find( ',' );
+                auto token = rest.substr( 0, comma );
+
+                while ( !token.empty() && ( token.front() == ' ' || token.front() == '\t' ) )
+                    token.remove_prefix( 1 );
+                while ( !token.empty() && ( token.back() == ' ' || token.back() == '\t' ) )
+                    token.remove_suffix( 1 );
+
+                if ( token == codec_name( cd ) ) {
+                    out = cd;
+                    return true;
+                }
+
+                if ( comma == std::string_view::npos )
+                    break;
+
+                rest.remove_prefix( comma + 1 );
+            }
+        }
+
+        return false;
+    }
+} // namespace o
@@ -0,0 +1,145 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../devices/small_buffer.h"
+#include "c74_min.h"
+#include "codec.h"
+#include "json_atoms.h"
+#include "osc_message.h"
+#include "proto_messages/wire_atoms_decoder.h"
+#include "proto_messages/wire_atoms_encoder.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+#include <boost/asio/buffer.hpp>
+
+namespace o {
+
+    /**
+     * Message type for sessions that negotiate their codec per connection.
+     * It carries the raw frame and decodes / encodes atoms with whatever codec
+     * the session selected during the handshake.
+     */
+    class codec_message {
+      public:
+        class codec_message_allocator {
+          public:
+            codec_message* allocate() {
+                alloc_msg_count++;
+                return new codec_message();
+            }
+
+            void deallocate( const codec_message* msg ) {
+                alloc_msg_count--;
+                delete msg;
+            }
+
+            ~codec_message_allocator() { assert( alloc_msg_count.load() == 0 ); }
+
+          private:
+            std::atomic< size_t > alloc_msg_count{ 0 };
+        };
+
+        typedef codec_message_allocator factory;
+
+        struct atoms_decoder {
+            wire_atoms_decoder wire;
+            json_atoms_decoder json;
+        };
+
+        using storage_type = small_buffer< 128 >;
+
+        template < typename ConstBufferSequence >
+        static void from_const_buffers( ConstBufferSequence buffers, codec_message* msg,
+                                        bool text ) {
+            msg->data_.resize( boost::asio::buffer_size( buffers ) );
+            boost::asio::buffer_copy(
+                boost::asio::buffer( msg->data_.data(), msg->data_.size() ), buffers );
+        }
+
+        const char* data() const { return data_.data(); }
+
+        size_t size() const { return data_.size(); }
+
+        storage_type& storage() { return data_; }
+
+        o::codec codec() const { return codec_; }
+
+        /// called by the session with the codec it negotiated
+        void set_codec( o::codec cd ) { codec_ = cd; }
+
+        bool is_text() const { return codec_ == codec::json; }
+
+        /// send time of a stamped message in nanoseconds of the local system clock, 0 if unknown
+        std::int64_t send_time() const { return send_time_; }
+
+        /// called by the session for stamped messages, see session::set_send_stamps
+        void set_send_time( std::int64_t time ) { send_time_ = time; }
+
+        template < typename Handler >
+        bool visit_atoms( atoms_decoder& decoder, c74::min::atoms& out,
+                          Handler&& handler ) const {
+
+            switch ( codec_ ) {
+            case codec::osc:
+                return osc_message::visit_atoms( data_.data(), data_.size(), out, handler );
+            case codec::json:
+                if ( !decoder.json.decode( data_.data(), data_.size(), out ) )
+                    return false;
+                break;
+            default:
+                if ( !decoder.wire.decode( data_.data(), data_.size(), out ) )
+                    return false;
+            }
+
+            handler( out );
+            return true;
+        }
+
+        /// encode atms with the current codec
+        void serialize_atoms( const c74::min::atoms& atms ) {
+            switch ( codec_ ) {
+            case codec::osc:
+                osc_message::encode_atoms( atms, data_ );
+                break;
+            case codec::json:
+                data_.clear();
+                json_encode_atoms( atms, data_ );
+                break;
+            default:
+                wire_atoms_encoder::encode( atms, data_ );
+            }
+        }
+
+      private:
+        storage_type data_;
+        std::int64_t send_time_ = 0;
+        o::codec codec_ = codec::protobuf_v1;
+    };
+} // namespace o
@@ -0,0 +1,99 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../devices/small_buffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/asio/buffer.hpp>
+
+namespace o {
+
+    /**
+     * Message type that carries the raw bytes of a frame without any codec.
+     * Used by the tools that run sessions outside of Max.
+     */
+    class frame_message {
+      public:
+        class frame_message_allocator {
+          public:
+            frame_message* allocate() {
+                alloc_msg_count++;
+                return new frame_message();
+            }
+
+            void deallocate( const frame_message* msg ) {
+                alloc_msg_count--;
+                delete msg;
+            }
+
+            /// messages that were allocated but not returned yet
+            size_t outstanding() const { return alloc_msg_count.load(); }
+
+          private:
+            std::atomic< size_t > alloc_msg_count{ 0 };
+        };
+
+        typedef frame_message_allocator factory;
+
+        using storage_type = small_buffer< 128 >;
+
+        template < typename ConstBufferSequence >
+        static void from_const_buffers( ConstBufferSequence buffers, frame_message* msg,
+                                        bool text ) {
+            msg->text_ = text;
+            msg->data_.resize( boost::asio::buffer_size( buffers ) );
+            boost::asio::buffer_copy(
+                boost::asio::buffer( msg->data_.data(), msg->data_.size() ), buffers );
+        }
+
+        const char* data() const { return data_.data(); }
+
+        char* data() { return data_.data(); }
+
+        size_t size() const { return data_.size(); }
+
+        storage_type& storage() { return data_; }
+
+        bool is_text() const { return text_; }
+
+        void set_text( bool text ) { text_ = text; }
+
+        /// send time of a stamped message in nanoseconds of the local system clock, 0 if unknown
+        std::int64_t send_time() const { return send_time_; }
+
+        /// called by the session for stamped messages, see session::set_send_stamps
+        void set_send_time( std::int64_t time ) { send_time_ = time; }
+
+      private:
+        storage_type data_;
+        std::int64_t send_time_ = 0;
+        bool text_ = false;
+    };
+} // namespace o
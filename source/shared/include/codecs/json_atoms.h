@@ -0,0 +1,533 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "c74_min.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifndef __cpp_lib_to_chars
+#include <clocale>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#endif
+
+namespace o {
+
+    namespace json_detail {
+
+        /// true if any byte in word equals the byte replicated in pattern
+        inline bool word_has_byte( std::uint64_t word, std::uint64_t pattern ) {
+            std::uint64_t x = word ^ pattern;
+            return ( ( x - 0x0101010101010101ull ) & ~x & 0x8080808080808080ull ) != 0;
+        }
+
+        /// find the next quote or backslash, scanning eight bytes at a time
+        inline const char* find_string_special( const char* it, const char* end ) {
+
+            constexpr std::uint64_t quotes = 0x2222222222222222ull;
+            constexpr std::uint64_t slashes = 0x5C5C5C5C5C5C5C5Cull;
+
+            while ( end - it >= 8 ) {
+                std::uint64_t word;
+                std::memcpy( &word, it, 8 );
+                if ( word_has_byte( word, quotes ) || word_has_byte( word, slashes ) )
+                    break;
+                it += 8;
+            }
+
+            while ( it != end && *it != '"' && *it != '\\' ) {
+                ++it;
+            }
+
+            return it;
+        }
+
+#ifndef __cpp_lib_to_chars
+        // standard libraries without floating point to_chars (older Apple clang)
+        // format and parse in the "C" locale, JSON always uses a decimal point
+#ifdef _WIN32
+        inline _locale_t c_locale() {
+            static _locale_t locale = _create_locale( LC_NUMERIC, "C" );
+            return locale;
+        }
+#else
+        inline locale_t c_locale() {
+            static locale_t locale = newlocale( LC_NUMERIC_MASK, "C", locale_t( 0 ) );
+            return locale;
+        }
+#endif
+#endif
+
+        /// parses [begin, end) as a double, false unless all of it is a finite number
+        inline bool parse_double( const char* begin, const char* end, double& value ) {
+#ifdef __cpp_lib_to_chars
+            auto result = std::from_chars( begin, end, value );
+            return result.ec == std::errc() && result.ptr == end;
+#else
+            std::string text( begin, end );
+            char* parsed_end;
+#ifdef _WIN32
+            value = _strtod_l( text.c_str(), &parsed_end, c_locale() );
+#else
+            value = strtod_l( text.c_str(), &parsed_end, c_locale() );
+#endif
+            return parsed_end == text.c_str() + text.size() && std::isfinite( value );
+#endif
+        }
+
+        /**
+         * writes the shortest form of a finite value that reads back as a float,
+         * whole numbers get a ".0" so they are not decoded as integers
+         */
+        inline size_t format_double( char* out, size_t size, double value ) {
+#ifdef __cpp_lib_to_chars
+            auto end = std::to_chars( out, out + size - 2, value ).ptr;
+            size_t length = static_cast< size_t >( end - out );
+#else
+#ifdef _WIN32
+            int written =
+                _snprintf_s_l( out, size - 2, _TRUNCATE, "%.17g", c_locale(), value );
+#else
+            locale_t previous = uselocale( c_locale() );
+            int written = std::snprintf( out, size - 2, "%.17g", value );
+            uselocale( previous );
+#endif
+            size_t length = written > 0 ? static_cast< size_t >( written ) : 0;
+#endif
+            if ( std::find_if( out, out + length, []( char c ) {
+                     return c == '.' || c == 'e' || c == 'n' || c == 'i';
+                 } ) == out + length ) {
+                out[length++] = '.';
+                out[length++] = '0';
+            }
+            return length;
+        }
+    } // namespace json_detail
+
+    /**
+     * Parses JSON text into a flat list of atoms. Arrays are flattened, objects
+     * emit each key as a symbol followed by its value, booleans become 0 / 1 and
+     * null becomes the symbol "null". The decoder keeps its scratch storage
+     * between calls, so reusing it does not allocate after warm-up.
+     */
+    class json_atoms_decoder {
+      public:
+        static constexpr int max_depth = 64;
+
+        json_atoms_decoder() { scratch_.reserve( 64 ); }
+
+        bool decode( const char* data, size_t size, c74::min::atoms& out ) {
+
+            out.clear();
+
+            it_ = data;
+            end_ = data + size;
+
+            skip_whitespace();
+
+            if ( !parse_value( out, 0 ) )
+                return false;
+
+            skip_whitespace();
+
+            return it_ == end_;
+        }
+
+      private:
+        void skip_whitespace() {
+            while ( it_ != end_ &&
+                    ( *it_ == ' ' || *it_ == '\n' || *it_ == '\r' || *it_ == '\t' ) ) {
+                ++it_;
+            }
+        }
+
+        bool consume( char c ) {
+            skip_whitespace();
+            if ( it_ != end_ && *it_ == c ) {
+                ++it_;
+                return true;
+            }
+            return false;
+        }
+
+        bool parse_literal( const char* literal, size_t length ) {
+            if ( static_cast< size_t >( end_ - it_ ) < length ||
+                 std::memcmp( it_, literal, length ) != 0 )
+                return false;
+            it_ += length;
+            return true;
+        }
+
+        bool parse_value( c74::min::atoms& out, int depth ) {
+
+            if ( depth > max_depth )
+                return false;
+
+            skip_whitespace();
+
+            if ( it_ == end_ )
+                return false;
+
+            switch ( *it_ ) {
+            case '[':
+                ++it_;
+                return parse_array( out, depth );
+            case '{':
+                ++it_;
+                return parse_object( out, depth );
+            case '"':
+                ++it_;
+                if ( !parse_string() )
+                    return false;
+                out.emplace_back( c74::min::symbol( scratch_.c_str() ) );
+                return true;
+            case 't':
+                if ( !parse_literal( "true", 4 ) )
+                    return false;
+                out.emplace_back( static_cast< c74::max::t_atom_long >( 1 ) );
+                return true;
+            case 'f':
+                if ( !parse_literal( "false", 5 ) )
+                    return false;
+                out.emplace_back( static_cast< c74::max::t_atom_long >( 0 ) );
+                return true;
+            case 'n':
+                if ( !parse_literal( "null", 4 ) )
+                    return false;
+                out.emplace_back( c74::min::symbol( "null" ) );
+                return true;
+            default:
+                return parse_number( out );
+            }
+        }
+
+        bool parse_array( c74::min::atoms& out, int depth ) {
+
+            if ( consume( ']' ) )
+                return true;
+
+            do {
+                if ( !parse_value( out, depth + 1 ) )
+                    return false;
+            } while ( consume( ',' ) );
+
+            return consume( ']' );
+        }
+
+        bool parse_object( c74::min::atoms& out, int depth ) {
+
+            if ( consume( '}' ) )
+                return true;
+
+            do {
+                if ( !consume( '"' ) || !parse_string() )
+                    return false;
+
+                out.emplace_back( c74::min::symbol( scratch_.c_str() ) );
+
+                if ( !consume( ':' ) || !parse_value( out, depth + 1 ) )
+                    return false;
+
+            } while ( consume( ',' ) );
+
+            return consume( '}' );
+        }
+
+        // parses the string after the opening quote into scratch_
+        bool parse_string() {
+
+            scratch_.clear();
+
+            while ( true ) {
+
+                auto special = json_detail::find_string_special( it_, end_ );
+
+                scratch_.append( it_, special );
+                it_ = special;
+
+                if ( it_ == end_ )
+                    return false;
+
+                if ( *it_ == '"' ) {
+                    ++it_;
+                    return true;
+                }
+
+                // backslash escape
+                if ( ++it_ == end_ )
+                    return false;
+
+                switch ( *it_++ ) {
+                case '"':
+                    scratch_.push_back( '"' );
+                    break;
+                case '\\':
+                    scratch_.push_back( '\\' );
+                    break;
+                case '/':
+                    scratch_.push_back( '/' );
+                    break;
+                case 'b':
+                    scratch_.push_back( '\b' );
+                    break;
+                case 'f':
+                    scratch_.push_back( '\f' );
+                    break;
+                case 'n':
+                    scratch_.push_back( '\n' );
+                    break;
+                case 'r':
+                    scratch_.push_back( '\r' );
+                    break;
+                case 't':
+                    scratch_.push_back( '\t' );
+                    break;
+                case 'u':
+                    if ( !parse_unicode_escape() )
+                        return false;
+                    break;
+                default:
+                    return false;
+                }
+            }
+        }
+
+        bool read_hex4( std::uint32_t& value ) {
+
+            if ( end_ - it_ < 4 )
+                return false;
+
+            value = 0;
+
+            for ( int i = 0; i < 4; ++i ) {
+                char c = *it_++;
+                value <<= 4;
+                if ( c >= '0' && c <= '9' )
+                    value |= static_cast< std::uint32_t >( c - '0' );
+                else if ( c >= 'a' && c <= 'f' )
+                    value |= static_cast< std::uint32_t >( c - 'a' + 10 );
+                else if ( c >= 'A' && c <= 'F' )
+                    value |= static_cast< std::uint32_t >( c - 'A' + 10 );
+                else
+                    return false;
+            }
+
+            return true;
+        }
+
+        // decodes \uXXXX (and surrogate pairs) to utf-8
+        bool parse_unicode_escape() {
+
+            std::uint32_t cp;
+
+            if ( !read_hex4( cp ) )
+                return false;
+
+            if ( cp >= 0xD800 && cp <= 0xDBFF ) {
+                std::uint32_t low;
+                if ( !parse_literal( "\\u", 2 ) || !read_hex4( low ) || low < 0xDC00 ||
+                     low > 0xDFFF )
+                    return false;
+                cp = 0x10000 + ( ( cp - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+            }
+
+            if ( cp < 0x80 ) {
+                scratch_.push_back( static_cast< char >( cp ) );
+            } else if ( cp < 0x800 ) {
+                scratch_.push_back( static_cast< char >( 0xC0 | ( cp >> 6 ) ) );
+                scratch_.push_back( static_cast< char >( 0x80 | ( cp & 0x3F ) ) );
+            } else if ( cp < 0x10000 ) {
+                scratch_.push_back( static_cast< char >( 0xE0 | ( cp >> 12 ) ) );
+                scratch_.push_back( static_cast< char >( 0x80 | ( ( cp >> 6 ) & 0x3F ) ) );
+                scratch_.push_back( static_cast< char >( 0x80 | ( cp & 0x3F ) ) );
+            } else {
+                scratch_.push_back( static_cast< char >( 0xF0 | ( cp >> 18 ) ) );
+                scratch_.push_back( static_cast< char >( 0x80 | ( ( cp >> 12 ) & 0x3F ) ) );
+                scratch_.push_back( static_cast< char >( 0x80 | ( ( cp >> 6 ) & 0x3F ) ) );
+                scratch_.push_back( static_cast< char >( 0x80 | ( cp & 0x3F ) ) );
+            }
+
+            return true;
+        }
+
+        bool parse_number( c74::min::atoms& out ) {
+
+            auto begin = it_;
+            bool negative = false;
+            bool is_float = false;
+            std::uint64_t integer = 0;
+            int digits = 0;
+
+            if ( *it_ == '-' ) {
+                negative = true;
+                ++it_;
+            }
+
+            while ( it_ != end_ && *it_ >= '0' && *it_ <= '9' ) {
+                integer = integer * 10 + static_cast< std::uint64_t >( *it_ - '0' );
+                ++digits;
+                ++it_;
+            }
+
+            if ( digits == 0 )
+                return false;
+
+            while ( it_ != end_ && ( *it_ == '.' || *it_ == 'e' || *it_ == 'E' ||
+                                     *it_ == '+' || *it_ == '-' ||
+                                     ( *it_ >= '0' && *it_ <= '9' ) ) ) {
+                is_float = true;
+                ++it_;
+            }
+
+            // integers that do not fit into 64 bits are parsed as floats
+            if ( !is_float && digits < 19 ) {
+                auto value = static_cast< c74::max::t_atom_long >( integer );
+                out.emplace_back( negative ? -value : value );
+                return true;
+            }
+
+            double value;
+
+            if ( !json_detail::parse_double( begin, it_, value ) )
+                return false;
+
+            out.emplace_back( static_cast< c74::max::t_atom_float >( value ) );
+            return true;
+        }
+
+        const char* it_ = nullptr;
+        const char* end_ = nullptr;
+        std::string scratch_;
+    };
+
+    /// writes str as a quoted and escaped JSON string
+    template < typename Output >
+    void json_encode_string( const char* str, Output& out ) {
+
+        static const char hex[] = "0123456789abcdef";
+
+        out.append( "\"", 1 );
+
+        const char* run = str;
+
+        for ( ; *str; ++str ) {
+
+            auto c = static_cast< unsigned char >( *str );
+
+            if ( c != '"' && c != '\\' && c >= 0x20 )
+                continue;
+
+            out.append( run, static_cast< size_t >( str - run ) );
+            run = str + 1;
+
+            switch ( c ) {
+            case '"':
+                out.append( "\\\"", 2 );
+                break;
+            case '\\':
+                out.append( "\\\\", 2 );
+                break;
+            case '\n':
+                out.append( "\\n", 2 );
+                break;
+            case '\r':
+                out.append( "\\r", 2 );
+                break;
+            case '\t':
+                out.append( "\\t", 2 );
+                break;
+            default: {
+                char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                out.append( escape, 6 );
+            }
+            }
+        }
+
+        out.append( run, static_cast< size_t >( str - run ) );
+        out.append( "\"", 1 );
+    }
+
+    /**
+     * Writes atoms as a flat JSON array, Output needs append( const char*, size_t ).
+     * Floats are written as the shortest text that reads back to the same double,
+     * nan and infinities as null because JSON has no literal for them.
+     */
+    template < typename Output >
+    void json_encode_atoms( const c74::min::atoms& atms, Output& out ) {
+
+        char number[32];
+
+        out.append( "[", 1 );
+
+        for ( size_t i = 0; i < atms.size(); ++i ) {
+
+            if ( i > 0 )
+                out.append( ",", 1 );
+
+            const auto& atm = atms[i];
+
+            switch ( atm.a_type ) {
+            case c74::max::e_max_atomtypes::A_LONG: {
+                auto end = std::to_chars( number, number + sizeof( number ),
+                                          static_cast< long long >( atm ) )
+                               .ptr;
+                out.append( number, static_cast< size_t >( end - number ) );
+                break;
+            }
+            case c74::max::e_max_atomtypes::A_FLOAT: {
+                double value = atm;
+
+                if ( !std::isfinite( value ) ) {
+                    out.append( "null", 4 );
+                    break;
+                }
+
+                out.append( number,
+                            json_detail::format_double( number, sizeof( number ), value ) );
+                break;
+            }
+            case c74::max::e_max_atomtypes::A_SYM: {
+                c74::min::symbol sym = atm;
+                json_encode_string( sym.c_str(), out );
+                break;
+            }
+            default:
+                out.append( "null", 4 );
+            }
+        }
+
+        out.append( "]", 1 );
+    }
+} // namespace o
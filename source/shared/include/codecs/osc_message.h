@@ -0,0 +1,516 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../devices/small_buffer.h"
+#include "../ohlano.h"
+#include "c74_min.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+#include <boost/asio/buffer.hpp>
+
+namespace o {
+
+    namespace osc_detail {
+
+        inline size_t padded( size_t size ) { return ( size + 3 ) & ~size_t( 3 ); }
+
+        inline std::uint32_t read_u32( const char* p ) {
+            auto u = reinterpret_cast< const unsigned char* >( p );
+            return ( std::uint32_t( u[0] ) << 24 ) | ( std::uint32_t( u[1] ) << 16 ) |
+                   ( std::uint32_t( u[2] ) << 8 ) | std::uint32_t( u[3] );
+        }
+
+        inline std::uint64_t read_u64( const char* p ) {
+            return ( std::uint64_t( read_u32( p ) ) << 32 ) | read_u32( p + 4 );
+        }
+
+        inline void write_u32( char* p, std::uint32_t v ) {
+            p[0] = static_cast< char >( v >> 24 );
+            p[1] = static_cast< char >( v >> 16 );
+            p[2] = static_cast< char >( v >> 8 );
+            p[3] = static_cast< char >( v );
+        }
+
+        inline void write_u64( char* p, std::uint64_t v ) {
+            write_u32( p, static_cast< std::uint32_t >( v >> 32 ) );
+            write_u32( p + 4, static_cast< std::uint32_t >( v ) );
+        }
+
+        /// length of the padded osc-string starting at p, 0 if it is not terminated
+        inline size_t string_size( const char* p, const char* end ) {
+            auto term = static_cast< const char* >(
+                std::memchr( p, 0, static_cast< size_t >( end - p ) ) );
+            if ( !term )
+                return 0;
+            auto size = padded( static_cast< size_t >( term - p ) + 1 );
+            return ( size <= static_cast< size_t >( end - p ) ) ? size : 0;
+        }
+    } // namespace osc_detail
+
+    /// a view into a single OSC message inside an osc_message frame
+    struct osc_message_view {
+
+        /// the timetag of the enclosing bundle, 1 (immediately) for plain messages
+        std::uint64_t timetag = 1;
+
+        std::string_view address;
+
+        /// type tags without the leading ','
+        std::string_view typetags;
+
+        const char* args = nullptr;
+        const char* end = nullptr;
+
+        /**
+         * append the address as symbol and all arguments to out.
+         * Strings are used directly from the frame, since they are
+         * null-terminated on the wire.
+         */
+        bool to_atoms( c74::min::atoms& out ) const {
+
+            out.emplace_back( c74::min::symbol( address.data() ) );
+
+            const char* it = args;
+
+            for ( char tag : typetags ) {
+
+                size_t left = static_cast< size_t >( end - it );
+
+                switch ( tag ) {
+                case 'i':
+                case 'c':
+                case 'r':
+                    if ( left < 4 )
+                        return false;
+                    out.emplace_back( static_cast< c74::max::t_atom_long >(
+                        static_cast< std::int32_t >( osc_detail::read_u32( it ) ) ) );
+                    it += 4;
+                    break;
+                case 'm':
+                    if ( left < 4 )
+                        return false;
+                    for ( int i = 0; i < 4; ++i ) {
+                        out.emplace_back( static_cast< c74::max::t_atom_long >(
+                            static_cast< unsigned char >( it[i] ) ) );
+                    }
+                    it += 4;
+                    break;
+                case 'f': {
+                    if ( left < 4 )
+                        return false;
+                    std::uint32_t bits = osc_detail::read_u32( it );
+                    float value;
+                    std::memcpy( &value, &bits, 4 );
+                    out.emplace_back( static_cast< c74::max::t_atom_float >( value ) );
+                    it += 4;
+                    break;
+                }
+                case 'h':
+                case 't':
+                    if ( left < 8 )
+                        return false;
+                    out.emplace_back( static_cast< c74::max::t_atom_long >(
+                        static_cast< std::int64_t >( osc_detail::read_u64( it ) ) ) );
+                    it += 8;
+                    break;
+                case 'd': {
+                    if ( left < 8 )
+                        return false;
+                    std::uint64_t bits = osc_detail::read_u64( it );
+                    double value;
+                    std::memcpy( &value, &bits, 8 );
+                    out.emplace_back( static_cast< c74::max::t_atom_float >( value ) );
+                    it += 8;
+                    break;
+                }
+                case 's':
+                case 'S': {
+                    size_t size = osc_detail::string_size( it, end );
+                    if ( size == 0 )
+                        return false;
+                    out.emplace_back( c74::min::symbol( it ) );
+                    it += size;
+                    break;
+                }
+                case 'b': {
+                    // blobs have no atom representation, skip the payload
+                    if ( left < 4 )
+                        return false;
+                    size_t size = osc_detail::padded( osc_detail::read_u32( it ) );
+                    if ( size > left - 4 )
+                        return false;
+                    it += 4 + size;
+                    break;
+                }
+                case 'T':
+                    out.emplace_back( static_cast< c74::max::t_atom_long >( 1 ) );
+                    break;
+                case 'F':
+                    out.emplace_back( static_cast< c74::max::t_atom_long >( 0 ) );
+                    break;
+                case 'N':
+                case 'I':
+                case '[':
+                case ']':
+                    break;
+                default:
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    /**
+     * OSC 1.0 message or bundle. Inbound frames are parsed in place without
+     * copying, outbound messages are encoded directly into the (inline) storage.
+     */
+    class osc_message {
+      public:
+        static constexpr int max_bundle_depth = 8;
+
+        // 1 means "immediately" in OSC timetag semantics
+        static constexpr std::uint64_t timetag_immediately = 1;
+
+        class osc_message_allocator {
+          public:
+            osc_message* allocate() {
+                alloc_msg_count++;
+                return new osc_message();
+            }
+
+            void deallocate( const osc_message* msg ) {
+                alloc_msg_count--;
+                delete msg;
+            }
+
+            ~osc_message_allocator() { assert( alloc_msg_count.load() == 0 ); }
+
+          private:
+            std::atomic< size_t > alloc_msg_count{ 0 };
+        };
+
+        typedef osc_message_allocator factory;
+
+        /// symbols are taken from the frame directly, so there is no decoder state
+        struct atoms_decoder {};
+
+        using storage_type = small_buffer< 128 >;
+
+        template < typename ConstBufferSequence >
+        static void from_const_buffers( ConstBufferSequence buffers, osc_message* msg,
+                                        bool text ) {
+            msg->data_.resize( boost::asio::buffer_size( buffers ) );
+            boost::asio::buffer_copy(
+                boost::asio::buffer( msg->data_.data(), msg->data_.size() ), buffers );
+        }
+
+        const char* data() const { return data_.data(); }
+
+        size_t size() const { return data_.size(); }
+
+        storage_type& storage() { return data_; }
+
+        bool is_bundle() const {
+            return data_.size() >= 16 && std::memcmp( data_.data(), "#bundle", 8 ) == 0;
+        }
+
+        /// call handler with an osc_message_view for every message in the frame
+        template < typename Handler >
+        bool for_each_message( Handler&& handler ) const {
+            return for_each_message( data_.data(), data_.size(), handler );
+        }
+
+        /// call handler for every message in the OSC packet at data
+        template < typename Handler >
+        static bool for_each_message( const char* data, size_t size, Handler&& handler ) {
+            return parse_element( data, data + size, timetag_immediately, handler, 0 );
+        }
+
+        /// decode every contained message to atoms and pass them to handler
+        template < typename Handler >
+        bool visit_atoms( atoms_decoder&, c74::min::atoms& out, Handler&& handler ) const {
+            return visit_atoms( data_.data(), data_.size(), out, handler );
+        }
+
+        /// decode every message in the OSC packet at data and pass them to handler
+        template < typename Handler >
+        static bool visit_atoms( const char* data, size_t size, c74::min::atoms& out,
+                                 Handler&& handler ) {
+            return for_each_message( data, size, [&]( const osc_message_view& view ) {
+                out.clear();
+                if ( !view.to_atoms( out ) )
+                    return false;
+                handler( out );
+                return true;
+            } );
+        }
+
+        /// decode the first message only
+        bool decode_atoms( atoms_decoder&, c74::min::atoms& out ) const {
+            bool first = true;
+            out.clear();
+            return for_each_message( [&]( const osc_message_view& view ) {
+                if ( first ) {
+                    first = false;
+                    return view.to_atoms( out );
+                }
+                return true;
+            } );
+        }
+
+        /**
+         * encode atms as a single OSC message. If the first atom is a symbol
+         * starting with '/' it is used as the address, otherwise the address
+         * is "/".
+         */
+        void serialize_atoms( const c74::min::atoms& atms ) {
+            data_.clear();
+            append_message( atms );
+        }
+
+        /// encode atms as a single OSC message into storage
+        template < typename Storage >
+        static void encode_atoms( const c74::min::atoms& atms, Storage& storage ) {
+            storage.resize( encoded_size( atms ) );
+            encode( atms, storage.data() );
+        }
+
+        /// start a bundle, add its elements with append_message()
+        void begin_bundle( std::uint64_t timetag = timetag_immediately ) {
+            data_.resize( 16 );
+            std::memcpy( data_.data(), "#bundle", 8 );
+            osc_detail::write_u64( data_.data() + 8, timetag );
+        }
+
+        /// append a message to the frame, or to the bundle if one was started
+        void append_message( const c74::min::atoms& atms ) {
+
+            bool in_bundle = is_bundle();
+
+            size_t offset = data_.size();
+            size_t element_size = encoded_size( atms );
+
+            data_.resize( offset + element_size + ( in_bundle ? 4 : 0 ) );
+
+            char* out = data_.data() + offset;
+
+            if ( in_bundle ) {
+                osc_detail::write_u32( out, static_cast< std::uint32_t >( element_size ) );
+                out += 4;
+            }
+
+            encode( atms, out );
+        }
+
+      private:
+        template < typename Handler >
+        static bool parse_element( const char* begin, const char* end,
+                                   std::uint64_t timetag, Handler& handler, int depth ) {
+
+            size_t size = static_cast< size_t >( end - begin );
+
+            if ( size >= 16 && std::memcmp( begin, "#bundle", 8 ) == 0 ) {
+
+                if ( depth >= max_bundle_depth )
+                    return false;
+
+                std::uint64_t bundle_time = osc_detail::read_u64( begin + 8 );
+                const char* it = begin + 16;
+
+                while ( it != end ) {
+
+                    if ( end - it < 4 )
+                        return false;
+
+                    size_t element_size = osc_detail::read_u32( it );
+                    it += 4;
+
+                    if ( element_size > static_cast< size_t >( end - it ) ||
+                         element_size % 4 != 0 )
+                        return false;
+
+                    if ( !parse_element( it, it + element_size, bundle_time, handler,
+                                         depth + 1 ) )
+                        return false;
+
+                    it += element_size;
+                }
+
+                return true;
+            }
+
+            if ( size == 0 || *begin != '/' )
+                return false;
+
+            osc_message_view view;
+            view.timetag = timetag;
+
+            size_t address_size = osc_detail::string_size( begin, end );
+
+            if ( address_size == 0 )
+                return false;
+
+            view.address = std::string_view( begin );
+
+            const char* it = begin + address_size;
+
+            // the type tag string may be missing in very old implementations
+            if ( it != end && *it == ',' ) {
+                size_t tags_size = osc_detail::string_size( it, end );
+                if ( tags_size == 0 )
+                    return false;
+                view.typetags = std::string_view( it + 1 );
+                it += tags_size;
+            }
+
+            view.args = it;
+            view.end = end;
+
+            return handler( static_cast< const osc_message_view& >( view ) );
+        }
+
+        static bool is_address( const c74::min::atom& atm ) {
+            if ( atm.a_type != c74::max::e_max_atomtypes::A_SYM )
+                return false;
+            c74::min::symbol sym = atm;
+            return sym.c_str()[0] == '/';
+        }
+
+        static bool fits_int32( c74::max::t_atom_long value ) {
+            return value >= std::numeric_limits< std::int32_t >::min() &&
+                   value <= std::numeric_limits< std::int32_t >::max();
+        }
+
+        static size_t encoded_size( const c74::min::atoms& atms ) {
+
+            size_t first = 0;
+            size_t size;
+
+            if ( !atms.empty() && is_address( atms[0] ) ) {
+                c74::min::symbol address = atms[0];
+                size = osc_detail::padded( std::strlen( address.c_str() ) + 1 );
+                first = 1;
+            } else {
+                size = 4;
+            }
+
+            // ',' + tags + terminator
+            size += osc_detail::padded( atms.size() - first + 2 );
+
+            for ( size_t i = first; i < atms.size(); ++i ) {
+                switch ( atms[i].a_type ) {
+                case c74::max::e_max_atomtypes::A_LONG:
+                    size += fits_int32( atms[i] ) ? 4 : 8;
+                    break;
+                case c74::max::e_max_atomtypes::A_SYM: {
+                    c74::min::symbol sym = atms[i];
+                    size += osc_detail::padded( std::strlen( sym.c_str() ) + 1 );
+                    break;
+                }
+                default:
+                    size += 4;
+                }
+            }
+
+            return size;
+        }
+
+        // out must have room for encoded_size( atms ) bytes
+        static void encode( const c74::min::atoms& atms, char* out ) {
+
+            size_t first = 0;
+
+            if ( !atms.empty() && is_address( atms[0] ) ) {
+                c74::min::symbol address = atms[0];
+                out = write_string( address.c_str(), out );
+                first = 1;
+            } else {
+                out = write_string( "/", out );
+            }
+
+            char* tags = out;
+            size_t tags_size = osc_detail::padded( atms.size() - first + 2 );
+
+            std::memset( tags, 0, tags_size );
+            *tags++ = ',';
+            out += tags_size;
+
+            for ( size_t i = first; i < atms.size(); ++i ) {
+
+                const auto& atm = atms[i];
+
+                switch ( atm.a_type ) {
+                case c74::max::e_max_atomtypes::A_LONG: {
+                    auto value = static_cast< c74::max::t_atom_long >( atm );
+                    if ( fits_int32( value ) ) {
+                        *tags++ = 'i';
+                        osc_detail::write_u32( out, static_cast< std::uint32_t >( value ) );
+                        out += 4;
+                    } else {
+                        *tags++ = 'h';
+                        osc_detail::write_u64( out, static_cast< std::uint64_t >( value ) );
+                        out += 8;
+                    }
+                    break;
+                }
+                case c74::max::e_max_atomtypes::A_SYM: {
+                    c74::min::symbol sym = atm;
+                    *tags++ = 's';
+                    out = write_string( sym.c_str(), out );
+                    break;
+                }
+                default: {
+                    float value = static_cast< float >( static_cast< double >( atm ) );
+                    std::uint32_t bits;
+                    std::memcpy( &bits, &value, 4 );
+                    *tags++ = 'f';
+                    osc_detail::write_u32( out, bits );
+                    out += 4;
+                }
+                }
+            }
+        }
+
+        static char* write_string( const char* str, char* out ) {
+            size_t length = std::strlen( str );
+            size_t size = osc_detail::padded( length + 1 );
+            std::memcpy( out, str, length );
+            std::memset( out + length, 0, size - length );
+            return out + size;
+        }
+
+        storage_type data_;
+    };
+} // namespace o
@@ -0,0 +1,528 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "trace.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+/**
+ * Asynchronous logger behind DBG / LOG and the O_LOG_* macros.
+ *
+ * The calling thread claims a slot in a lock-free ring and copies its
+ * arguments into it as tagged binary values. Turning them into text and
+ * writing them out happens on a background thread, so a log call costs a
+ * compare-exchange and a few memcpys. When the ring is full, trace, debug and
+ * info records are dropped and counted instead of blocking the caller, while
+ * warnings and errors wait for room.
+ *
+ * Records below MAXNET_LOG_LEVEL are compiled out, records below the
+ * runtime level set with o::logging::set_level are skipped.
+ *
+ *   O_LOG_WARN( "no pong for ", missed, " pings" );
+ */
+
+#define MAXNET_LOG_TRACE 0
+#define MAXNET_LOG_DEBUG 1
+#define MAXNET_LOG_INFO 2
+#define MAXNET_LOG_WARN 3
+#define MAXNET_LOG_ERROR 4
+#define MAXNET_LOG_OFF 5
+
+#ifndef MAXNET_LOG_LEVEL
+#if ( defined( _MSC_VER ) && defined( _DEBUG ) ) || ( !defined( _MSC_VER ) && !defined( NDEBUG ) )
+#define MAXNET_LOG_LEVEL MAXNET_LOG_DEBUG
+#else
+#define MAXNET_LOG_LEVEL MAXNET_LOG_INFO
+#endif
+#endif
+
+namespace o {
+    namespace logging {
+
+        enum class level : int { trace, debug, info, warn, error, off };
+
+        inline const char* level_name( level lvl ) {
+            switch ( lvl ) {
+            case level::trace:
+                return "T";
+            case level::debug:
+                return "D";
+            case level::info:
+                return "I";
+            case level::warn:
+                return "W";
+            case level::error:
+                return "E";
+            default:
+                return "-";
+            }
+        }
+
+        inline std::atomic< int >& level_flag() {
+            static std::atomic< int > flag{ MAXNET_LOG_LEVEL };
+            return flag;
+        }
+
+        /// runtime filter on top of MAXNET_LOG_LEVEL
+        inline void set_level( level lvl ) {
+            level_flag().store( static_cast< int >( lvl ), std::memory_order_relaxed );
+        }
+
+        inline bool enabled( level lvl ) {
+            return static_cast< int >( lvl ) >=
+                   level_flag().load( std::memory_order_relaxed );
+        }
+
+        /// arguments are stored as a tag byte followed by their value
+        enum class arg_tag : unsigned char { i64, u64, f64, boolean, character, text, pointer };
+
+        struct record {
+            std::atomic< std::uint64_t > sequence{ 0 };
+            std::uint64_t time_ns;
+            std::uint32_t thread;
+            level lvl;
+            std::uint16_t size;
+            bool truncated;
+            char data[224];
+        };
+
+        /// writes the arguments of one record into its slot
+        class encoder {
+          public:
+            explicit encoder( record& rec ) : rec_( rec ) {
+                rec_.size = 0;
+                rec_.truncated = false;
+            }
+
+            template < typename T >
+            void add( const T& value ) {
+
+                using type = std::decay_t< T >;
+
+                if constexpr ( std::is_same_v< type, bool > ) {
+                    put( arg_tag::boolean, &value, 1 );
+                } else if constexpr ( std::is_same_v< type, char > ) {
+                    put( arg_tag::character, &value, 1 );
+                } else if constexpr ( std::is_integral_v< type > && std::is_signed_v< type > ) {
+                    std::int64_t v = value;
+                    put( arg_tag::i64, &v, sizeof( v ) );
+                } else if constexpr ( std::is_integral_v< type > ) {
+                    std::uint64_t v = value;
+                    put( arg_tag::u64, &v, sizeof( v ) );
+                } else if constexpr ( std::is_enum_v< type > ) {
+                    std::int64_t v = static_cast< std::int64_t >( value );
+                    put( arg_tag::i64, &v, sizeof( v ) );
+                } else if constexpr ( std::is_floating_point_v< type > ) {
+                    double v = value;
+                    put( arg_tag::f64, &v, sizeof( v ) );
+                } else if constexpr ( std::is_array_v< T > &&
+                                      std::is_same_v< std::remove_cv_t< std::remove_extent_t< T > >,
+                                                      char > ) {
+                    // literals and char buffers, bounded by the array so there is no
+                    // null check to warn about
+                    text( std::string_view( value, strnlen( value, std::extent_v< T > ) ) );
+                } else if constexpr ( std::is_same_v< type, const char* > ||
+                                      std::is_same_v< type, char* > ) {
+                    text( value ? std::string_view( value ) : std::string_view( "(null)" ) );
+                } else if constexpr ( std::is_convertible_v< const T&, std::string_view > ) {
+                    text( std::string_view( value ) );
+                } else if constexpr ( std::is_pointer_v< type > ) {
+                    auto v = reinterpret_cast< std::uintptr_t >( value );
+                    put( arg_tag::pointer, &v, sizeof( v ) );
+                } else {
+                    // anything else is formatted right away, this is the slow path
+                    std::ostringstream stream;
+                    stream << value;
+                    text( stream.str() );
+                }
+            }
+
+          private:
+            void put( arg_tag tag, const void* value, size_t length ) {
+
+                if ( rec_.size + 1 + length > sizeof( rec_.data ) ) {
+                    rec_.truncated = true;
+                    return;
+                }
+
+                rec_.data[rec_.size] = static_cast< char >( tag );
+                std::memcpy( rec_.data + rec_.size + 1, value, length );
+                rec_.size += static_cast< std::uint16_t >( 1 + length );
+            }
+
+            void text( std::string_view str ) {
+
+                size_t room = sizeof( rec_.data ) - rec_.size;
+
+                if ( room < 4 || rec_.truncated ) {
+                    rec_.truncated = true;
+                    return;
+                }
+
+                if ( str.size() > room - 3 ) {
+                    str = str.substr( 0, room - 3 );
+                    rec_.truncated = true;
+                }
+
+                auto length = static_cast< std::uint16_t >( str.size() );
+
+                rec_.data[rec_.size] = static_cast< char >( arg_tag::text );
+                std::memcpy( rec_.data + rec_.size + 1, &length, 2 );
+                std::memcpy( rec_.data + rec_.size + 3, str.data(), str.size() );
+                rec_.size += static_cast< std::uint16_t >( 3 + str.size() );
+            }
+
+            record& rec_;
+        };
+
+        /// turn a record into one line of text, runs on the flusher thread
+        inline void format( const record& rec, std::string& line ) {
+
+            char buf[64];
+
+            std::snprintf( buf, sizeof( buf ), "[%12.6f] %s %u ", rec.time_ns / 1e9,
+                           level_name( rec.lvl ), rec.thread );
+            line.append( buf );
+
+            size_t pos = 0;
+
+            while ( pos < rec.size ) {
+
+                auto tag = static_cast< arg_tag >( rec.data[pos++] );
+
+                switch ( tag ) {
+                case arg_tag::i64: {
+                    std::int64_t v;
+                    std::memcpy( &v, rec.data + pos, sizeof( v ) );
+                    pos += sizeof( v );
+                    std::snprintf( buf, sizeof( buf ), "%lld", static_cast< long long >( v ) );
+                    line.append( buf );
+                    break;
+                }
+                case arg_tag::u64: {
+                    std::uint64_t v;
+                    std::memcpy( &v, rec.data + pos, sizeof( v ) );
+                    pos += sizeof( v );
+                    std::snprintf( buf, sizeof( buf ), "%llu",
+                                   static_cast< unsigned long long >( v ) );
+                    line.append( buf );
+                    break;
+                }
+                case arg_tag::f64: {
+                    double v;
+                    std::memcpy( &v, rec.data + pos, sizeof( v ) );
+                    pos += sizeof( v );
+                    std::snprintf( buf, sizeof( buf ), "%g", v );
+                    line.append( buf );
+                    break;
+                }
+                case arg_tag::boolean:
+                    line.append( rec.data[pos++] ? "1" : "0" );
+                    break;
+                case arg_tag::character:
+                    line.push_back( rec.data[pos++] );
+                    break;
+                case arg_tag::text: {
+                    std::uint16_t length;
+                    std::memcpy( &length, rec.data + pos, 2 );
+                    line.append( rec.data + pos + 2, length );
+                    pos += 2 + length;
+                    break;
+                }
+                case arg_tag::pointer: {
+                    std::uintptr_t v;
+                    std::memcpy( &v, rec.data + pos, sizeof( v ) );
+                    pos += sizeof( v );
+                    std::snprintf( buf, sizeof( buf ), "0x%llx",
+                                   static_cast< unsigned long long >( v ) );
+                    line.append( buf );
+                    break;
+                }
+                default:
+                    pos = rec.size;
+                }
+            }
+
+            if ( rec.truncated )
+                line.append( "..." );
+
+            line.push_back( '\n' );
+        }
+
+        /**
+         * Bounded multi-producer ring with one consumer. Every slot carries a
+         * sequence number that tells producers and the consumer whose turn it is,
+         * so neither side ever takes a lock.
+         */
+        template < size_t Capacity = 2048 >
+        class logger {
+            static_assert( ( Capacity & ( Capacity - 1 ) ) == 0,
+                           "capacity must be a power of two" );
+
+          public:
+            using sink_type = std::function< void( level, std::string_view ) >;
+
+            logger() {
+                for ( size_t i = 0; i < Capacity; ++i )
+                    slots_[i].sequence.store( i, std::memory_order_relaxed );
+
+                flusher_ = std::thread( [this]() { run(); } );
+            }
+
+            ~logger() {
+                {
+                    std::lock_guard< std::mutex > lock{ wake_mutex_ };
+                    stopped_ = true;
+                }
+                wake_.notify_one();
+                flusher_.join();
+                flush();
+            }
+
+            logger( const logger& ) = delete;
+            logger& operator=( const logger& ) = delete;
+
+            template < typename... Args >
+            void write( level lvl, const Args&... args ) {
+
+                auto pos = tail_.load( std::memory_order_relaxed );
+                record* slot;
+
+                for ( ;; ) {
+                    slot = &slots_[pos & ( Capacity - 1 )];
+                    auto seq = slot->sequence.load( std::memory_order_acquire );
+                    auto diff = static_cast< std::int64_t >( seq - pos );
+
+                    if ( diff == 0 ) {
+                        if ( tail_.compare_exchange_weak( pos, pos + 1,
+                                                          std::memory_order_relaxed ) )
+                            break;
+                    } else if ( diff < 0 ) {
+                        if ( lvl < level::warn ) {
+                            dropped_.fetch_add( 1, std::memory_order_relaxed );
+                            return;
+                        }
+
+                        // warnings and errors are rare enough to wait for the flusher
+                        wake_.notify_one();
+                        std::this_thread::yield();
+                        pos = tail_.load( std::memory_order_relaxed );
+                    } else {
+                        pos = tail_.load( std::memory_order_relaxed );
+                    }
+                }
+
+                slot->time_ns = o::trace::now_ns();
+                slot->thread = o::trace::thread_index();
+                slot->lvl = lvl;
+
+                encoder enc{ *slot };
+                ( enc.add( args ), ... );
+
+                slot->sequence.store( pos + 1, std::memory_order_release );
+
+                // bursts wake the flusher before the ring runs full
+                if ( ( pos & ( Capacity / 4 - 1 ) ) == Capacity / 4 - 1 )
+                    wake_.notify_one();
+            }
+
+            /**
+             * Receives every formatted line on the flusher thread. The default
+             * writes to stdout, or to the debugger output on Windows.
+             */
+            void set_sink( sink_type sink ) {
+                std::lock_guard< std::mutex > lock{ drain_mutex_ };
+                sink_ = std::move( sink );
+            }
+
+            /// write out everything logged so far from the calling thread
+            void flush() {
+                std::lock_guard< std::mutex > lock{ drain_mutex_ };
+                drain();
+            }
+
+            /// records lost because the ring was full
+            std::uint64_t dropped() const { return dropped_.load( std::memory_order_relaxed ); }
+
+          private:
+            void run() {
+
+                std::unique_lock< std::mutex > lock{ wake_mutex_ };
+
+                while ( !stopped_ ) {
+
+                    lock.unlock();
+
+                    bool busy;
+                    {
+                        std::lock_guard< std::mutex > drain_lock{ drain_mutex_ };
+                        busy = drain();
+                    }
+
+                    lock.lock();
+
+                    // producers only notify on bursts, a quiet ring is polled every few ms
+                    if ( !busy )
+                        wake_.wait_for( lock, std::chrono::milliseconds( 5 ) );
+                }
+            }
+
+            // caller holds drain_mutex_, returns true if anything was written
+            bool drain() {
+
+                bool any = false;
+
+                for ( ;; ) {
+                    auto& slot = slots_[head_ & ( Capacity - 1 )];
+
+                    if ( slot.sequence.load( std::memory_order_acquire ) != head_ + 1 )
+                        break;
+
+                    line_.clear();
+                    format( slot, line_ );
+                    auto lvl = slot.lvl;
+
+                    slot.sequence.store( head_ + Capacity, std::memory_order_release );
+                    ++head_;
+
+                    emit( lvl, line_ );
+                    any = true;
+                }
+
+                auto dropped = dropped_.load( std::memory_order_relaxed );
+
+                if ( dropped != reported_dropped_ ) {
+                    line_ = std::to_string( dropped - reported_dropped_ ) +
+                            " log records dropped\n";
+                    reported_dropped_ = dropped;
+                    emit( level::warn, line_ );
+                    any = true;
+                }
+
+                if ( any && !sink_ )
+                    std::fflush( stdout );
+
+                return any;
+            }
+
+            void emit( level lvl, const std::string& line ) {
+
+                if ( sink_ ) {
+                    sink_( lvl, line );
+                    return;
+                }
+
+#ifdef _MSC_VER
+                OutputDebugStringA( line.c_str() );
+#else
+                std::fwrite( line.data(), 1, line.size(), stdout );
+#endif
+            }
+
+            std::array< record, Capacity > slots_;
+            alignas( 64 ) std::atomic< std::uint64_t > tail_{ 0 };
+            alignas( 64 ) std::atomic< std::uint64_t > dropped_{ 0 };
+
+            // consumer side, guarded by drain_mutex_
+            alignas( 64 ) std::uint64_t head_ = 0;
+            std::uint64_t reported_dropped_ = 0;
+            std::string line_;
+            sink_type sink_;
+            std::mutex drain_mutex_;
+
+            std::mutex wake_mutex_;
+            std::condition_variable wake_;
+            bool stopped_ = false;
+            std::thread flusher_;
+        };
+
+        using default_logger = logger<>;
+
+        /**
+         * The process wide logger. It is never destroyed, so sessions that log
+         * from static destructors are fine. Pending records are flushed at exit.
+         */
+        inline default_logger& global() {
+            static default_logger* instance = []() {
+                auto* created = new default_logger;
+                std::atexit( []() { global().flush(); } );
+                return created;
+            }();
+            return *instance;
+        }
+    } // namespace logging
+} // namespace o
+
+#define O_LOG_AT_( lvl, ... )                                                            \
+    do {                                                                                 \
+        if ( o::logging::enabled( lvl ) )                                                \
+            o::logging::global().write( lvl, __VA_ARGS__ );                              \
+    } while ( false )
+
+#if MAXNET_LOG_LEVEL <= MAXNET_LOG_TRACE
+#define O_LOG_TRACE( ... ) O_LOG_AT_( o::logging::level::trace, __VA_ARGS__ )
+#else
+#define O_LOG_TRACE( ... ) ( (void)0 )
+#endif
+
+#if MAXNET_LOG_LEVEL <= MAXNET_LOG_DEBUG
+#define O_LOG_DEBUG( ... ) O_LOG_AT_( o::logging::level::debug, __VA_ARGS__ )
+#else
+#define O_LOG_DEBUG( ... ) ( (void)0 )
+#endif
+
+#if MAXNET_LOG_LEVEL <= MAXNET_LOG_INFO
+#define O_LOG_INFO( ... ) O_LOG_AT_( o::logging::level::info, __VA_ARGS__ )
+#else
+#define O_LOG_INFO( ... ) ( (void)0 )
+#endif
+
+#if MAXNET_LOG_LEVEL <= MAXNET_LOG_WARN
+#define O_LOG_WARN( ... ) O_LOG_AT_( o::logging::level::warn, __VA_ARGS__ )
+#else
+#define O_LOG_WARN( ... ) ( (void)0 )
+#endif
+
+#if MAXNET_LOG_LEVEL <= MAXNET_LOG_ERROR
+#define O_LOG_ERROR( ... ) O_LOG_AT_( o::logging::level::error, __VA_ARGS__ )
+#else
+#define O_LOG_ERROR( ... ) ( (void)0 )
+#endif
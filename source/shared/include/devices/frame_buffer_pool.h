@@ -0,0 +1,228 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace o {
+
+    /// a contiguous block of memory that can be borrowed from a frame_buffer_pool
+    class frame_buffer {
+
+        friend class frame_buffer_pool;
+
+        frame_buffer( std::unique_ptr< char[] > mem, size_t capacity )
+            : mem_( std::move( mem ) ), capacity_( capacity ) {}
+
+      public:
+        frame_buffer() = default;
+
+        frame_buffer( frame_buffer&& other ) noexcept
+            : mem_( std::move( other.mem_ ) ), capacity_( other.capacity_ ) {
+            other.capacity_ = 0;
+        }
+
+        frame_buffer& operator=( frame_buffer&& other ) noexcept {
+            mem_ = std::move( other.mem_ );
+            capacity_ = other.capacity_;
+            other.capacity_ = 0;
+            return *this;
+        }
+
+        OHLANO_NOCOPY( frame_buffer )
+
+        char* data() { return mem_.get(); }
+
+        const char* data() const { return mem_.get(); }
+
+        size_t capacity() const { return capacity_; }
+
+        explicit operator bool() const { return static_cast< bool >( mem_ ); }
+
+      private:
+        std::unique_ptr< char[] > mem_;
+        size_t capacity_ = 0;
+    };
+
+    /**
+     * Size-classed cache of frame_buffers. Use the thread local instance from
+     * local(), which hands out and takes back buffers without any locking.
+     * Buffers are often acquired on one thread (a serializing worker) and
+     * released on another (the io thread that wrote them), so the thread
+     * local pools exchange batches of buffers through a shared depot: an
+     * empty pool refills from it, a full one spills half of its buffers into
+     * it. Requests larger than the biggest size class are rounded up to a
+     * multiple of it and allocated and freed directly.
+     */
+    class frame_buffer_pool {
+      public:
+        // size classes are powers of two from 64 bytes to 128 kilobytes
+        static constexpr size_t min_class_bits = 6;
+        static constexpr size_t num_classes = 12;
+        static constexpr size_t max_cached_per_class = 32;
+
+        /// buffers moved between a thread local pool and the depot at once
+        static constexpr size_t transfer_batch = max_cached_per_class / 2;
+
+        /// buffers the shared depot keeps per size class, the rest is freed
+        static constexpr size_t max_depot_per_class = 256;
+
+        frame_buffer_pool() {
+            for ( auto& free : free_ ) {
+                free.reserve( max_cached_per_class );
+            }
+        }
+
+        /// an exiting thread leaves its buffers to the others
+        ~frame_buffer_pool() {
+            for ( size_t cls = 0; cls < num_classes; ++cls )
+                spill( cls, free_[cls].size() );
+        }
+
+        OHLANO_NOCOPY( frame_buffer_pool )
+
+        /// the pool for the calling thread
+        static frame_buffer_pool& local() {
+            thread_local frame_buffer_pool pool;
+            return pool;
+        }
+
+        /// get a buffer that can hold at least size bytes
+        frame_buffer acquire( size_t size ) {
+
+            auto cls = size_class( size );
+
+            if ( cls >= num_classes ) {
+                // rounded up to whole blocks of the biggest class, so a growing
+                // buffer does not need a new allocation for every few bytes
+                auto block = class_size( num_classes - 1 );
+                size = ( size + block - 1 ) / block * block;
+                return frame_buffer( std::unique_ptr< char[] >( new char[size] ), size );
+            }
+
+            auto& free = free_[cls];
+
+            if ( free.empty() )
+                refill( cls );
+
+            if ( !free.empty() ) {
+                frame_buffer buf = std::move( free.back() );
+                free.pop_back();
+                return buf;
+            }
+
+            return frame_buffer( std::unique_ptr< char[] >( new char[class_size( cls )] ),
+                                 class_size( cls ) );
+        }
+
+        /// hand a buffer back, it will be freed if the cache is full
+        void release( frame_buffer&& buf ) {
+
+            if ( !buf )
+                return;
+
+            auto cls = size_class( buf.capacity() );
+
+            if ( cls >= num_classes || class_size( cls ) != buf.capacity() ) {
+                frame_buffer dropped = std::move( buf );
+                return;
+            }
+
+            if ( free_[cls].size() >= max_cached_per_class )
+                spill( cls, transfer_batch );
+
+            free_[cls].push_back( std::move( buf ) );
+        }
+
+      private:
+        struct depot {
+            std::mutex mtx;
+            std::array< std::vector< frame_buffer >, num_classes > free;
+        };
+
+        static depot& shared_depot() {
+            static depot instance;
+            return instance;
+        }
+
+        void refill( size_t cls ) {
+
+            auto& shared = shared_depot();
+            std::lock_guard< std::mutex > lock{ shared.mtx };
+
+            auto& from = shared.free[cls];
+            auto count = std::min( from.size(), transfer_batch );
+
+            std::move( from.end() - count, from.end(), std::back_inserter( free_[cls] ) );
+            from.erase( from.end() - count, from.end() );
+        }
+
+        // move count buffers to the depot, buffers that do not fit are freed
+        void spill( size_t cls, size_t count ) {
+
+            auto& free = free_[cls];
+            count = std::min( count, free.size() );
+
+            if ( count == 0 )
+                return;
+
+            {
+                auto& shared = shared_depot();
+                std::lock_guard< std::mutex > lock{ shared.mtx };
+
+                auto& to = shared.free[cls];
+                auto room = max_depot_per_class - std::min( to.size(), max_depot_per_class );
+                auto kept = std::min( count, room );
+
+                std::move( free.end() - count, free.end() - count + kept,
+                           std::back_inserter( to ) );
+            }
+
+            free.erase( free.end() - count, free.end() );
+        }
+
+        static size_t class_size( size_t cls ) {
+            return size_t( 1 ) << ( cls + min_class_bits );
+        }
+
+        static size_t size_class( size_t size ) {
+            size_t cls = 0;
+            while ( cls < num_classes && class_size( cls ) < size ) {
+                ++cls;
+            }
+            return cls;
+        }
+
+        std::array< std::vector< frame_buffer >, num_classes > free_;
+    };
+} // namespace o
@@ -0,0 +1,213 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/beast/websocket/rfc6455.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+namespace o {
+
+    /**
+     * Wire format of the latency probes and message send stamps.
+     *
+     * A probe is a websocket ping that carries the send time t1 of the prober.
+     * The peer answers with an unsolicited pong that carries t1, its receive
+     * time t2 and its send time t3; the prober reads t4 on arrival. Peers that
+     * do not know probes just echo the ping like any other.
+     *
+     * Times are nanoseconds of the system clock since the epoch, encoded little
+     * endian. Send stamps are sixteen hex digits so they are valid in text frames.
+     */
+    struct latency_probe {
+
+        static constexpr std::array< char, 4 > request_tag = { 'm', 'x', 'p', 'q' };
+        static constexpr std::array< char, 4 > reply_tag = { 'm', 'x', 'p', 'r' };
+
+        static constexpr size_t request_size = 4 + 8;
+        static constexpr size_t reply_size = 4 + 3 * 8;
+
+        /// length of the send stamp in front of every stamped message
+        static constexpr size_t stamp_size = 16;
+
+        /// handshake header that asks for / confirms send stamps on both directions
+        static constexpr const char* stamp_header = "X-Maxnet-Send-Time";
+
+        static std::int64_t now() {
+            return std::chrono::duration_cast< std::chrono::nanoseconds >(
+                       std::chrono::system_clock::now().time_since_epoch() )
+                .count();
+        }
+
+        static boost::beast::websocket::ping_data request( std::int64_t t1 ) {
+            boost::beast::websocket::ping_data out;
+            out.resize( request_size );
+            std::memcpy( out.data(), request_tag.data(), 4 );
+            put( out.data() + 4, t1 );
+            return out;
+        }
+
+        static bool parse_request( std::string_view payload, std::int64_t& t1 ) {
+            if ( payload.size() != request_size ||
+                 std::memcmp( payload.data(), request_tag.data(), 4 ) != 0 )
+                return false;
+            t1 = get( payload.data() + 4 );
+            return true;
+        }
+
+        /// t3 is filled in right before the pong goes out, see stamp_reply
+        static boost::beast::websocket::ping_data reply( std::int64_t t1, std::int64_t t2 ) {
+            boost::beast::websocket::ping_data out;
+            out.resize( reply_size );
+            std::memcpy( out.data(), reply_tag.data(), 4 );
+            put( out.data() + 4, t1 );
+            put( out.data() + 12, t2 );
+            put( out.data() + 20, t2 );
+            return out;
+        }
+
+        static bool is_reply( const boost::beast::websocket::ping_data& payload ) {
+            return payload.size() == reply_size &&
+                   std::memcmp( payload.data(), reply_tag.data(), 4 ) == 0;
+        }
+
+        static void stamp_reply( boost::beast::websocket::ping_data& payload,
+                                 std::int64_t t3 ) {
+            put( payload.data() + 20, t3 );
+        }
+
+        static bool parse_reply( std::string_view payload, std::int64_t& t1,
+                                 std::int64_t& t2, std::int64_t& t3 ) {
+            if ( payload.size() != reply_size ||
+                 std::memcmp( payload.data(), reply_tag.data(), 4 ) != 0 )
+                return false;
+            t1 = get( payload.data() + 4 );
+            t2 = get( payload.data() + 12 );
+            t3 = get( payload.data() + 20 );
+            return true;
+        }
+
+        static void write_stamp( char* out, std::int64_t time ) {
+            static constexpr char digits[] = "0123456789abcdef";
+            auto value = static_cast< std::uint64_t >( time );
+            for ( size_t i = stamp_size; i > 0; --i ) {
+                out[i - 1] = digits[value & 0xf];
+                value >>= 4;
+            }
+        }
+
+        static bool read_stamp( const char* in, std::int64_t& time ) {
+            std::uint64_t value = 0;
+            for ( size_t i = 0; i < stamp_size; ++i ) {
+                char c = in[i];
+                int digit = ( c >= '0' && c <= '9' )   ? c - '0'
+                            : ( c >= 'a' && c <= 'f' ) ? c - 'a' + 10
+                                                       : -1;
+                if ( digit < 0 )
+                    return false;
+                value = ( value << 4 ) | static_cast< std::uint64_t >( digit );
+            }
+            time = static_cast< std::int64_t >( value );
+            return true;
+        }
+
+      private:
+        static void put( char* out, std::int64_t value ) {
+            auto v = static_cast< std::uint64_t >( value );
+            for ( size_t i = 0; i < 8; ++i )
+                out[i] = static_cast< char >( ( v >> ( 8 * i ) ) & 0xff );
+        }
+
+        static std::int64_t get( const char* in ) {
+            std::uint64_t v = 0;
+            for ( size_t i = 0; i < 8; ++i )
+                v |= static_cast< std::uint64_t >( static_cast< unsigned char >( in[i] ) )
+                     << ( 8 * i );
+            return static_cast< std::int64_t >( v );
+        }
+    };
+
+    /**
+     * NTP style clock offset from probe exchanges. Of the last Window samples
+     * the one with the shortest round trip wins, because queueing only ever
+     * makes a sample worse.
+     */
+    template < size_t Window = 8 >
+    class clock_offset_estimator {
+
+        struct sample {
+            std::int64_t offset = 0;
+            std::int64_t delay = std::numeric_limits< std::int64_t >::max();
+        };
+
+        std::array< sample, Window > samples_{};
+        size_t next_ = 0;
+        size_t count_ = 0;
+        std::int64_t offset_ = 0;
+
+      public:
+        /**
+         * Add the four times of one exchange and return the new offset, the
+         * clock of the peer minus ours, in nanoseconds.
+         */
+        std::int64_t add( std::int64_t t1, std::int64_t t2, std::int64_t t3,
+                          std::int64_t t4 ) {
+
+            sample s;
+            s.offset = ( ( t2 - t1 ) + ( t3 - t4 ) ) / 2;
+            s.delay = std::max< std::int64_t >( ( t4 - t1 ) - ( t3 - t2 ), 0 );
+
+            samples_[next_] = s;
+            next_ = ( next_ + 1 ) % Window;
+            count_ = std::min( count_ + 1, Window );
+
+            const sample* best = &samples_[0];
+            for ( size_t i = 1; i < count_; ++i )
+                if ( samples_[i].delay < best->delay )
+                    best = &samples_[i];
+
+            offset_ = best->offset;
+            return offset_;
+        }
+
+        bool valid() const { return count_ > 0; }
+
+        std::int64_t offset() const { return offset_; }
+
+        void reset() {
+            samples_.fill( sample{} );
+            next_ = 0;
+            count_ = 0;
+            offset_ = 0;
+        }
+    };
+} // namespace o
@@ -23,7 +23,10 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#pragma once
+
 #include "../ohlano.h"
+#include "socket_options.h"
 #include <boost/asio.hpp>
 
 namespace o {
@@ -48,6 +51,12 @@ namespace o {
             , ctx_( ctx )
             , strand_( ctx ) {}
 
+        /// options for accepted sockets, buffer sizes also go to the listening socket
+        void set_socket_options( const socket_options& options ) {
+            std::lock_guard< std::mutex > lock{ options_mtx_ };
+            options_ = options;
+        }
+
         boost::system::error_code start_listen( boost::asio::ip::tcp::endpoint endpoint,
                                                 new_connection_handler handler ) {
 
@@ -73,6 +82,11 @@ namespace o {
                 return ec;
             }
 
+            {
+                std::lock_guard< std::mutex > lock{ options_mtx_ };
+                options_.apply( *acceptor_ );
+            }
+
             acceptor_->bind( endpoint, ec );
             if ( ec ) {
                 DBG( "bind error: ", ec.message() );
@@ -110,6 +124,11 @@ namespace o {
 
             socket_mtx.lock();
 
+            if ( !ec ) {
+                std::lock_guard< std::mutex > lock{ options_mtx_ };
+                options_.apply( socket_ );
+            }
+
             boost::asio::post(
                 ctx_, boost::asio::bind_executor(
                           accepted_handler_strand_,
@@ -134,6 +153,9 @@ namespace o {
         std::atomic< status_code > status_;
         std::mutex socket_mtx;
 
+        std::mutex options_mtx_;
+        socket_options options_;
+
         boost::asio::ip::tcp::socket socket_;
         boost::asio::io_context::strand accepted_handler_strand_;
         std::unique_ptr< boost::asio::ip::tcp::acceptor > acceptor_;
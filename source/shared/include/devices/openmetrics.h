@@ -0,0 +1,496 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+#include "stats.h"
+
+#include <boost/beast/http.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace o {
+
+    /// writes metric families in the OpenMetrics text exposition format
+    class openmetrics_writer {
+
+      public:
+        using label = std::pair< std::string_view, std::string_view >;
+        using labels = std::initializer_list< label >;
+
+        static constexpr const char* content_type =
+            "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+        /// start a new family, all samples of it must follow before the next one
+        void family( std::string_view name, std::string_view type,
+                     std::string_view help, std::string_view unit = {} ) {
+
+            out_.append( "# TYPE " ).append( name ).append( " " ).append( type );
+            out_.push_back( '\n' );
+
+            if ( !unit.empty() ) {
+                out_.append( "# UNIT " ).append( name ).append( " " ).append( unit );
+                out_.push_back( '\n' );
+            }
+
+            out_.append( "# HELP " ).append( name ).append( " " ).append( help );
+            out_.push_back( '\n' );
+        }
+
+        void sample( std::string_view name, std::uint64_t value, labels lbls = {} ) {
+            begin_sample( name, lbls );
+            out_.append( std::to_string( value ) );
+            out_.push_back( '\n' );
+        }
+
+        void sample( std::string_view name, double value, labels lbls = {} ) {
+            char num[32];
+            std::snprintf( num, sizeof( num ), "%.12g", value );
+            begin_sample( name, lbls );
+            out_.append( num );
+            out_.push_back( '\n' );
+        }
+
+        /**
+         * Write the _bucket, _count and _sum samples of a histogram family.
+         * Bucket bounds and the sum are multiplied by scale, so a histogram
+         * of microseconds can be exported in seconds.
+         */
+        template < typename T, size_t B, size_t M >
+        void histogram( std::string_view name, const size_histogram< T, B, M >& hist,
+                        double scale = 1.0, labels lbls = {} ) {
+
+            std::string bucket{ name };
+            bucket.append( "_bucket" );
+
+            std::uint64_t acc = 0;
+
+            for ( size_t i = 0; i < B; ++i ) {
+
+                acc += hist.count( i );
+
+                char le[32];
+                if ( i + 1 < B )
+                    std::snprintf( le, sizeof( le ), "%.12g",
+                                   static_cast< double >( hist.bucket_bound( i ) ) *
+                                       scale );
+                else
+                    std::snprintf( le, sizeof( le ), "+Inf" );
+
+                begin_sample( bucket, lbls, label{ "le", le } );
+                out_.append( std::to_string( acc ) );
+                out_.push_back( '\n' );
+            }
+
+            sample( std::string{ name }.append( "_count" ), acc, lbls );
+            sample( std::string{ name }.append( "_sum" ),
+                    static_cast< double >( hist.sum() ) * scale, lbls );
+        }
+
+        /// terminate the exposition and return it
+        const std::string& finish() {
+            out_.append( "# EOF\n" );
+            return out_;
+        }
+
+      private:
+        void begin_sample( std::string_view name, labels lbls, label extra = {} ) {
+
+            out_.append( name );
+
+            if ( lbls.size() == 0 && extra.first.empty() ) {
+                out_.push_back( ' ' );
+                return;
+            }
+
+            bool first = true;
+            out_.push_back( '{' );
+
+            auto append_label = [&]( const label& lbl ) {
+                if ( !first )
+                    out_.push_back( ',' );
+                first = false;
+
+                out_.append( lbl.first ).append( "=\"" );
+
+                for ( char c : lbl.second ) {
+                    if ( c == '\\' || c == '"' )
+                        out_.push_back( '\\' );
+                    if ( c == '\n' ) {
+                        out_.append( "\\n" );
+                        continue;
+                    }
+                    out_.push_back( c );
+                }
+
+                out_.push_back( '"' );
+            };
+
+            for ( auto& lbl : lbls )
+                append_label( lbl );
+
+            if ( !extra.first.empty() )
+                append_label( extra );
+
+            out_.append( "} " );
+        }
+
+        std::string out_;
+    };
+
+    /// a snapshot of the stats of one session, or the sum of many
+    struct session_metrics {
+
+        using histogram_type = size_histogram< unsigned long long >;
+
+        std::uint64_t received_msgs = 0;
+        std::uint64_t received_bytes = 0;
+        std::uint64_t sent_msgs = 0;
+        std::uint64_t sent_bytes = 0;
+        std::uint64_t queue_depth = 0;
+        std::uint64_t read_buffer_bytes = 0;
+
+        histogram_type received_sizes;
+        histogram_type sent_sizes;
+
+        /// time from starting a write until it completed, in microseconds
+        histogram_type write_latency_us;
+
+        /// round trip times of keepalive pings in microseconds
+        histogram_type rtt_us;
+        double smoothed_rtt_us = 0;
+
+        /// one-way latencies from latency probes and the delay of stamped messages
+        histogram_type one_way_in_us;
+        histogram_type one_way_out_us;
+        histogram_type message_delay_us;
+        double jitter_in_us = 0;
+        double jitter_out_us = 0;
+        double clock_offset_us = 0;
+
+        /// tls handshake durations and how many of them were resumed
+        histogram_type tls_handshake_us;
+        std::uint64_t tls_resumed = 0;
+
+        /// datagram loss and reordering of udp sessions
+        std::uint64_t lost = 0;
+        std::uint64_t reordered = 0;
+        std::uint64_t superseded = 0;
+
+        template < typename Session >
+        static session_metrics collect( Session& session ) {
+
+            session_metrics out;
+
+            {
+                std::lock_guard< std::mutex > lock{ session.stats().mtx() };
+
+                auto& in = session.stats().inbound();
+                auto& outb = session.stats().outbound();
+
+                out.received_msgs = in.msgs().cumulative();
+                out.received_bytes = in.data().cumulative();
+                out.sent_msgs = outb.msgs().cumulative();
+                out.sent_bytes = outb.data().cumulative();
+
+                out.received_sizes = in.sizes();
+                out.sent_sizes = outb.sizes();
+                out.write_latency_us = outb.latencies();
+                out.rtt_us = session.stats().rtt();
+                out.smoothed_rtt_us = session.stats().smoothed_rtt();
+                out.one_way_in_us = in.one_way();
+                out.one_way_out_us = outb.one_way();
+                out.message_delay_us = in.delays();
+                out.jitter_in_us = in.jitter();
+                out.jitter_out_us = outb.jitter();
+                out.clock_offset_us = session.stats().clock_offset();
+                out.tls_handshake_us = session.stats().tls_handshakes();
+                out.tls_resumed = session.stats().resumed_handshakes();
+                out.lost = session.stats().lost();
+                out.reordered = session.stats().reordered();
+                out.superseded = session.stats().superseded();
+            }
+
+            out.queue_depth = session.queue_depth();
+            out.read_buffer_bytes = session.read_buffer_bytes();
+
+            return out;
+        }
+
+        session_metrics& operator+=( const session_metrics& other ) {
+            received_msgs += other.received_msgs;
+            received_bytes += other.received_bytes;
+            sent_msgs += other.sent_msgs;
+            sent_bytes += other.sent_bytes;
+            queue_depth += other.queue_depth;
+            read_buffer_bytes += other.read_buffer_bytes;
+            received_sizes += other.received_sizes;
+            sent_sizes += other.sent_sizes;
+            write_latency_us += other.write_latency_us;
+            rtt_us += other.rtt_us;
+            one_way_in_us += other.one_way_in_us;
+            one_way_out_us += other.one_way_out_us;
+            message_delay_us += other.message_delay_us;
+            tls_handshake_us += other.tls_handshake_us;
+            tls_resumed += other.tls_resumed;
+            lost += other.lost;
+            reordered += other.reordered;
+            superseded += other.superseded;
+            return *this;
+        }
+    };
+
+    /**
+     * Keeps track of the sessions of a server and renders their stats for a
+     * /metrics scrape. Counters of closed sessions are kept in the global
+     * totals so they never go backwards.
+     */
+    template < typename Session >
+    class metrics_registry {
+
+        struct entry {
+            std::string id;
+            std::weak_ptr< Session > session;
+        };
+
+      public:
+        /// start tracking a session, returns the id used as its label
+        std::string add( const std::shared_ptr< Session >& session ) {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            entries_.push_back( { std::to_string( next_id_++ ), session } );
+            return entries_.back().id;
+        }
+
+        /// stop tracking a session and fold its counters into the totals
+        void remove( const std::shared_ptr< Session >& session ) {
+
+            auto last = session_metrics::collect( *session );
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+
+            for ( auto it = entries_.begin(); it != entries_.end(); ++it ) {
+                if ( it->session.lock() == session ) {
+                    retired_ += last;
+                    entries_.erase( it );
+                    return;
+                }
+            }
+        }
+
+        std::string render() {
+
+            std::vector< std::pair< std::string, session_metrics > > live;
+            session_metrics total;
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+
+                total = retired_;
+                total.queue_depth = 0;
+                total.read_buffer_bytes = 0;
+
+                for ( auto& e : entries_ ) {
+                    if ( auto s = e.session.lock() ) {
+                        live.emplace_back( e.id, session_metrics::collect( *s ) );
+                        total += live.back().second;
+                    }
+                }
+            }
+
+            openmetrics_writer w;
+
+            w.family( "maxnet_sessions", "gauge", "Open sessions." );
+            w.sample( "maxnet_sessions", std::uint64_t( live.size() ) );
+
+            w.family( "maxnet_received_messages", "counter", "Messages received." );
+            w.sample( "maxnet_received_messages_total", total.received_msgs );
+
+            w.family( "maxnet_received_bytes", "counter", "Payload bytes received.",
+                      "bytes" );
+            w.sample( "maxnet_received_bytes_total", total.received_bytes );
+
+            w.family( "maxnet_sent_messages", "counter", "Messages sent." );
+            w.sample( "maxnet_sent_messages_total", total.sent_msgs );
+
+            w.family( "maxnet_sent_bytes", "counter", "Payload bytes sent.", "bytes" );
+            w.sample( "maxnet_sent_bytes_total", total.sent_bytes );
+
+            w.family( "maxnet_write_queue_depth", "gauge",
+                      "Messages waiting to be written on all sessions." );
+            w.sample( "maxnet_write_queue_depth", total.queue_depth );
+
+            w.family( "maxnet_read_buffer_bytes", "gauge",
+                      "Memory held by the read buffers of all sessions.", "bytes" );
+            w.sample( "maxnet_read_buffer_bytes", total.read_buffer_bytes );
+
+            w.family( "maxnet_message_size_bytes", "histogram", "Size of messages.",
+                      "bytes" );
+            w.histogram( "maxnet_message_size_bytes", total.received_sizes, 1.0,
+                         { { "direction", "in" } } );
+            w.histogram( "maxnet_message_size_bytes", total.sent_sizes, 1.0,
+                         { { "direction", "out" } } );
+
+            w.family( "maxnet_write_latency_seconds", "histogram",
+                      "Time from starting a write until it completed.", "seconds" );
+            w.histogram( "maxnet_write_latency_seconds", total.write_latency_us, 1e-6 );
+
+            w.family( "maxnet_rtt_seconds", "histogram",
+                      "Round trip time of keepalive pings.", "seconds" );
+            w.histogram( "maxnet_rtt_seconds", total.rtt_us, 1e-6 );
+
+            w.family( "maxnet_one_way_latency_seconds", "histogram",
+                      "One-way latency measured by latency probes.", "seconds" );
+            w.histogram( "maxnet_one_way_latency_seconds", total.one_way_in_us, 1e-6,
+                         { { "direction", "in" } } );
+            w.histogram( "maxnet_one_way_latency_seconds", total.one_way_out_us, 1e-6,
+                         { { "direction", "out" } } );
+
+            w.family( "maxnet_message_delay_seconds", "histogram",
+                      "Send to receive time of stamped messages.", "seconds" );
+            w.histogram( "maxnet_message_delay_seconds", total.message_delay_us, 1e-6 );
+
+            w.family( "maxnet_tls_handshake_seconds", "histogram",
+                      "Duration of tls handshakes.", "seconds" );
+            w.histogram( "maxnet_tls_handshake_seconds", total.tls_handshake_us, 1e-6 );
+
+            w.family( "maxnet_tls_resumed_handshakes", "counter",
+                      "Tls handshakes that resumed an earlier session." );
+            w.sample( "maxnet_tls_resumed_handshakes_total", total.tls_resumed );
+
+            w.family( "maxnet_datagrams_lost", "counter",
+                      "Gaps in the sequence of received udp datagrams." );
+            w.sample( "maxnet_datagrams_lost_total", total.lost );
+
+            w.family( "maxnet_datagrams_reordered", "counter",
+                      "Udp datagrams that arrived late and filled a gap." );
+            w.sample( "maxnet_datagrams_reordered_total", total.reordered );
+
+            w.family( "maxnet_messages_superseded", "counter",
+                      "Messages replaced by a newer one before they were sent." );
+            w.sample( "maxnet_messages_superseded_total", total.superseded );
+
+            w.family( "maxnet_session_received_messages", "counter",
+                      "Messages received per session." );
+            for ( auto& s : live )
+                w.sample( "maxnet_session_received_messages_total",
+                          s.second.received_msgs, { { "session", s.first } } );
+
+            w.family( "maxnet_session_received_bytes", "counter",
+                      "Payload bytes received per session.", "bytes" );
+            for ( auto& s : live )
+                w.sample( "maxnet_session_received_bytes_total", s.second.received_bytes,
+                          { { "session", s.first } } );
+
+            w.family( "maxnet_session_sent_messages", "counter",
+                      "Messages sent per session." );
+            for ( auto& s : live )
+                w.sample( "maxnet_session_sent_messages_total", s.second.sent_msgs,
+                          { { "session", s.first } } );
+
+            w.family( "maxnet_session_sent_bytes", "counter",
+                      "Payload bytes sent per session.", "bytes" );
+            for ( auto& s : live )
+                w.sample( "maxnet_session_sent_bytes_total", s.second.sent_bytes,
+                          { { "session", s.first } } );
+
+            w.family( "maxnet_session_write_queue_depth", "gauge",
+                      "Messages waiting to be written per session." );
+            for ( auto& s : live )
+                w.sample( "maxnet_session_write_queue_depth", s.second.queue_depth,
+                          { { "session", s.first } } );
+
+            w.family( "maxnet_session_read_buffer_bytes", "gauge",
+                      "Memory held by the read buffer per session.", "bytes" );
+            for ( auto& s : live )
+                w.sample( "maxnet_session_read_buffer_bytes", s.second.read_buffer_bytes,
+                          { { "session", s.first } } );
+
+            w.family( "maxnet_session_write_latency_seconds", "histogram",
+                      "Time from starting a write until it completed per session.",
+                      "seconds" );
+            for ( auto& s : live )
+                w.histogram( "maxnet_session_write_latency_seconds",
+                             s.second.write_latency_us, 1e-6,
+                             { { "session", s.first } } );
+
+            w.family( "maxnet_session_smoothed_rtt_seconds", "gauge",
+                      "Smoothed round trip time of keepalive pings per session.",
+                      "seconds" );
+            for ( auto& s : live )
+                w.sample( "maxnet_session_smoothed_rtt_seconds",
+                          s.second.smoothed_rtt_us * 1e-6, { { "session", s.first } } );
+
+            w.family( "maxnet_session_jitter_seconds", "gauge",
+                      "Jitter of the one-way latency per session.", "seconds" );
+            for ( auto& s : live ) {
+                w.sample( "maxnet_session_jitter_seconds", s.second.jitter_in_us * 1e-6,
+                          { { "session", s.first }, { "direction", "in" } } );
+                w.sample( "maxnet_session_jitter_seconds", s.second.jitter_out_us * 1e-6,
+                          { { "session", s.first }, { "direction", "out" } } );
+            }
+
+            w.family( "maxnet_session_clock_offset_seconds", "gauge",
+                      "Clock of the peer minus the local clock per session.", "seconds" );
+            for ( auto& s : live )
+                w.sample( "maxnet_session_clock_offset_seconds",
+                          s.second.clock_offset_us * 1e-6, { { "session", s.first } } );
+
+            return w.finish();
+        }
+
+        /**
+         * Answer GET /metrics, leave every other request alone.
+         * Use it as the http request handler of the server sessions.
+         */
+        template < typename Request, typename Response >
+        bool serve( const Request& req, Response& res ) {
+
+            if ( req.method() != boost::beast::http::verb::get || req.target() != "/metrics" )
+                return false;
+
+            res.result( boost::beast::http::status::ok );
+            res.set( boost::beast::http::field::content_type,
+                     openmetrics_writer::content_type );
+            res.body() = render();
+
+            return true;
+        }
+
+      private:
+        std::mutex mtx_;
+        std::vector< entry > entries_;
+        session_metrics retired_;
+        unsigned long long next_id_ = 0;
+    };
+} // namespace o
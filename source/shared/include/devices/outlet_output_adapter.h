@@ -25,8 +25,10 @@
 
 #pragma once
 
+#include <deque>
 #include <mutex>
 #include "c74_min.h"
+#include "trace.h"
 
 namespace o {
 
@@ -39,11 +41,22 @@ namespace o {
         outlet_output_adapter(
             c74::min::outlet< c74::min::thread_check::none,
                               c74::min::thread_action::assert >* outlet )
-            : outlet_( outlet ) {}
+            : outlet_( outlet ) {
+            atoms_.reserve( 64 );
+        }
+
+        /// decode the message directly from its wire data and send it to the outlet.
+        /// Messages that contain more than one list (osc bundles) send each of them.
+        bool write( const Message* message ) {
+            O_TRACE_SCOPE( "outlet_output_adapter::write", message );
 
-        void write( Message* message ) {
             std::lock_guard< std::mutex > lock{ outlet_mutex_ };
-            outlet_->send( message->get_atoms() );
+
+            return message->visit_atoms( decoder_, atoms_,
+                                         [this, message]( const c74::min::atoms& atms ) {
+                                             O_TRACE_SCOPE( "outlet::send", message );
+                                             outlet_->send( atms );
+                                         } );
         }
 
         template < typename... T >
@@ -57,5 +70,8 @@ namespace o {
             outlet_;
         std::deque< Message* > output_queue_;
         std::mutex outlet_mutex_;
+
+        typename Message::atoms_decoder decoder_;
+        c74::min::atoms atoms_;
     };
 }
@@ -0,0 +1,180 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+#include "frame_buffer_pool.h"
+
+#include <boost/asio/buffer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace o {
+
+    /**
+     * Contiguous dynamic buffer that borrows its memory from the frame_buffer_pool
+     * of the calling thread. Blocks above keep_bytes go back to the pool as soon
+     * as the buffer is consumed, smaller ones are kept for the next message until
+     * release_if_idle() finds the buffer unused for long enough.
+     *
+     * Meets the DynamicBuffer requirements, so it can be passed to
+     * websocket::stream::async_read directly.
+     */
+    class pooled_flat_buffer {
+
+      public:
+        using const_buffers_type = boost::asio::const_buffer;
+        using mutable_buffers_type = boost::asio::mutable_buffer;
+        using clock = std::chrono::steady_clock;
+
+        /// buffers up to this size stay with the session between messages
+        static constexpr std::size_t default_keep_bytes = 4096;
+
+        pooled_flat_buffer() = default;
+
+        OHLANO_NOCOPY( pooled_flat_buffer )
+
+        ~pooled_flat_buffer() { release(); }
+
+        std::size_t size() const { return out_ - in_; }
+
+        std::size_t max_size() const { return std::numeric_limits< std::size_t >::max(); }
+
+        std::size_t capacity() const { return block_.capacity(); }
+
+        const_buffers_type data() const {
+            return { block_.data() + in_, size() };
+        }
+
+        mutable_buffers_type prepare( std::size_t n ) {
+
+            if ( n > max_size() - size() )
+                throw std::length_error( "pooled_flat_buffer overflow" );
+
+            if ( capacity() - out_ < n ) {
+
+                auto readable = size();
+
+                if ( capacity() - readable >= n ) {
+                    // enough room if the readable bytes move to the front
+                    std::memmove( block_.data(), block_.data() + in_, readable );
+                } else {
+                    // grows geometrically, a message read frame by frame is
+                    // copied a logarithmic number of times
+                    auto bigger = frame_buffer_pool::local().acquire(
+                        std::max( readable + n, 2 * capacity() ) );
+                    if ( readable > 0 )
+                        std::memcpy( bigger.data(), block_.data() + in_, readable );
+                    release();
+                    adopt( std::move( bigger ) );
+                }
+
+                in_ = 0;
+                out_ = readable;
+            }
+
+            prepared_ = n;
+            return { block_.data() + out_, n };
+        }
+
+        void commit( std::size_t n ) {
+            out_ += std::min( n, prepared_ );
+            prepared_ = 0;
+        }
+
+        void consume( std::size_t n ) {
+
+            in_ += std::min( n, size() );
+
+            if ( in_ != out_ )
+                return;
+
+            in_ = 0;
+            out_ = 0;
+            idle_since_ = clock::now();
+
+            if ( capacity() > keep_bytes_ && prepared_ == 0 )
+                release();
+        }
+
+        /**
+         * Give the memory back if the buffer is empty, nothing is prepared and no
+         * message arrived for the given time. Must not race with a read.
+         */
+        bool release_if_idle( clock::duration idle ) {
+
+            if ( !block_ || size() > 0 || prepared_ > 0 )
+                return false;
+
+            if ( clock::now() - idle_since_ < idle )
+                return false;
+
+            release();
+            return true;
+        }
+
+        void set_keep_bytes( std::size_t bytes ) { keep_bytes_ = bytes; }
+
+        /// bytes borrowed by all pooled_flat_buffers of the process
+        static std::size_t held_bytes() { return held().load( std::memory_order_relaxed ); }
+
+      private:
+        static std::atomic< std::size_t >& held() {
+            static std::atomic< std::size_t > bytes{ 0 };
+            return bytes;
+        }
+
+        void adopt( frame_buffer&& block ) {
+            block_ = std::move( block );
+            held().fetch_add( block_.capacity(), std::memory_order_relaxed );
+        }
+
+        void release() {
+            if ( !block_ )
+                return;
+
+            held().fetch_sub( block_.capacity(), std::memory_order_relaxed );
+            frame_buffer_pool::local().release( std::move( block_ ) );
+
+            in_ = 0;
+            out_ = 0;
+        }
+
+        frame_buffer block_;
+
+        std::size_t in_ = 0;
+        std::size_t out_ = 0;
+        std::size_t prepared_ = 0;
+        std::size_t keep_bytes_ = default_keep_bytes;
+
+        clock::time_point idle_since_ = clock::now();
+    };
+} // namespace o
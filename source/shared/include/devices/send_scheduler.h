@@ -0,0 +1,245 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+#include "stats.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace o {
+
+    /// timing of the ticks of a latest_value_scheduler
+    struct send_schedule_stats {
+
+        /// deviation of the actual tick time from its deadline in microseconds
+        size_histogram< std::uint64_t, 16, 3 > jitter;
+
+        std::uint64_t jitter_max_us = 0;
+        std::uint64_t jitter_sum_us = 0;
+
+        /// ticks that fired with a new value to send
+        std::uint64_t sent = 0;
+
+        /// values that were replaced by a newer one before their tick
+        std::uint64_t superseded = 0;
+
+        /// ticks that were skipped because the timer fell behind by a full period
+        std::uint64_t overruns = 0;
+
+        double jitter_mean_us() const {
+            auto ticks = jitter.total();
+            return ticks ? static_cast< double >( jitter_sum_us ) / ticks : 0.0;
+        }
+
+        void reset() { *this = send_schedule_stats{}; }
+    };
+
+    /**
+     * Holds only the newest submitted message and hands it to the sink at a
+     * fixed rate. Deadlines are computed from the start time, so timer latency
+     * does not accumulate into drift. While stopped, pushed messages go to the
+     * sink right away, in order with a value that was pending when the
+     * scheduler stopped. push() may be called from any thread, the sink is
+     * always called from the io_context.
+     */
+    template < typename Message, typename Clock = std::chrono::steady_clock >
+    class latest_value_scheduler {
+
+      public:
+        using clock = Clock;
+        using sink_type = std::function< void( const Message* ) >;
+
+        latest_value_scheduler( boost::asio::io_context& ctx,
+                                typename Message::factory& factory, sink_type sink )
+            : ctx_( ctx ), timer_( ctx ), factory_( factory ), sink_( std::move( sink ) ) {}
+
+        ~latest_value_scheduler() {
+            timer_.cancel();
+            release_pending();
+        }
+
+        OHLANO_NOCOPY( latest_value_scheduler );
+
+        /// change the rate in Hz, 0 stops the scheduler and sends the pending value
+        void set_rate( double hz ) {
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+
+            // push() decides between scheduling and sending under the same lock
+            enabled_ = hz > 0;
+
+            if ( !enabled_ ) {
+                boost::asio::post( ctx_, [this, msg = std::exchange( pending_, nullptr )]() {
+                    timer_.cancel();
+                    running_ = false;
+                    ++generation_;
+
+                    if ( msg )
+                        sink_( msg );
+                } );
+                return;
+            }
+
+            boost::asio::post( ctx_, [this, hz]() {
+                timer_.cancel();
+
+                period_ = std::chrono::duration_cast< typename clock::duration >(
+                    std::chrono::duration< double >( 1.0 / hz ) );
+
+                if ( period_.count() <= 0 )
+                    period_ = typename clock::duration( 1 );
+
+                running_ = true;
+                deadline_ = clock::now() + period_;
+                ++generation_;
+                schedule();
+            } );
+        }
+
+        void stop() { set_rate( 0 ); }
+
+        bool running() const { return running_; }
+
+        /// take ownership of msg, replacing a value that was not sent yet
+        void push( const Message* msg ) {
+
+            const Message* old;
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+
+                if ( !enabled_ ) {
+                    boost::asio::post( ctx_, [this, msg]() { sink_( msg ); } );
+                    return;
+                }
+
+                old = pending_;
+                pending_ = msg;
+
+                if ( old )
+                    stats_.superseded++;
+            }
+
+            if ( old )
+                factory_.deallocate( old );
+        }
+
+        send_schedule_stats stats() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            return stats_;
+        }
+
+        void reset_stats() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            stats_.reset();
+        }
+
+      private:
+        void schedule() {
+            timer_.expires_at( deadline_ );
+            timer_.async_wait( [this, generation = generation_]( boost::system::error_code ec ) {
+                if ( ec || !running_ || generation != generation_ )
+                    return;
+                tick();
+            } );
+        }
+
+        void tick() {
+
+            auto now = clock::now();
+            auto late = std::max( now - deadline_, clock::duration::zero() );
+
+            auto late_us = static_cast< std::uint64_t >(
+                std::chrono::duration_cast< std::chrono::microseconds >( late ).count() );
+
+            const Message* msg;
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+
+                msg = pending_;
+                pending_ = nullptr;
+
+                stats_.jitter.add( late_us );
+                stats_.jitter_sum_us += late_us;
+                stats_.jitter_max_us = std::max( stats_.jitter_max_us, late_us );
+
+                if ( msg )
+                    stats_.sent++;
+
+                // skip whole periods we missed instead of firing them in a burst
+                if ( late >= period_ ) {
+                    auto missed = late / period_;
+                    stats_.overruns += static_cast< std::uint64_t >( missed );
+                    deadline_ += period_ * missed;
+                }
+            }
+
+            deadline_ += period_;
+            schedule();
+
+            if ( msg )
+                sink_( msg );
+        }
+
+        void release_pending() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            if ( pending_ ) {
+                factory_.deallocate( pending_ );
+                pending_ = nullptr;
+            }
+        }
+
+        boost::asio::io_context& ctx_;
+        boost::asio::basic_waitable_timer< Clock > timer_;
+
+        typename Message::factory& factory_;
+        sink_type sink_;
+
+        typename clock::duration period_{};
+        typename clock::time_point deadline_{};
+
+        std::atomic< bool > running_{ false };
+        std::uint64_t generation_ = 0;
+
+        std::mutex mtx_;
+        bool enabled_ = false;
+        const Message* pending_ = nullptr;
+        send_schedule_stats stats_;
+    };
+} // namespace o
@@ -0,0 +1,110 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace o {
+
+    /**
+     * Byte storage that keeps up to InlineCapacity bytes inside the object and
+     * only allocates on the heap for larger contents. Once spilled, the heap
+     * block is kept and reused for the lifetime of the buffer.
+     */
+    template < size_t InlineCapacity >
+    class small_buffer {
+      public:
+        using value_type = char;
+
+        static constexpr size_t inline_capacity = InlineCapacity;
+
+        small_buffer() = default;
+
+        small_buffer( const small_buffer& other ) { assign( other.data(), other.size() ); }
+
+        small_buffer& operator=( const small_buffer& other ) {
+            if ( this != &other )
+                assign( other.data(), other.size() );
+            return *this;
+        }
+
+        char* data() { return heap_ ? heap_.get() : inline_; }
+
+        const char* data() const { return heap_ ? heap_.get() : inline_; }
+
+        size_t size() const { return size_; }
+
+        size_t capacity() const { return heap_ ? heap_capacity_ : InlineCapacity; }
+
+        bool empty() const { return size_ == 0; }
+
+        /// true if the contents currently live on the heap
+        bool spilled() const { return static_cast< bool >( heap_ ); }
+
+        void clear() { size_ = 0; }
+
+        void reserve( size_t capacity ) {
+
+            if ( capacity <= this->capacity() )
+                return;
+
+            std::unique_ptr< char[] > block( new char[capacity] );
+            std::memcpy( block.get(), data(), size_ );
+
+            heap_ = std::move( block );
+            heap_capacity_ = capacity;
+        }
+
+        /// resize without initializing new bytes
+        void resize( size_t size ) {
+            reserve( size );
+            size_ = size;
+        }
+
+        void assign( const char* bytes, size_t size ) {
+            resize( size );
+            std::memcpy( data(), bytes, size );
+        }
+
+        void append( const char* bytes, size_t size ) {
+            auto offset = size_;
+            if ( offset + size > capacity() )
+                reserve( std::max( offset + size, capacity() * 2 ) );
+            resize( offset + size );
+            std::memcpy( data() + offset, bytes, size );
+        }
+
+      private:
+        char inline_[InlineCapacity];
+        std::unique_ptr< char[] > heap_;
+        size_t heap_capacity_ = 0;
+        size_t size_ = 0;
+    };
+} // namespace o
@@ -0,0 +1,185 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/core/ignore_unused.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace o {
+
+    /**
+     * Socket options applied to every connected and accepted socket. Zero sizes
+     * and values leave the system defaults in place. Options the platform does
+     * not know are skipped.
+     */
+    struct socket_options {
+
+        /// disable Nagle's algorithm, small frames are sent immediately
+        bool no_delay = true;
+
+        /// acknowledge received data immediately (linux only, reapplied after every read)
+        bool quick_ack = false;
+
+        int send_buffer = 0;
+        int receive_buffer = 0;
+
+        /// differentiated services code point, 0 - 63, written into IP_TOS / IPV6_TCLASS
+        int dscp = 0;
+
+        /// microseconds to busy poll the device queue on blocking reads (linux only)
+        int busy_poll = 0;
+
+        /// apply all options to a connected socket, returns the last error
+        boost::system::error_code apply( boost::asio::ip::tcp::socket& socket ) const {
+
+            boost::system::error_code ec;
+            boost::system::error_code last;
+
+            socket.set_option( boost::asio::ip::tcp::no_delay( no_delay ), ec );
+            if ( ec ) {
+                DBG( "could not set TCP_NODELAY: ", ec.message() );
+                last = ec;
+            }
+
+            apply_ip( socket, last );
+
+            if ( quick_ack )
+                request_quick_ack( socket );
+
+            return last;
+        }
+
+        /// apply the options that are not tcp specific to a connected or bound udp socket
+        boost::system::error_code apply( boost::asio::ip::udp::socket& socket ) const {
+            boost::system::error_code last;
+            apply_ip( socket, last );
+            return last;
+        }
+
+        /// buffer sizes of the listening socket are inherited by accepted sockets
+        boost::system::error_code apply( boost::asio::ip::tcp::acceptor& acceptor ) const {
+            boost::system::error_code last;
+            apply_buffers( acceptor, last );
+            return last;
+        }
+
+        /// the kernel falls back to delayed acks on its own, so this has to be repeated
+        static void request_quick_ack( boost::asio::ip::tcp::socket& socket ) {
+#ifdef TCP_QUICKACK
+            boost::system::error_code ec;
+            socket.set_option(
+                boost::asio::detail::socket_option::boolean< IPPROTO_TCP, TCP_QUICKACK >(
+                    true ),
+                ec );
+#else
+            boost::ignore_unused( socket );
+#endif
+        }
+
+      private:
+        template < typename Socket >
+        void apply_ip( Socket& socket, boost::system::error_code& last ) const {
+
+            boost::system::error_code ec;
+
+            apply_buffers( socket, last );
+
+            if ( dscp > 0 ) {
+                bool v6 = socket.local_endpoint( ec ).address().is_v6();
+                set_tos( socket, v6, std::min( dscp, 63 ) << 2, ec );
+                if ( ec ) {
+                    DBG( "could not set IP_TOS: ", ec.message() );
+                    last = ec;
+                    ec.clear();
+                }
+            }
+
+#ifdef SO_BUSY_POLL
+            if ( busy_poll > 0 ) {
+                socket.set_option( boost::asio::detail::socket_option::integer<
+                                       SOL_SOCKET, SO_BUSY_POLL >( busy_poll ),
+                                   ec );
+                if ( ec ) {
+                    DBG( "could not set SO_BUSY_POLL: ", ec.message() );
+                    last = ec;
+                }
+            }
+#endif
+        }
+
+        template < typename Socket >
+        void apply_buffers( Socket& socket, boost::system::error_code& last ) const {
+
+            boost::system::error_code ec;
+
+            if ( send_buffer > 0 ) {
+                socket.set_option( boost::asio::socket_base::send_buffer_size( send_buffer ),
+                                   ec );
+                if ( ec ) {
+                    DBG( "could not set SO_SNDBUF: ", ec.message() );
+                    last = ec;
+                }
+            }
+
+            if ( receive_buffer > 0 ) {
+                socket.set_option(
+                    boost::asio::socket_base::receive_buffer_size( receive_buffer ), ec );
+                if ( ec ) {
+                    DBG( "could not set SO_RCVBUF: ", ec.message() );
+                    last = ec;
+                }
+            }
+        }
+
+        template < typename Socket >
+        static void set_tos( Socket& socket, bool v6, int value,
+                             boost::system::error_code& ec ) {
+#ifdef IPV6_TCLASS
+            if ( v6 ) {
+                socket.set_option( boost::asio::detail::socket_option::integer<
+                                       IPPROTO_IPV6, IPV6_TCLASS >( value ),
+                                   ec );
+                return;
+            }
+#endif
+            socket.set_option(
+                boost::asio::detail::socket_option::integer< IPPROTO_IP, IP_TOS >( value ),
+                ec );
+        }
+    };
+} // namespace o
@@ -23,12 +23,87 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#pragma once
+
 #include "../ohlano.h"
 #include <boost/asio/basic_waitable_timer.hpp>
 #include <boost/asio/io_context.hpp>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <limits>
 #include <mutex>
 
+/// counts values into power of two buckets, the last bucket catches everything above
+template < typename T, size_t Buckets = 16, size_t MinBits = 4 >
+class size_histogram {
+
+    std::array< T, Buckets > counts_{};
+    T sum_ = 0;
+
+  public:
+    static constexpr size_t buckets = Buckets;
+
+    /// the inclusive upper bound of bucket i
+    static size_t bucket_bound( size_t i ) {
+        return ( i + 1 < Buckets ) ? ( size_t( 1 ) << ( i + MinBits ) )
+                                   : std::numeric_limits< size_t >::max();
+    }
+
+    static size_t bucket_for( size_t value ) {
+        size_t i = 0;
+        while ( i + 1 < Buckets && value > bucket_bound( i ) ) {
+            ++i;
+        }
+        return i;
+    }
+
+    void add( size_t value ) {
+        counts_[bucket_for( value )]++;
+        sum_ += static_cast< T >( value );
+    }
+
+    T count( size_t bucket ) const { return counts_[bucket]; }
+
+    /// sum of all added values
+    T sum() const { return sum_; }
+
+    T total() const {
+        T sum = 0;
+        for ( auto c : counts_ )
+            sum += c;
+        return sum;
+    }
+
+    /// smallest bucket bound that covers at least the given fraction of all values
+    size_t percentile_bound( double fraction ) const {
+
+        T all = total();
+        T acc = 0;
+
+        for ( size_t i = 0; i < Buckets; ++i ) {
+            acc += counts_[i];
+            if ( all > 0 && static_cast< double >( acc ) >= fraction * all )
+                return bucket_bound( i );
+        }
+
+        return 0;
+    }
+
+    size_histogram& operator+=( const size_histogram& other ) {
+        for ( size_t i = 0; i < Buckets; ++i )
+            counts_[i] += other.counts_[i];
+        sum_ += other.sum_;
+        return *this;
+    }
+
+    void reset() {
+        counts_.fill( 0 );
+        sum_ = 0;
+    }
+};
+
 template < typename T >
 class stats_category {
 
@@ -36,6 +111,7 @@ class stats_category {
 
         T total = 0;
         T last = 0;
+        T lifetime = 0;
 
       public:
         void diff_callback() {
@@ -47,11 +123,23 @@ class stats_category {
 
         T count() { return total; }
 
-        T operator++() { return total++; }
+        /// everything counted since construction, not affected by reset()
+        T cumulative() const { return lifetime; }
+
+        T operator++() {
+            lifetime++;
+            return total++;
+        }
 
-        T operator++( int i ) { return ++total; }
+        T operator++( int ) {
+            lifetime++;
+            return ++total;
+        }
 
-        void add( T amount ) { total += amount; }
+        void add( T amount ) {
+            total += amount;
+            lifetime += amount;
+        }
 
         void reset() {
             total = 0;
@@ -61,14 +149,53 @@ class stats_category {
 
     stat data_;
     stat msgs_;
+    size_histogram< T > sizes_;
+    size_histogram< T > latencies_;
+    size_histogram< T > one_way_;
+    size_histogram< T > delays_;
+    double last_one_way_ = 0;
+    double jitter_ = 0;
 
   public:
     stat& data() { return data_; }
     stat& msgs() { return msgs_; }
 
+    /// distribution of message sizes since the last reset
+    size_histogram< T >& sizes() { return sizes_; }
+
+    /// distribution of operation times in microseconds since the last reset
+    size_histogram< T >& latencies() { return latencies_; }
+
+    /// one-way latencies in microseconds measured by latency probes
+    size_histogram< T >& one_way() { return one_way_; }
+
+    /// send to receive time of stamped messages in microseconds
+    size_histogram< T >& delays() { return delays_; }
+
+    /// mean deviation of consecutive one-way latencies in microseconds (RFC 3550)
+    double jitter() const { return jitter_; }
+
+    /// negative latencies from a not yet settled clock offset count as zero
+    void add_one_way( double microseconds ) {
+        microseconds = std::max( microseconds, 0. );
+        if ( one_way_.total() > 0 )
+            jitter_ += ( std::abs( microseconds - last_one_way_ ) - jitter_ ) / 16.;
+        last_one_way_ = microseconds;
+        one_way_.add( static_cast< size_t >( microseconds ) );
+    }
+
+    void add_delay( double microseconds ) {
+        delays_.add( static_cast< size_t >( std::max( microseconds, 0. ) ) );
+    }
+
     void reset() {
         data().reset();
         msgs().reset();
+        sizes().reset();
+        latencies().reset();
+        one_way_.reset();
+        delays_.reset();
+        jitter_ = 0;
     }
 };
 
@@ -80,6 +207,17 @@ class session_stats {
     stats_category< T > inbound_;
     stats_category< T > outbound_;
 
+    size_histogram< T > rtt_;
+    double smoothed_rtt_ = 0;
+    double clock_offset_ = 0;
+
+    size_histogram< T > tls_handshakes_;
+    T resumed_handshakes_ = 0;
+
+    T lost_ = 0;
+    T reordered_ = 0;
+    T superseded_ = 0;
+
     boost::asio::basic_waitable_timer< Clock > timer_;
     std::mutex mutex_;
 
@@ -133,5 +271,51 @@ class session_stats {
     stats_category< T >& inbound() { return inbound_; }
     stats_category< T >& outbound() { return outbound_; }
 
+    /// round trip times of keepalive pings in microseconds
+    size_histogram< T >& rtt() { return rtt_; }
+
+    /// round trip time in microseconds, smoothed with a gain of 1/8 like TCP's SRTT
+    double smoothed_rtt() const { return smoothed_rtt_; }
+
+    void add_rtt( T microseconds ) {
+        rtt_.add( microseconds );
+        smoothed_rtt_ = ( rtt_.total() == 1 )
+                            ? microseconds
+                            : smoothed_rtt_ + ( microseconds - smoothed_rtt_ ) / 8.;
+    }
+
+    /// clock of the peer minus ours in microseconds, from latency probes
+    double clock_offset() const { return clock_offset_; }
+
+    void set_clock_offset( double microseconds ) { clock_offset_ = microseconds; }
+
+    /// duration of tls handshakes in microseconds, full and resumed ones
+    size_histogram< T >& tls_handshakes() { return tls_handshakes_; }
+
+    /// handshakes that resumed an earlier tls session
+    T resumed_handshakes() const { return resumed_handshakes_; }
+
+    void add_tls_handshake( T microseconds, bool resumed ) {
+        tls_handshakes_.add( microseconds );
+        resumed_handshakes_ += resumed;
+    }
+
+    /// gaps in the sequence of received datagrams, udp sessions only. Never decreases,
+    /// datagrams that fill a gap later are counted by reordered()
+    T lost() const { return lost_; }
+
+    /// datagrams that arrived after a newer one and filled a gap, udp sessions only.
+    /// lost() - reordered() is the number of datagrams that never arrived
+    T reordered() const { return reordered_; }
+
+    /// messages replaced by a newer one before they were sent (latest-value)
+    T superseded() const { return superseded_; }
+
+    void add_lost( T datagrams ) { lost_ += datagrams; }
+
+    void add_reordered() { ++reordered_; }
+
+    void add_superseded( T messages ) { superseded_ += messages; }
+
     std::mutex& mtx() { return mutex_; };
 };
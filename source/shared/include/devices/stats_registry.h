@@ -0,0 +1,230 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+#include "pooled_flat_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace o {
+
+    /**
+     * Space-saving sketch (Metwally et al.) for the heaviest keys of a weighted
+     * stream. Keeps at most Capacity counters, a key that is not tracked replaces
+     * the smallest one and inherits its count as error bound.
+     */
+    template < typename Key, size_t Capacity = 64 >
+    class space_saving {
+
+      public:
+        struct counter {
+            Key key;
+            std::uint64_t count;
+
+            /// the count may be overestimated by at most this much
+            std::uint64_t error;
+        };
+
+        void add( const Key& key, std::uint64_t weight ) {
+
+            if ( weight == 0 )
+                return;
+
+            for ( auto& c : counters_ ) {
+                if ( c.key == key ) {
+                    c.count += weight;
+                    return;
+                }
+            }
+
+            if ( counters_.size() < Capacity ) {
+                counters_.push_back( { key, weight, 0 } );
+                return;
+            }
+
+            auto smallest = std::min_element(
+                counters_.begin(), counters_.end(),
+                []( const counter& a, const counter& b ) { return a.count < b.count; } );
+
+            smallest->key = key;
+            smallest->error = smallest->count;
+            smallest->count += weight;
+        }
+
+        /// the n largest counters, largest first
+        std::vector< counter > top( size_t n ) const {
+
+            std::vector< counter > out{ counters_ };
+
+            n = std::min( n, out.size() );
+
+            std::partial_sort(
+                out.begin(), out.begin() + n, out.end(),
+                []( const counter& a, const counter& b ) { return a.count > b.count; } );
+
+            out.resize( n );
+            return out;
+        }
+
+        void clear() { counters_.clear(); }
+
+      private:
+        std::vector< counter > counters_;
+    };
+
+    /**
+     * Process-wide traffic totals of all sessions. Sessions count into their own
+     * source without locking, the registry folds the sources into the totals and
+     * the heavy hitter sketch whenever a report is requested.
+     */
+    class stats_registry {
+
+      public:
+        struct source {
+
+            explicit source( std::string source_name ) : name( std::move( source_name ) ) {}
+
+            void inbound( std::uint64_t bytes ) {
+                in_bytes.fetch_add( bytes, std::memory_order_relaxed );
+                in_msgs.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+            void outbound( std::uint64_t bytes ) {
+                out_bytes.fetch_add( bytes, std::memory_order_relaxed );
+                out_msgs.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+            const std::string name;
+
+            std::atomic< std::uint64_t > in_bytes{ 0 };
+            std::atomic< std::uint64_t > in_msgs{ 0 };
+            std::atomic< std::uint64_t > out_bytes{ 0 };
+            std::atomic< std::uint64_t > out_msgs{ 0 };
+        };
+
+        using source_ptr = std::shared_ptr< source >;
+        using sketch_type = space_saving< std::string, 64 >;
+        using heavy_hitter = sketch_type::counter;
+
+        struct report {
+            std::uint64_t in_bytes = 0;
+            std::uint64_t in_msgs = 0;
+            std::uint64_t out_bytes = 0;
+            std::uint64_t out_msgs = 0;
+
+            /// sources that are still held by a session
+            size_t sessions = 0;
+
+            /// memory currently borrowed by pooled read buffers
+            size_t read_buffer_bytes = 0;
+
+            /// sources with the most bytes in both directions, largest first
+            std::vector< heavy_hitter > top;
+        };
+
+        static stats_registry& global() {
+            static stats_registry registry;
+            return registry;
+        }
+
+        /// create a source, it is counted until its last owner besides the registry is gone
+        source_ptr attach( std::string name ) {
+
+            auto src = std::make_shared< source >( std::move( name ) );
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+
+            sources_.push_back( src );
+
+            // without regular reports, closed sources would pile up here
+            if ( ++attached_ % 64 == 0 )
+                fold();
+
+            return src;
+        }
+
+        report snapshot( size_t top_n = 10 ) {
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+
+            fold();
+
+            report out = totals_;
+            out.sessions = sources_.size();
+            out.read_buffer_bytes = pooled_flat_buffer::held_bytes();
+            out.top = sketch_.top( top_n );
+
+            return out;
+        }
+
+        void reset() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            fold();
+            totals_ = report{};
+            sketch_.clear();
+        }
+
+      private:
+        // move the counts of all sources into the totals and drop closed sources
+        void fold() {
+            sources_.erase( std::remove_if( sources_.begin(), sources_.end(),
+                                            [this]( const source_ptr& src ) {
+                                                // a closed source can not count any
+                                                // more, so check before taking its counts
+                                                bool closed = src.use_count() == 1;
+                                                fold( *src );
+                                                return closed;
+                                            } ),
+                            sources_.end() );
+        }
+
+        void fold( source& src ) {
+
+            auto in_bytes = src.in_bytes.exchange( 0, std::memory_order_relaxed );
+            auto out_bytes = src.out_bytes.exchange( 0, std::memory_order_relaxed );
+
+            totals_.in_bytes += in_bytes;
+            totals_.out_bytes += out_bytes;
+            totals_.in_msgs += src.in_msgs.exchange( 0, std::memory_order_relaxed );
+            totals_.out_msgs += src.out_msgs.exchange( 0, std::memory_order_relaxed );
+
+            sketch_.add( src.name, in_bytes + out_bytes );
+        }
+
+        std::mutex mtx_;
+        std::vector< source_ptr > sources_;
+        report totals_;
+        sketch_type sketch_;
+        std::uint64_t attached_ = 0;
+    };
+} // namespace o
@@ -0,0 +1,76 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+
+#include <boost/version.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace o {
+
+    /**
+     * Buffering and framing of a websocket stream. The defaults are the ones of
+     * beast. Large messages stream faster without fragmentation and with a big
+     * write buffer, small control messages go out sooner with a small one.
+     */
+    struct stream_tuning {
+
+        enum class read_buffer_type { multi, flat, pooled };
+
+        /// split outgoing messages into frames of write_buffer_bytes
+        bool auto_fragment = true;
+
+        /// size of the buffer used to mask and fragment outgoing frames
+        std::size_t write_buffer_bytes = 4096;
+
+        /// incoming messages above this size fail the read, 0 for no limit
+        std::size_t read_message_max = 16 * 1024 * 1024;
+
+        /**
+         * multi_buffer grows in chunks, flat_buffer keeps each message contiguous.
+         * Both keep the memory of the largest message for the lifetime of the
+         * session. pooled borrows a contiguous block from the frame_buffer_pool
+         * and gives large ones back after every message.
+         */
+        read_buffer_type read_buffer = read_buffer_type::pooled;
+
+        template < typename Stream >
+        void apply( Stream& stream ) const {
+
+            stream.auto_fragment( auto_fragment );
+            stream.read_message_max( read_message_max );
+
+#if BOOST_VERSION >= 107000
+            stream.write_buffer_bytes( std::max< std::size_t >( write_buffer_bytes, 8 ) );
+#else
+            stream.write_buffer_size( std::max< std::size_t >( write_buffer_bytes, 8 ) );
+#endif
+        }
+    };
+} // namespace o
@@ -0,0 +1,532 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../ohlano.h"
+
+#include <boost/system/error_code.hpp>
+
+#include <string_view>
+
+#ifdef MAXNET_ENABLE_TLS
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#endif
+
+namespace o {
+
+    /**
+     * How the websocket stream of a session reaches its tcp socket. Plain
+     * streams sit right on top of it, tls streams are specialized below.
+     */
+    template < typename Layer >
+    struct stream_layer {
+        static constexpr bool is_tls = false;
+
+        static Layer& socket( Layer& layer ) { return layer; }
+    };
+
+#ifdef MAXNET_ENABLE_TLS
+
+    /// the websocket stream of wss:// sessions
+    using tls_websocket_stream = boost::beast::websocket::stream<
+        boost::asio::ssl::stream< boost::asio::ip::tcp::socket > >;
+
+    /// AEAD ciphers offered or accepted, all of them with forward secrecy
+    enum class tls_ciphers { automatic, aes_gcm, chacha20 };
+
+    struct tls_options {
+
+        /**
+         * automatic allows AES-GCM first and ChaCha20-Poly1305 second. Servers then
+         * still pick ChaCha20 for clients that prefer it, which are usually the
+         * ones without AES instructions.
+         */
+        tls_ciphers ciphers = tls_ciphers::automatic;
+
+        /// clients check the certificate chain and the host name of the server
+        bool verify_peer = true;
+
+        /// additionally trusted certificates in PEM format, e.g. of a test server
+        std::string ca_file;
+
+        /// certificate chain and private key of a server in PEM format
+        std::string certificate_file;
+        std::string private_key_file;
+
+        /// clients keep a session ticket per host, servers hand them out
+        bool resumption = true;
+    };
+
+    /// a certificate and its private key in PEM format
+    struct tls_certificate {
+
+        std::string certificate;
+        std::string private_key;
+
+        /**
+         * Create a self-signed P-256 certificate for common_name that is also
+         * valid for localhost, 127.0.0.1 and ::1. Good for local tests only,
+         * clients have to trust() it explicitly.
+         */
+        static tls_certificate self_signed( const std::string& common_name,
+                                            boost::system::error_code& ec,
+                                            int valid_days = 30 ) {
+
+            tls_certificate out;
+
+            std::unique_ptr< EVP_PKEY_CTX, decltype( &EVP_PKEY_CTX_free ) > kctx{
+                EVP_PKEY_CTX_new_id( EVP_PKEY_EC, nullptr ), &EVP_PKEY_CTX_free };
+            std::unique_ptr< EVP_PKEY, decltype( &EVP_PKEY_free ) > key{ nullptr,
+                                                                          &EVP_PKEY_free };
+            std::unique_ptr< X509, decltype( &X509_free ) > cert{ X509_new(), &X509_free };
+
+            EVP_PKEY* raw_key = nullptr;
+
+            if ( !kctx || !cert || EVP_PKEY_keygen_init( kctx.get() ) <= 0 ||
+                 EVP_PKEY_CTX_set_ec_paramgen_curve_nid( kctx.get(),
+                                                         NID_X9_62_prime256v1 ) <= 0 ||
+                 EVP_PKEY_keygen( kctx.get(), &raw_key ) <= 0 ) {
+                ec = last_error();
+                return out;
+            }
+
+            key.reset( raw_key );
+
+            std::uint32_t serial;
+            RAND_bytes( reinterpret_cast< unsigned char* >( &serial ), sizeof( serial ) );
+
+            X509_set_version( cert.get(), 2 );
+            ASN1_INTEGER_set( X509_get_serialNumber( cert.get() ), serial >> 1 );
+            X509_gmtime_adj( X509_getm_notBefore( cert.get() ), -60 );
+            X509_gmtime_adj( X509_getm_notAfter( cert.get() ), 86400L * valid_days );
+            X509_set_pubkey( cert.get(), key.get() );
+
+            auto name = X509_get_subject_name( cert.get() );
+            X509_NAME_add_entry_by_txt(
+                name, "CN", MBSTRING_ASC,
+                reinterpret_cast< const unsigned char* >( common_name.c_str() ), -1, -1, 0 );
+            X509_set_issuer_name( cert.get(), name );
+
+            std::string alt_names = "DNS:" + common_name;
+            if ( common_name != "localhost" )
+                alt_names += ",DNS:localhost";
+            alt_names += ",IP:127.0.0.1,IP:::1";
+
+            if ( !add_extension( cert.get(), NID_basic_constraints, "critical,CA:TRUE" ) ||
+                 !add_extension( cert.get(), NID_subject_alt_name, alt_names ) ||
+                 X509_sign( cert.get(), key.get(), EVP_sha256() ) <= 0 ) {
+                ec = last_error();
+                return out;
+            }
+
+            std::unique_ptr< BIO, decltype( &BIO_free ) > bio{ BIO_new( BIO_s_mem() ),
+                                                               &BIO_free };
+
+            auto take = [&bio]() {
+                char* data;
+                auto size = BIO_get_mem_data( bio.get(), &data );
+                std::string pem( data, static_cast< size_t >( size ) );
+                BIO_reset( bio.get() );
+                return pem;
+            };
+
+            PEM_write_bio_X509( bio.get(), cert.get() );
+            out.certificate = take();
+
+            PEM_write_bio_PrivateKey( bio.get(), key.get(), nullptr, nullptr, 0, nullptr,
+                                      nullptr );
+            out.private_key = take();
+
+            return out;
+        }
+
+        static boost::system::error_code last_error() {
+            return { static_cast< int >( ERR_get_error() ),
+                     boost::asio::error::get_ssl_category() };
+        }
+
+      private:
+        static bool add_extension( X509* cert, int nid, const std::string& value ) {
+
+            X509V3_CTX ctx;
+            X509V3_set_ctx_nodb( &ctx );
+            X509V3_set_ctx( &ctx, cert, cert, nullptr, nullptr, 0 );
+
+            auto ext = X509V3_EXT_conf_nid( nullptr, &ctx, nid, value.c_str() );
+
+            if ( ext == nullptr )
+                return false;
+
+            X509_add_ext( cert, ext, -1 );
+            X509_EXTENSION_free( ext );
+            return true;
+        }
+    };
+
+    /**
+     * Client side store of tls sessions, one per host:port. Resuming one skips
+     * the certificate exchange and the key agreement of a full handshake.
+     */
+    class tls_session_cache {
+
+        using session_ptr = std::shared_ptr< SSL_SESSION >;
+
+      public:
+        explicit tls_session_cache( size_t capacity = 256 ) : capacity_( capacity ) {}
+
+        /// keep session for key, takes over the reference
+        void store( const std::string& key, SSL_SESSION* session ) {
+
+            session_ptr ptr{ session, &SSL_SESSION_free };
+
+            std::lock_guard< std::mutex > lock{ mtx_ };
+
+            if ( sessions_.size() >= capacity_ && sessions_.count( key ) == 0 )
+                sessions_.erase( sessions_.begin() );
+
+            sessions_[key] = std::move( ptr );
+        }
+
+        /// offer the session stored for key in the next handshake of ssl
+        bool apply( const std::string& key, SSL* ssl ) {
+
+            session_ptr session;
+
+            {
+                std::lock_guard< std::mutex > lock{ mtx_ };
+
+                auto it = sessions_.find( key );
+
+                if ( it == sessions_.end() )
+                    return false;
+
+                session = it->second;
+            }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+            if ( !SSL_SESSION_is_resumable( session.get() ) )
+                return false;
+#endif
+
+            return SSL_set_session( ssl, session.get() ) == 1;
+        }
+
+        size_t size() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            return sessions_.size();
+        }
+
+        void clear() {
+            std::lock_guard< std::mutex > lock{ mtx_ };
+            sessions_.clear();
+        }
+
+      private:
+        std::mutex mtx_;
+        std::unordered_map< std::string, session_ptr > sessions_;
+        size_t capacity_;
+    };
+
+    /**
+     * An ssl::context set up for websocket sessions: TLS 1.2 and newer, AEAD
+     * ciphers only and session resumption. Clients keep their sessions in
+     * sessions(), servers resume through session tickets. All sessions of a
+     * server have to share one context for their tickets to be accepted.
+     */
+    class tls_context {
+
+      public:
+        enum class role { client, server };
+
+        tls_context( role r, const tls_options& options, boost::system::error_code& ec )
+            : ctx_( r == role::client ? boost::asio::ssl::context::tls_client
+                                      : boost::asio::ssl::context::tls_server )
+            , role_( r )
+            , resumption_( options.resumption ) {
+
+            ctx_.set_options( boost::asio::ssl::context::default_workarounds |
+                              boost::asio::ssl::context::no_sslv2 |
+                              boost::asio::ssl::context::no_sslv3 |
+                              boost::asio::ssl::context::no_tlsv1 |
+                              boost::asio::ssl::context::no_tlsv1_1 );
+
+            auto handle = ctx_.native_handle();
+
+            SSL_CTX_set_ex_data( handle, context_index(), this );
+
+            if ( !set_ciphers( options.ciphers ) ) {
+                ec = tls_certificate::last_error();
+                return;
+            }
+
+            if ( r == role::client ) {
+
+                if ( options.verify_peer ) {
+                    ctx_.set_verify_mode( boost::asio::ssl::verify_peer, ec );
+
+                    if ( !ec )
+                        ctx_.set_default_verify_paths( ec );
+                    if ( !ec && !options.ca_file.empty() )
+                        ctx_.load_verify_file( options.ca_file, ec );
+                    if ( ec )
+                        return;
+                }
+
+                // sessions are looked up by host, the internal cache goes by session id
+                SSL_CTX_set_session_cache_mode(
+                    handle, resumption_ ? SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL
+                                        : SSL_SESS_CACHE_OFF );
+
+                if ( resumption_ )
+                    SSL_CTX_sess_set_new_cb( handle, &tls_context::new_session );
+
+            } else {
+
+                static const unsigned char session_id_context[] = "maxnet";
+                SSL_CTX_set_session_id_context( handle, session_id_context,
+                                                sizeof( session_id_context ) - 1 );
+
+                if ( !resumption_ ) {
+                    SSL_CTX_set_session_cache_mode( handle, SSL_SESS_CACHE_OFF );
+                    SSL_CTX_set_options( handle, SSL_OP_NO_TICKET );
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+                    SSL_CTX_set_num_tickets( handle, 0 );
+#endif
+                }
+
+                if ( !options.certificate_file.empty() ) {
+                    ctx_.use_certificate_chain_file( options.certificate_file, ec );
+
+                    if ( !ec )
+                        ctx_.use_private_key_file( options.private_key_file.empty()
+                                                       ? options.certificate_file
+                                                       : options.private_key_file,
+                                                   boost::asio::ssl::context::pem, ec );
+                }
+            }
+        }
+
+        tls_context( const tls_context& ) = delete;
+        tls_context& operator=( const tls_context& ) = delete;
+
+        /// serve with this certificate
+        boost::system::error_code use_certificate( const tls_certificate& cert ) {
+
+            boost::system::error_code ec;
+
+            ctx_.use_certificate_chain( boost::asio::buffer( cert.certificate ), ec );
+
+            if ( !ec )
+                ctx_.use_private_key( boost::asio::buffer( cert.private_key ),
+                                      boost::asio::ssl::context::pem, ec );
+
+            return ec;
+        }
+
+        /// accept servers that present this certificate
+        boost::system::error_code trust( const tls_certificate& cert ) {
+            boost::system::error_code ec;
+            ctx_.add_certificate_authority( boost::asio::buffer( cert.certificate ), ec );
+            return ec;
+        }
+
+        boost::asio::ssl::context& native() { return ctx_; }
+
+        /// sessions take the context like an ssl::context
+        operator boost::asio::ssl::context&() { return ctx_; }
+
+        tls_session_cache& sessions() { return cache_; }
+
+        role context_role() const { return role_; }
+
+        /**
+         * Set server name and host name verification of a client connection to
+         * host and offer the session kept from the last connection to host:port.
+         */
+        static void prepare_client( SSL* ssl, std::string_view host, std::string_view port ) {
+
+            std::string name( host );
+
+            boost::system::error_code ec;
+            boost::asio::ip::make_address( name, ec );
+            bool literal = !ec;
+
+            // no server name indication for addresses
+            if ( !literal )
+                SSL_set_tlsext_host_name( ssl, name.c_str() );
+
+            if ( SSL_get_verify_mode( ssl ) & SSL_VERIFY_PEER ) {
+                if ( literal )
+                    X509_VERIFY_PARAM_set1_ip_asc( SSL_get0_param( ssl ), name.c_str() );
+                else
+                    SSL_set1_host( ssl, name.c_str() );
+            }
+
+            auto self = from( SSL_get_SSL_CTX( ssl ) );
+
+            if ( self == nullptr || !self->resumption_ )
+                return;
+
+            // owned by ssl, see key_index()
+            auto key = new std::string( name );
+            key->append( ":" ).append( port );
+
+            SSL_set_ex_data( ssl, key_index(), key );
+            self->cache_.apply( *key, ssl );
+        }
+
+      private:
+        bool set_ciphers( tls_ciphers ciphers ) {
+
+            static const char* aes_gcm = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-"
+                                         "SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-"
+                                         "AES256-GCM-SHA384";
+            static const char* chacha20 =
+                "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305";
+
+            std::string list;
+            std::string suites;
+
+            switch ( ciphers ) {
+            case tls_ciphers::aes_gcm:
+                list = aes_gcm;
+                suites = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384";
+                break;
+            case tls_ciphers::chacha20:
+                list = chacha20;
+                suites = "TLS_CHACHA20_POLY1305_SHA256";
+                break;
+            default:
+                list = std::string( aes_gcm ) + ":" + chacha20;
+                suites = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_"
+                         "POLY1305_SHA256";
+            }
+
+            auto handle = ctx_.native_handle();
+
+            if ( SSL_CTX_set_cipher_list( handle, list.c_str() ) != 1 )
+                return false;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+            if ( SSL_CTX_set_ciphersuites( handle, suites.c_str() ) != 1 )
+                return false;
+#endif
+
+            if ( role_ == role::server ) {
+                SSL_CTX_set_options( handle, SSL_OP_CIPHER_SERVER_PREFERENCE );
+#ifdef SSL_OP_PRIORITIZE_CHACHA
+                if ( ciphers == tls_ciphers::automatic )
+                    SSL_CTX_set_options( handle, SSL_OP_PRIORITIZE_CHACHA );
+#endif
+            }
+
+            return true;
+        }
+
+        static tls_context* from( SSL_CTX* ctx ) {
+            return static_cast< tls_context* >( SSL_CTX_get_ex_data( ctx, context_index() ) );
+        }
+
+        // called for every new session, with tls 1.3 after the handshake
+        static int new_session( SSL* ssl, SSL_SESSION* session ) {
+
+            auto self = from( SSL_get_SSL_CTX( ssl ) );
+            auto key = static_cast< std::string* >( SSL_get_ex_data( ssl, key_index() ) );
+
+            if ( self == nullptr || key == nullptr )
+                return 0;
+
+            self->cache_.store( *key, session );
+            return 1;
+        }
+
+        static int context_index() {
+            static int index = SSL_CTX_get_ex_new_index( 0, nullptr, nullptr, nullptr, nullptr );
+            return index;
+        }
+
+        // the cache key of a client connection, freed together with the connection
+        static int key_index() {
+            static int index = SSL_get_ex_new_index(
+                0, nullptr, nullptr, nullptr,
+                []( void*, void* ptr, CRYPTO_EX_DATA*, int, long, void* ) {
+                    delete static_cast< std::string* >( ptr );
+                } );
+            return index;
+        }
+
+        boost::asio::ssl::context ctx_;
+        role role_;
+        bool resumption_;
+        tls_session_cache cache_;
+    };
+
+    template < typename Socket >
+    struct stream_layer< boost::asio::ssl::stream< Socket > > {
+
+        using layer_type = boost::asio::ssl::stream< Socket >;
+
+        static constexpr bool is_tls = true;
+
+        static Socket& socket( layer_type& layer ) { return layer.next_layer(); }
+
+        static void prepare_client( layer_type& layer, std::string_view host,
+                                    std::string_view port ) {
+            tls_context::prepare_client( layer.native_handle(), host, port );
+        }
+
+        template < typename Handler >
+        static void async_handshake( layer_type& layer, bool server, Handler&& handler ) {
+            layer.async_handshake( server ? boost::asio::ssl::stream_base::server
+                                          : boost::asio::ssl::stream_base::client,
+                                   std::forward< Handler >( handler ) );
+        }
+
+        /// true if the last handshake resumed an earlier session
+        static bool resumed( layer_type& layer ) {
+            return SSL_session_reused( layer.native_handle() ) == 1;
+        }
+
+        static const char* cipher( layer_type& layer ) {
+            return SSL_get_cipher_name( layer.native_handle() );
+        }
+    };
+
+#endif
+} // namespace o
@@ -0,0 +1,257 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+
+/**
+ * Lightweight trace points for the message pipeline. Define
+ * MAXNET_ENABLE_TRACING to compile them in; without it the macros below
+ * expand to nothing. Even when compiled in, events are only recorded
+ * while o::trace::set_enabled( true ) is in effect.
+ *
+ *   O_TRACE_SCOPE( "read_handler", msg );  // complete event for this scope
+ *   O_TRACE_INSTANT( "session::write", msg );
+ */
+
+namespace o {
+    namespace trace {
+
+        struct event {
+            const char* name;
+            std::uint64_t begin_ns;
+            std::uint64_t duration_ns;
+            std::uint64_t id;
+            std::uint32_t thread;
+            char phase;
+
+            // index + 1 of the write that completed this slot, 0 if never written
+            std::atomic< std::uint64_t > sequence{ 0 };
+        };
+
+        /**
+         * Fixed size multi-producer ring of trace events. Writers claim a slot
+         * with one fetch_add and publish it through its sequence number, so
+         * recording never blocks. Old events are overwritten once the ring is full.
+         */
+        template < size_t Capacity = ( 1 << 16 ) >
+        class ring {
+            static_assert( ( Capacity & ( Capacity - 1 ) ) == 0,
+                           "capacity must be a power of two" );
+
+          public:
+            static constexpr size_t capacity = Capacity;
+
+            void record( const char* name, char phase, std::uint64_t begin_ns,
+                         std::uint64_t duration_ns, std::uint64_t id,
+                         std::uint32_t thread ) {
+
+                auto index = head_.fetch_add( 1, std::memory_order_relaxed );
+                auto& slot = events_[index & ( Capacity - 1 )];
+
+                // invalidate while writing so readers skip the slot
+                slot.sequence.store( 0, std::memory_order_relaxed );
+                std::atomic_thread_fence( std::memory_order_release );
+
+                slot.name = name;
+                slot.phase = phase;
+                slot.begin_ns = begin_ns;
+                slot.duration_ns = duration_ns;
+                slot.id = id;
+                slot.thread = thread;
+
+                slot.sequence.store( index + 1, std::memory_order_release );
+            }
+
+            /// call fn for every complete event that is still in the ring, oldest first
+            template < typename Function >
+            void for_each( Function&& fn ) const {
+
+                auto head = head_.load( std::memory_order_acquire );
+                auto first = head > Capacity ? head - Capacity : 0;
+
+                for ( auto index = first; index < head; ++index ) {
+
+                    const auto& slot = events_[index & ( Capacity - 1 )];
+
+                    if ( slot.sequence.load( std::memory_order_acquire ) != index + 1 )
+                        continue;
+
+                    event copy_of;
+                    copy_of.name = slot.name;
+                    copy_of.phase = slot.phase;
+                    copy_of.begin_ns = slot.begin_ns;
+                    copy_of.duration_ns = slot.duration_ns;
+                    copy_of.id = slot.id;
+                    copy_of.thread = slot.thread;
+
+                    // the slot was reused while we copied it
+                    std::atomic_thread_fence( std::memory_order_acquire );
+                    if ( slot.sequence.load( std::memory_order_relaxed ) != index + 1 )
+                        continue;
+
+                    fn( static_cast< const event& >( copy_of ) );
+                }
+            }
+
+            /// number of events recorded since the last clear, including overwritten ones
+            std::uint64_t recorded() const { return head_.load( std::memory_order_relaxed ); }
+
+            /// not safe against concurrent writers, disable tracing first
+            void clear() {
+                for ( auto& slot : events_ )
+                    slot.sequence.store( 0, std::memory_order_relaxed );
+                head_.store( 0, std::memory_order_release );
+            }
+
+          private:
+            std::array< event, Capacity > events_;
+            alignas( 64 ) std::atomic< std::uint64_t > head_{ 0 };
+        };
+
+        using default_ring = ring<>;
+
+        inline default_ring& global_ring() {
+            static default_ring instance;
+            return instance;
+        }
+
+        inline std::atomic< bool >& enabled_flag() {
+            static std::atomic< bool > flag{ false };
+            return flag;
+        }
+
+        inline bool enabled() { return enabled_flag().load( std::memory_order_relaxed ); }
+
+        inline void set_enabled( bool enabled ) {
+            enabled_flag().store( enabled, std::memory_order_relaxed );
+        }
+
+        /// nanoseconds since the first call in this process
+        inline std::uint64_t now_ns() {
+            using clock = std::chrono::steady_clock;
+            static const auto epoch = clock::now();
+            return static_cast< std::uint64_t >(
+                std::chrono::duration_cast< std::chrono::nanoseconds >( clock::now() - epoch )
+                    .count() );
+        }
+
+        /// small sequential id for the calling thread, used as tid in the trace
+        inline std::uint32_t thread_index() {
+            static std::atomic< std::uint32_t > next{ 1 };
+            thread_local std::uint32_t index = next.fetch_add( 1 );
+            return index;
+        }
+
+        inline void instant( const char* name, const void* id = nullptr ) {
+            if ( enabled() )
+                global_ring().record( name, 'i', now_ns(), 0,
+                                      reinterpret_cast< std::uintptr_t >( id ),
+                                      thread_index() );
+        }
+
+        /// records a complete event spanning the lifetime of the object
+        class scope {
+          public:
+            explicit scope( const char* name, const void* id = nullptr )
+                : name_( enabled() ? name : nullptr )
+                , id_( reinterpret_cast< std::uintptr_t >( id ) )
+                , begin_( name_ ? now_ns() : 0 ) {}
+
+            ~scope() {
+                if ( name_ )
+                    global_ring().record( name_, 'X', begin_, now_ns() - begin_, id_,
+                                          thread_index() );
+            }
+
+            scope( const scope& ) = delete;
+            scope& operator=( const scope& ) = delete;
+
+          private:
+            const char* name_;
+            std::uint64_t id_;
+            std::uint64_t begin_;
+        };
+
+        /**
+         * Write the ring as Chrome trace event JSON, loadable in chrome://tracing
+         * and ui.perfetto.dev. The message address of every event is stored in
+         * args.msg, so one message can be followed through the pipeline.
+         */
+        template < size_t Capacity >
+        void write_chrome_json( const ring< Capacity >& events, std::ostream& out ) {
+
+            out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+            bool first = true;
+            char line[256];
+
+            events.for_each( [&]( const event& ev ) {
+                char duration[48] = "\"s\":\"t\",";
+
+                if ( ev.phase == 'X' )
+                    std::snprintf( duration, sizeof( duration ), "\"dur\":%.3f,",
+                                   ev.duration_ns / 1e3 );
+
+                int length = std::snprintf(
+                    line, sizeof( line ),
+                    "%s\n{\"name\":\"%s\",\"cat\":\"maxnet\",\"ph\":\"%c\",\"ts\":%.3f,%s"
+                    "\"pid\":1,\"tid\":%u,\"args\":{\"msg\":\"0x%llx\"}}",
+                    first ? "" : ",", ev.name, ev.phase, ev.begin_ns / 1e3, duration, ev.thread,
+                    static_cast< unsigned long long >( ev.id ) );
+
+                if ( length > 0 )
+                    out.write( line, std::min< int >( length, sizeof( line ) - 1 ) );
+
+                first = false;
+            } );
+
+            out << "\n]}\n";
+        }
+
+        inline void write_chrome_json( std::ostream& out ) {
+            write_chrome_json( global_ring(), out );
+        }
+    } // namespace trace
+} // namespace o
+
+#define O_TRACE_CONCAT_IMPL_( a, b ) a##b
+#define O_TRACE_CONCAT_( a, b ) O_TRACE_CONCAT_IMPL_( a, b )
+
+#ifdef MAXNET_ENABLE_TRACING
+#define O_TRACE_SCOPE( name, id )                                                        \
+    o::trace::scope O_TRACE_CONCAT_( o_trace_scope_, __LINE__ ) { name, id }
+#define O_TRACE_INSTANT( name, id ) o::trace::instant( name, id )
+#else
+#define O_TRACE_SCOPE( name, id )
+#define O_TRACE_INSTANT( name, id )
+#endif
@@ -26,36 +26,56 @@
 #ifndef WebSocketUrl_h
 #define WebSocketUrl_h
 
-#include <iostream>
-#include <string>
-#include <boost/tokenizer.hpp>
-#include <boost/asio/ip/address.hpp>
-#include <boost/system/error_code.hpp>
+#include "devices/small_buffer.h"
 #include "ohlano.h"
+
+#include <boost/asio/ip/address.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/container/small_vector.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 struct ws_parser_template {
     static constexpr const char* const url_separator_char = "/";
     static constexpr const char* const url_prefix = "ws:";
+    static constexpr const char* const secure_url_prefix = "wss:";
     static constexpr const char* const std_port = "80";
+    static constexpr const char* const secure_std_port = "443";
 };
 
 struct http_parser_template {
     static constexpr const char* const url_separator_char = "/";
     static constexpr const char* const url_prefix = "http:";
+    static constexpr const char* const secure_url_prefix = "https:";
     static constexpr const char* const std_port = "80";
+    static constexpr const char* const secure_std_port = "443";
 };
 
+/**
+ * [scheme:][//]host[:port][/path][?query][#fragment]
+ *
+ * Parsed in one pass without exceptions. Host, port, path and query are kept
+ * in one inline buffer and the accessors return views into it, so they stay
+ * valid until the url is modified or destroyed. IPv6 literals are written in
+ * brackets, host() returns them without.
+ */
 template < typename ProtocolType = boost::asio::ip::tcp,
            typename UrlTemplate = ws_parser_template >
 class net_url {
 
   public:
-    typedef std::string port_type;
-    typedef std::string hostname_type;
-    typedef std::string path_type;
+    typedef std::string_view port_type;
+    typedef std::string_view hostname_type;
+    typedef std::string_view path_type;
 
-    typedef typename std::vector< typename ProtocolType::endpoint >
+    typedef boost::container::small_vector< typename ProtocolType::endpoint, 2 >
         endpoint_sequence_type;
 
     typedef net_url< boost::asio::ip::tcp, ws_parser_template > websocket_url;
@@ -67,202 +87,279 @@ class net_url {
     typedef typename boost::asio::ip::basic_resolver< ProtocolType >::results_type
         resolver_results_type;
 
-    net_url* operator=( const net_url& other ) {
-        hostname_ = hostname_type( other.hostname_ );
-        port_ = port_type( other.port_ );
-        path_ = path_type( other.path_ );
-        endpoint_seq = endpoint_sequence_type( other.endpoint_seq );
-        return this;
+    net_url() noexcept {}
+
+    net_url( std::string_view url, error_code& ec ) { ec = parse( url ); }
+
+    /// for everything that only converts to std::string, like atoms
+    template < typename T, typename = std::enable_if_t<
+                               std::is_convertible< T, std::string >::value &&
+                               !std::is_convertible< T, std::string_view >::value > >
+    net_url( const T& url, error_code& ec )
+        : net_url( std::string_view( static_cast< std::string >( url ) ), ec ) {}
+
+    net_url( std::string_view host, std::string_view port, std::string_view path ) {
+        assign( host, port, path, {} );
     }
 
-    net_url( const net_url& other )
-        : hostname_( other.hostname_ )
-        , port_( other.port_ )
-        , path_( other.path_ )
-        , endpoint_seq( other.endpoint_seq ) {}
+    net_url( std::string_view host, std::string_view port ) {
+        assign( host, port, {}, {} );
+    }
 
-    net_url() noexcept {}
+    void set_host( hostname_type hostname ) {
+        assign( hostname, view( port_ ), view( path_ ), view( query_ ) );
+    }
 
-    net_url( std::string url, error_code& ec ) {
+    bool set_port( port_type port ) {
+        if ( !is_port( port ) )
+            return false;
+        assign( view( host_ ), port, view( path_ ), view( query_ ) );
+        return true;
+    }
 
-        boost::char_separator< char > sep{ UrlTemplate::url_separator_char };
-        boost::tokenizer< boost::char_separator< char > > tok( url, sep );
+    void set_path( path_type path ) {
+        assign( view( host_ ), view( port_ ), path, view( query_ ) );
+    }
 
-        auto token_it = tok.begin();
+    /// the host without the brackets around IPv6 literals
+    hostname_type host() const {
+        auto h = view( host_ );
+        if ( h.size() > 1 && h.front() == '[' )
+            return h.substr( 1, h.size() - 2 );
+        return h;
+    }
 
-        if ( *token_it == UrlTemplate::url_prefix ) {
-            token_it++;
-        }
+    /// the host as written in the url, for the Host header
+    hostname_type host_header() const { return view( host_ ); }
 
-        // first legit token
-        if ( token_it != tok.end() ) {
+    port_type port() const {
+        if ( has_port() )
+            return view( port_ );
+        return secure_ ? UrlTemplate::secure_std_port : UrlTemplate::std_port;
+    }
 
-            // may be host:port combination
-            auto port_pos = ( *token_it ).find( ":" );
+    unsigned short port_int( bool default_ = true ) const {
+        if ( !has_port() && !default_ )
+            return 0;
+        unsigned short out = 0;
+        for ( char c : port() )
+            out = static_cast< unsigned short >( out * 10 + ( c - '0' ) );
+        return out;
+    }
 
-            // it is
-            if ( port_pos != std::string::npos ) {
+    /// the path, always starting with a separator
+    path_type path() const { return view( path_ ); }
 
-                hostname_ = ( *token_it ).substr( 0, port_pos );
+    /// the query without the question mark, empty if there is none
+    std::string_view query() const {
+        auto q = view( query_ );
+        return q.empty() ? q : q.substr( 1 );
+    }
 
-                port_ = ( *token_it ).substr( port_pos + 1 );
+    /// path and query as sent in the request line
+    std::string_view target() const {
+        return { buffer_.data() + path_.offset, path_.length + query_.length };
+    }
 
-                if ( !is_number( port_ ) ) {
-                    ec = error_code::FAIL;
-                    return;
-                }
+    /// true for wss: (or https:) urls
+    bool secure() const { return secure_; }
 
-                // it is not
-            } else {
-                hostname_ = *token_it;
-            }
-        } else {
-            ec = error_code::FAIL;
-            return;
-        }
+    const endpoint_sequence_type& endpoints() const { return endpoint_seq; }
 
-        if ( ++token_it != tok.end() ) {
+    void set_resolver_results( const resolver_results_type& results ) {
+        endpoint_seq.clear();
+        std::copy( results.begin(), results.end(), std::back_inserter( endpoint_seq ) );
+    }
 
-            std::vector< std::string > address;
+    bool is_resolved() const { return !endpoint_seq.empty(); }
 
-            for ( ; token_it != tok.end(); token_it++ ) {
-                address.push_back( *token_it );
-            }
-            for ( auto token : address ) {
-                path_.append( UrlTemplate::url_separator_char ).append( token );
-            }
+    std::string get_pretty_resolver_results() { return {}; }
 
-        } else {
-            path_ = UrlTemplate::url_separator_char;
-        }
+    void clear() {
+        buffer_.clear();
+        host_ = port_ = path_ = query_ = {};
+        secure_ = false;
+        endpoint_seq.clear();
+    }
 
-        if ( is_ip() ) {
-            endpoint_seq = endpoint_seq_from_string( host(), port_int() );
-        }
+    bool has_port() const { return port_.length > 0; }
 
-        ec = error_code::SUCCESS;
+    bool operator==( const net_url& other ) const {
+        return other.host_header() == host_header() &&
+               other.view( other.port_ ) == view( port_ ) && other.target() == target() &&
+               other.secure_ == secure_;
     }
 
-    net_url( std::string _host, std::string _port, std::string _handshake ) {}
+    bool operator!=( const net_url& other ) const { return !( *this == other ); }
 
-    net_url( std::string _host, std::string _port ) {}
+    bool valid() const { return host_.length > 0; }
 
-    void set_host( const hostname_type& hostname ) {
-        hostname_ = hostname;
-        endpoint_seq = endpoint_seq_from_string( host(), port_int() );
+    operator bool() const { return valid(); }
+
+    static net_url from_string( std::string_view url, error_code& ec ) {
+        return net_url( url, ec );
     }
 
-    bool set_port( const port_type& port ) {
-        if ( is_number( port ) ) {
-            port_ = port;
-            endpoint_seq = endpoint_seq_from_string( host(), port_int() );
-            return true;
-        } else {
+  private:
+    struct span {
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    std::string_view view( span part ) const {
+        return { buffer_.data() + part.offset, part.length };
+    }
+
+    static bool starts_with( std::string_view str, std::string_view prefix ) {
+        return str.size() >= prefix.size() && str.compare( 0, prefix.size(), prefix ) == 0;
+    }
+
+    static bool is_port( std::string_view port ) {
+        if ( port.empty() || port.size() > 5 )
             return false;
+        unsigned value = 0;
+        for ( char c : port ) {
+            if ( c < '0' || c > '9' )
+                return false;
+            value = value * 10 + static_cast< unsigned >( c - '0' );
         }
+        return value > 0 && value <= 65535;
     }
 
-    void set_path( path_type path ) { path_ = path; }
+    error_code parse( std::string_view url ) {
 
-    void set_host( hostname_type hostname ) {
-        hostname_ = hostname;
-        endpoint_seq = endpoint_seq_from_string( host(), port_int() );
-    }
+        clear();
 
-    void set_path( const path_type& path ) { path_ = path; }
+        if ( starts_with( url, UrlTemplate::secure_url_prefix ) ) {
+            secure_ = true;
+            url.remove_prefix(
+                std::char_traits< char >::length( UrlTemplate::secure_url_prefix ) );
+        } else if ( starts_with( url, UrlTemplate::url_prefix ) ) {
+            url.remove_prefix( std::char_traits< char >::length( UrlTemplate::url_prefix ) );
+        }
 
-    hostname_type host() { return hostname_; }
+        while ( !url.empty() && url.front() == '/' )
+            url.remove_prefix( 1 );
 
-    port_type port() {
+        auto authority_end = url.find_first_of( "/?#" );
+        auto authority = url.substr( 0, authority_end );
+        auto rest = authority_end == std::string_view::npos ? std::string_view{}
+                                                            : url.substr( authority_end );
 
-        if ( has_port() ) {
-            return port_;
-        } else {
-            return { UrlTemplate::std_port };
-        }
-    }
+        // user info is not supported and skipped
+        auto at = authority.rfind( '@' );
+        if ( at != std::string_view::npos )
+            authority.remove_prefix( at + 1 );
 
-    short port_int( bool default_ = true ) {
-        if ( has_port() ) {
-            return std::stoi( port() );
+        std::string_view host, port;
+
+        if ( !authority.empty() && authority.front() == '[' ) {
+
+            auto close = authority.find( ']' );
+
+            if ( close == std::string_view::npos )
+                return error_code::FAIL;
+
+            host = authority.substr( 0, close + 1 );
+            auto after = authority.substr( close + 1 );
+
+            if ( !after.empty() ) {
+                if ( after.front() != ':' )
+                    return error_code::FAIL;
+                port = after.substr( 1 );
+            }
         } else {
-            if ( default_ ) {
-                return std::stoi( UrlTemplate::std_port );
+
+            auto colon = authority.find( ':' );
+
+            // more than one colon is an IPv6 literal without brackets and port
+            if ( colon != std::string_view::npos &&
+                 authority.find( ':', colon + 1 ) == std::string_view::npos ) {
+                host = authority.substr( 0, colon );
+                port = authority.substr( colon + 1 );
+                if ( port.empty() )
+                    return error_code::FAIL;
             } else {
-                return 0;
+                host = authority;
             }
         }
-    }
 
-    endpoint_sequence_type endpoints() { return endpoint_seq; }
+        if ( host.empty() || host == "[]" || ( !port.empty() && !is_port( port ) ) )
+            return error_code::FAIL;
 
-    void set_resolver_results( const resolver_results_type& results ) {
-        endpoint_seq.clear();
-        std::copy( results.begin(), results.end(), std::back_inserter( endpoint_seq ) );
-        endpoint_seq.shrink_to_fit();
+        auto fragment = rest.find( '#' );
+        if ( fragment != std::string_view::npos )
+            rest = rest.substr( 0, fragment );
+
+        auto question = rest.find( '?' );
+        auto path = rest.substr( 0, question );
+        auto query = question == std::string_view::npos ? std::string_view{}
+                                                        : rest.substr( question );
+
+        assign( host, port, path, query );
+
+        return error_code::SUCCESS;
     }
 
-    bool is_resolved() { return !endpoint_seq.empty(); }
+    /// lay out host, port, path and query in the buffer, the parts may point into it
+    void assign( std::string_view host, std::string_view port, std::string_view path,
+                 std::string_view query ) {
 
-    std::string get_pretty_resolver_results() { return {}; }
+        if ( path.empty() )
+            path = UrlTemplate::url_separator_char;
 
-    std::string path() { return path_; }
+        bool separator = path.front() != '/';
+        size_t size = host.size() + port.size() + separator + path.size() + query.size();
 
-    void clear() {
-        port_.clear();
-        hostname_.clear();
-        path_.clear();
-        endpoint_seq.clear();
-    }
+        o::small_buffer< 96 > next;
+        next.resize( size );
+        char* out = next.data();
 
-    bool has_port() const {
-        if ( is_number( port_ ) ) {
-            return port_.size() > 0 && std::stoi( port_ ) <= 65535;
-        } else
-            return false;
-    }
+        host_ = { 0, host.size() };
+        out = std::copy( host.begin(), host.end(), out );
+        port_ = { host_.length, port.size() };
+        out = std::copy( port.begin(), port.end(), out );
+        path_ = { port_.offset + port_.length, path.size() + separator };
+        if ( separator )
+            *out++ = '/';
+        out = std::copy( path.begin(), path.end(), out );
+        query_ = { path_.offset + path_.length, query.size() };
+        std::copy( query.begin(), query.end(), out );
+
+        buffer_ = next;
 
-    bool operator==( const net_url& other ) {
-        return other.hostname_ == hostname_ && other.port_ == port_ &&
-               other.path_ == path_;
+        resolve_literal();
     }
 
-    bool operator!=( const net_url& other ) { return !( *this == other ); }
+    // ip literals need no resolver, everything else waits for set_resolver_results
+    void resolve_literal() {
 
-    bool valid() const {
-        return !hostname_.empty() && ( port_.empty() || is_number( port_ ) );
-    }
+        endpoint_seq.clear();
 
-    operator bool() const { return valid(); }
+        auto h = host();
+        char literal[64];
 
-    static net_url from_string( std::string url, error_code& ec ) {
-        return url_t( url, ec );
-    }
+        if ( h.empty() || h.size() >= sizeof( literal ) )
+            return;
 
-  private:
-    bool is_number( const std::string& s ) const {
-        return !s.empty() && std::find_if( s.begin(), s.end(), []( char c ) {
-                                 return !std::isdigit( c );
-                             } ) == s.end();
-    }
+        std::copy( h.begin(), h.end(), literal );
+        literal[h.size()] = '\0';
 
-    bool is_ip() {
-        try {
-            boost::asio::ip::make_address_v4( host() );
-            return true;
-        } catch ( ... ) {
-            return false;
-        }
-    }
+        boost::system::error_code ec;
+        auto address = boost::asio::ip::make_address( literal, ec );
 
-    endpoint_sequence_type endpoint_seq_from_string( std::string str, short port ) {
-        return { typename ProtocolType::endpoint(
-            boost::asio::ip::address::from_string( str ), port ) };
+        if ( !ec )
+            endpoint_seq.emplace_back( address, port_int() );
     }
 
-    hostname_type hostname_;
-    port_type port_;
-    path_type path_;
+    o::small_buffer< 96 > buffer_;
+
+    span host_;
+    span port_;
+    span path_;
+    span query_;
+
+    bool secure_ = false;
 
     endpoint_sequence_type endpoint_seq;
 };
@@ -26,8 +26,6 @@
 #ifndef ohlano_h
 #define ohlano_h
 
-#define DEBUG
-
 #define D( s ) std::cout << std::string( s )
 #define el() std::cout << std::endl
 #define S( n ) std::to_string( n )
@@ -71,6 +69,8 @@
 
 #define OHLANO_NODEFAULT( class ) class() = delete;
 
+#include "devices/async_log.h"
+
 #include <iostream>
 #include <sstream>
 #include <utility>
@@ -78,78 +78,28 @@
 namespace o {
 
     using void_t = void;
+} // namespace o
 
-#ifdef _MSC_VER
-
-    template < typename T >
-    void log( T thing ) {
-
-        std::stringstream sstream;
-
-        sstream << std::forward< T >( thing ) << std::endl;
-
-        OutputDebugStringA( sstream.str().c_str() );
-    }
-
-    template < typename C, typename... T >
-    void log( C&& current, T&&... rest ) {
-
-        std::stringstream sstream;
-        sstream << std::forward< C >( current );
-        OutputDebugStringA( sstream.str().c_str() );
-
-        log( std::forward< T >( rest )... );
-    }
-#else
-    template < typename T >
-    void log( T thing ) {
-        std::cout << std::forward< T >( thing ) << std::endl;
-    }
+#define DBG( ... ) O_LOG_DEBUG( __VA_ARGS__ )
 
-    template < typename C, typename... T >
-    void log( C&& current, T&&... rest ) {
-        std::cout << std::forward< C >( current );
-        log( std::forward< T >( rest )... );
-    }
-#endif
-} // namespace o
+#define LOG( ... ) O_LOG_DEBUG( __FILE__, " ", __LINE__, ": ", __VA_ARGS__ )
 
 #ifdef _MSC_VER
 #ifdef _DEBUG
-#define DBG( ... ) o::log( __VA_ARGS__ );
 #define CONFIG_TAG d
 #else
-#define DBG( ... ) ;
 #define CONFIG_TAG r
 #endif
 
 #define OS_TAG win
-
-#ifdef _DEBUG
-#define LOG( ... )                                                                       \
-    std::cout << __FILE__ << " " << __LINE__ << ": ";                                    \
-    ohlano::log( __VA_ARGS__ );
-#else
-#define LOG( ... ) ;
-#endif
 #else
 #ifndef NDEBUG
-#define DBG( ... ) o::log( __VA_ARGS__ );
 #define CONFIG_TAG d
 #else
-#define DBG( ... ) ;
 #define CONFIG_TAG r
 #endif
 
 #define OS_TAG osx
-
-#ifndef NDEBUG
-#define LOG( ... )                                                                       \
-    std::cout << __FILE__ << " " << __LINE__ << ": ";                                    \
-    o::log( __VA_ARGS__ );
-#else
-#define LOG( ... ) ;
-#endif
 #endif
 
 #define DISABLE_DBG _Pragma( "push_macro(\"DBG\")" )
@@ -25,9 +25,18 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <functional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #define min_wrap_member( x )                                                        \
     o::make_func< c74::min::atoms( const c74::min::atoms&, int ) >(                 \
@@ -39,88 +48,314 @@ namespace o {
 
     static console_stream_adapter_endl_marker endl;
 
+    /**
+     * Bounded queue of finished console lines. Any thread can push, one thread
+     * (usually the Max main thread) drains it. Lines are copied into fixed
+     * slots that carry a sequence number, so neither side takes a lock or
+     * allocates. Lines that do not fit are dropped and counted.
+     */
+    template < size_t Lines = 128, size_t LineCapacity = 256 >
+    class console_line_queue {
+        static_assert( ( Lines & ( Lines - 1 ) ) == 0, "number of lines must be a power of two" );
+
+        struct slot {
+            std::atomic< std::uint64_t > sequence;
+            size_t size;
+            std::array< char, LineCapacity > data;
+        };
+
+      public:
+        static constexpr size_t line_capacity = LineCapacity;
+
+        console_line_queue() {
+            for ( size_t i = 0; i < Lines; ++i )
+                slots_[i].sequence.store( i, std::memory_order_relaxed );
+        }
+
+        console_line_queue( const console_line_queue& ) = delete;
+        console_line_queue& operator=( const console_line_queue& ) = delete;
+
+        bool push( std::string_view line ) {
+
+            auto pos = tail_.load( std::memory_order_relaxed );
+            slot* target;
+
+            for ( ;; ) {
+                target = &slots_[pos & ( Lines - 1 )];
+                auto seq = target->sequence.load( std::memory_order_acquire );
+                auto diff = static_cast< std::int64_t >( seq - pos );
+
+                if ( diff == 0 ) {
+                    if ( tail_.compare_exchange_weak( pos, pos + 1,
+                                                      std::memory_order_relaxed ) )
+                        break;
+                } else if ( diff < 0 ) {
+                    dropped_.fetch_add( 1, std::memory_order_relaxed );
+                    return false;
+                } else {
+                    pos = tail_.load( std::memory_order_relaxed );
+                }
+            }
+
+            target->size = std::min( line.size(), LineCapacity );
+            std::memcpy( target->data.data(), line.data(), target->size );
+            target->sequence.store( pos + 1, std::memory_order_release );
+
+            return true;
+        }
+
+        /// call handler with every queued line, only from one thread at a time
+        template < typename Handler >
+        size_t drain( Handler&& handler ) {
+
+            size_t count = 0;
+
+            for ( ;; ) {
+                auto& next = slots_[head_ & ( Lines - 1 )];
+
+                if ( next.sequence.load( std::memory_order_acquire ) != head_ + 1 )
+                    break;
+
+                handler( std::string_view( next.data.data(), next.size ) );
+
+                next.sequence.store( head_ + Lines, std::memory_order_release );
+                ++head_;
+                ++count;
+            }
+
+            return count;
+        }
+
+        /// lines lost because the queue was full
+        std::uint64_t dropped() const { return dropped_.load( std::memory_order_relaxed ); }
+
+      private:
+        std::array< slot, Lines > slots_;
+        alignas( 64 ) std::atomic< std::uint64_t > tail_{ 0 };
+        alignas( 64 ) std::atomic< std::uint64_t > dropped_{ 0 };
+        alignas( 64 ) std::uint64_t head_ = 0;
+    };
+
+    using default_console_line_queue = console_line_queue<>;
+
+    namespace detail {
+
+        /// the line an adapter is building on the calling thread
+        struct console_line {
+            std::uint64_t owner = 0;
+            size_t size = 0;
+            bool truncated = false;
+            std::array< char, 256 > data;
+
+            void append( std::string_view str ) {
+                auto room = data.size() - size;
+                if ( str.size() > room ) {
+                    str = str.substr( 0, room );
+                    truncated = true;
+                }
+                std::memcpy( data.data() + size, str.data(), str.size() );
+                size += str.size();
+            }
+
+            template < typename T >
+            void append_number( T value ) {
+                auto result = std::to_chars( data.data() + size, data.data() + data.size(),
+                                             value );
+                if ( result.ec == std::errc() )
+                    size = static_cast< size_t >( result.ptr - data.data() );
+                else
+                    truncated = true;
+            }
+
+            // same output as a default formatted ostream, %g with 6 digits
+            void append_number( double value ) {
+#if defined( __cpp_lib_to_chars ) && __cpp_lib_to_chars >= 201611L
+                auto result =
+                    std::to_chars( data.data() + size, data.data() + data.size(), value,
+                                   std::chars_format::general, 6 );
+                if ( result.ec == std::errc() )
+                    size = static_cast< size_t >( result.ptr - data.data() );
+                else
+                    truncated = true;
+#else
+                char buf[32];
+                int length = std::snprintf( buf, sizeof( buf ), "%g", value );
+                if ( length > 0 )
+                    append( std::string_view( buf, static_cast< size_t >( length ) ) );
+#endif
+            }
+
+            // the end of a cut off line shows "..."
+            void mark_truncated() {
+                if ( size + 3 > data.size() )
+                    size = data.size() - 3;
+                std::memcpy( data.data() + size, "...", 3 );
+                size += 3;
+            }
+
+            void clear() {
+                size = 0;
+                truncated = false;
+            }
+
+            std::string_view view() const { return { data.data(), size }; }
+        };
+
+        /**
+         * Every thread keeps a few lines in flight, one per adapter that is
+         * writing on it. If more adapters write interleaved on one thread, the
+         * oldest unfinished line is given up.
+         */
+        inline console_line& console_line_for( std::uint64_t owner ) {
+
+            thread_local std::array< console_line, 4 > lines;
+            thread_local size_t evict = 0;
+
+            for ( auto& line : lines )
+                if ( line.owner == owner )
+                    return line;
+
+            for ( auto& line : lines ) {
+                if ( line.size == 0 ) {
+                    line.owner = owner;
+                    return line;
+                }
+            }
+
+            auto& line = lines[evict++ % lines.size()];
+            line.owner = owner;
+            line.clear();
+            return line;
+        }
+
+        inline std::uint64_t next_console_adapter_id() {
+            static std::atomic< std::uint64_t > next{ 1 };
+            return next.fetch_add( 1, std::memory_order_relaxed );
+        }
+    } // namespace detail
+
+    /**
+     * Formats console output into a fixed size line of the calling thread, so
+     * it can be used from io threads without allocating or locking. Finished
+     * lines go either to a handler on the calling thread or into a
+     * console_line_queue that the Max main thread drains; notify is called
+     * after every queued line to schedule that.
+     */
     class console_stream_adapter {
       public:
         console_stream_adapter() = delete;
 
-        typedef std::function< void( std::string ) > handler_function_type;
+        typedef std::function< void( std::string_view ) > handler_function_type;
+        typedef std::function< void() > notify_function_type;
 
         console_stream_adapter( handler_function_type handler,
                                 bool _space_separated = false,
-                                std::string _separator_char = std::string( "" ) ) {
-            separator_char = _separator_char;
-            space_separator = _space_separated;
-            string_handler = handler;
-        }
+                                std::string _separator_char = std::string( "" ) )
+            : string_handler( std::move( handler ) )
+            , separator( make_separator( _space_separated, _separator_char ) ) {}
 
-        console_stream_adapter( const console_stream_adapter& other ) {
-            string_handler = other.string_handler;
-            separator_char = other.separator_char;
-            space_separator = other.space_separator;
-        }
+        console_stream_adapter( default_console_line_queue& queue, notify_function_type notify,
+                                bool _space_separated = false,
+                                std::string _separator_char = std::string( "" ) )
+            : line_queue( &queue )
+            , queue_notify( std::move( notify ) )
+            , separator( make_separator( _space_separated, _separator_char ) ) {}
+
+        console_stream_adapter( const console_stream_adapter& other )
+            : string_handler( other.string_handler )
+            , line_queue( other.line_queue )
+            , queue_notify( other.queue_notify )
+            , separator( other.separator ) {}
 
         console_stream_adapter* operator=( const console_stream_adapter& other ) {
             string_handler = other.string_handler;
-            separator_char = other.separator_char;
-            space_separator = other.space_separator;
+            line_queue = other.line_queue;
+            queue_notify = other.queue_notify;
+            separator = other.separator;
             return this;
         }
 
-        bool has_sep_char() { return separator_char.size() > 0; }
-
-        bool space_separated() { return space_separator; }
-
         template < typename T >
         console_stream_adapter& operator<<( T&& input ) {
 
-            sstr << std::forward< T >( input );
+            auto& line = detail::console_line_for( id );
 
-            if ( space_separated() )
-                sstr << " ";
+            if ( line.size > 0 )
+                line.append( separator );
 
-            if ( has_sep_char() ) {
-                sstr << separator_char;
-                if ( space_separated() )
-                    sstr << " ";
-            }
+            append( line, std::forward< T >( input ) );
 
             return *this;
         }
 
         console_stream_adapter& operator<<( console_stream_adapter_endl_marker x ) {
 
-            std::string out = sstr.str();
+            auto& line = detail::console_line_for( id );
 
-            if ( space_separated() ) {
-                out.pop_back();
-            }
-            if ( has_sep_char() ) {
-                out.pop_back();
-            }
+            if ( line.truncated )
+                line.mark_truncated();
 
-            string_handler( out );
+            if ( line_queue ) {
+                if ( line_queue->push( line.view() ) && queue_notify )
+                    queue_notify();
+            } else if ( string_handler ) {
+                string_handler( line.view() );
+            }
 
-            sstr.str( std::string() );
+            line.clear();
             return *this;
         }
 
         template < typename T >
         void operator()( T&& thing_to_post ) {
-            *this << thing_to_post << endl;
+            *this << std::forward< T >( thing_to_post ) << endl;
         }
 
         template < typename C, typename... T >
         void operator()( C&& current, T&&... rest ) {
             *this << std::forward< C >( current );
-            ( *this )( rest... );
+            ( *this )( std::forward< T >( rest )... );
         }
 
       private:
+        static std::string make_separator( bool space, const std::string& sep ) {
+            if ( sep.empty() )
+                return space ? " " : "";
+            return space ? " " + sep + " " : sep;
+        }
+
+        template < typename T >
+        static void append( detail::console_line& line, const T& input ) {
+
+            using type = std::decay_t< T >;
+
+            if constexpr ( std::is_same_v< type, bool > ) {
+                line.append( input ? "1" : "0" );
+            } else if constexpr ( std::is_same_v< type, char > ||
+                                  std::is_same_v< type, signed char > ||
+                                  std::is_same_v< type, unsigned char > ) {
+                char c = static_cast< char >( input );
+                line.append( std::string_view( &c, 1 ) );
+            } else if constexpr ( std::is_integral_v< type > ) {
+                line.append_number( input );
+            } else if constexpr ( std::is_floating_point_v< type > ) {
+                line.append_number( static_cast< double >( input ) );
+            } else if constexpr ( std::is_convertible_v< const T&, std::string_view > ) {
+                line.append( std::string_view( input ) );
+            } else {
+                // everything else goes through its stream operator, this allocates
+                std::ostringstream stream;
+                stream << input;
+                line.append( stream.str() );
+            }
+        }
+
         handler_function_type string_handler;
+        default_console_line_queue* line_queue = nullptr;
+        notify_function_type queue_notify;
 
-        std::stringstream sstr;
-        std::string separator_char;
-        bool space_separator;
+        std::string separator;
+        std::uint64_t id = detail::next_console_adapter_id();
     };
 
     // static console_stream_adapter::endl_type endl =
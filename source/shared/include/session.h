@@ -25,19 +25,35 @@
 
 #pragma once
 
+#include "codecs/codec.h"
+#include "devices/latency_probe.h"
+#include "devices/pooled_flat_buffer.h"
+#include "devices/socket_options.h"
 #include "devices/stats.h"
+#include "devices/stats_registry.h"
+#include "devices/stream_tuning.h"
+#include "devices/tls.h"
+#include "devices/trace.h"
 #include "net_url.h"
 #include "ohlano.h"
 
 #include <atomic>
 #include <boost/asio.hpp>
 
+#include <boost/beast/http.hpp>
+#include <boost/version.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/system/error_code.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <deque>
 #include <functional>
+#include <vector>
 
 #include <boost/function_types/property_tags.hpp>
 #include <boost/mpl/vector.hpp>
@@ -48,6 +64,38 @@
 
 namespace o {
 
+    template < typename T, typename = void >
+    struct has_release_frame : std::false_type {};
+
+    template < typename T >
+    struct has_release_frame<
+        T, std::void_t< decltype( std::declval< const T& >().release_frame() ) > >
+        : std::true_type {};
+
+    template < typename T, typename = void >
+    struct has_text_mode : std::false_type {};
+
+    template < typename T >
+    struct has_text_mode< T,
+                          std::void_t< decltype( std::declval< const T& >().is_text() ) > >
+        : std::true_type {};
+
+    template < typename T, typename = void >
+    struct has_codec_support : std::false_type {};
+
+    template < typename T >
+    struct has_codec_support<
+        T, std::void_t< decltype( std::declval< T& >().set_codec( o::codec{} ) ) > >
+        : std::true_type {};
+
+    template < typename T, typename = void >
+    struct has_send_time : std::false_type {};
+
+    template < typename T >
+    struct has_send_time<
+        T, std::void_t< decltype( std::declval< T& >().set_send_time( std::int64_t{} ) ) > >
+        : std::true_type {};
+
     struct status_codes_base {
         enum class status_codes { OFFLINE, ONLINE, BLOCKED, ABORTED, SUSPENDED };
     };
@@ -75,7 +123,8 @@ namespace o {
 
     template < typename Stream, typename Message,
                typename Role = sessions::roles::client >
-    class session : public std::enable_shared_from_this< session< Stream, Message > >,
+    class session
+        : public std::enable_shared_from_this< session< Stream, Message, Role > >,
                     public session_threaded_base< ccy::safe > {
       public:
         typedef std::function< void( boost::system::error_code ) >
@@ -84,8 +133,16 @@ namespace o {
         typedef std::function< void( boost::system::error_code, Message*, size_t ) >
             read_completion_handler_t;
 
+        using http_request_t = boost::beast::http::request< boost::beast::http::string_body >;
+        using http_response_t =
+            boost::beast::http::response< boost::beast::http::string_body >;
+        typedef std::function< void( const http_request_t&, http_response_t& ) >
+            http_request_handler_t;
+
         using status_t = status_codes;
 
+        using layer_traits = stream_layer< typename Stream::next_layer_type >;
+
         /**
          * return a string representation of the current status
          * @return the string
@@ -107,21 +164,72 @@ namespace o {
 
         template < typename M = Message >
         typename o::messages::enable_if_direction_supported< M >::type
-        optional_set_direction( bool direction, Message* msg ) {
+        optional_set_direction( bool, Message* msg ) {
             msg->set_direction( false );
         };
 
         template < typename M = Message >
         typename std::enable_if<
             !o::messages::is_direction_supported< M >::value >::type
-        optional_set_direction( bool direction, Message* msg ){};
+        optional_set_direction( bool, Message* ){};
+
+        template < typename M = Message >
+        typename std::enable_if< has_release_frame< M >::value >::type
+        optional_release_frame( const Message* msg ) {
+            msg->release_frame();
+        }
+
+        template < typename M = Message >
+        typename std::enable_if< !has_release_frame< M >::value >::type
+        optional_release_frame( const Message* ) {}
+
+        template < typename M = Message >
+        typename std::enable_if< has_text_mode< M >::value >::type
+        optional_set_text_mode( const Message* msg ) {
+            stream_.text( msg->is_text() );
+        }
+
+        template < typename M = Message >
+        typename std::enable_if< !has_text_mode< M >::value >::type
+        optional_set_text_mode( const Message* ) {}
+
+        template < typename M = Message >
+        typename std::enable_if< has_codec_support< M >::value >::type
+        optional_set_codec( Message* msg ) {
+            msg->set_codec( codec_ );
+        }
+
+        template < typename M = Message >
+        typename std::enable_if< !has_codec_support< M >::value >::type
+        optional_set_codec( Message* ) {}
+
+        // written messages belong to the session until on_write_done
+        template < typename M = Message >
+        typename std::enable_if< has_codec_support< M >::value >::type
+        optional_stamp_codec( const Message* msg ) {
+            const_cast< Message* >( msg )->set_codec( codec_ );
+        }
+
+        template < typename M = Message >
+        typename std::enable_if< !has_codec_support< M >::value >::type
+        optional_stamp_codec( const Message* ) {}
+
+        template < typename M = Message >
+        typename std::enable_if< has_send_time< M >::value >::type
+        optional_set_send_time( Message* msg, std::int64_t time ) {
+            msg->set_send_time( time );
+        }
+
+        template < typename M = Message >
+        typename std::enable_if< !has_send_time< M >::value >::type
+        optional_set_send_time( Message*, std::int64_t ) {}
 
         /// constructor for client role
         template < typename R = Role >
         explicit session( boost::asio::io_context& ctx,
                           typename Message::factory& allocator, std::atomic< int >* refc,
                           typename sessions::enable_for_client< R, std::nullptr_t >::type
-                              dummyarg = nullptr )
+                              = nullptr )
             : ctx_( ctx )
             , read_strand_( ctx )
             , stream_( ctx_ )
@@ -132,13 +240,29 @@ namespace o {
             ( *msg_pool_refc )++;
         }
 
+        /// constructor for client role on a tls stream, see tls_context
+        template < typename TlsContext, typename R = Role >
+        explicit session( boost::asio::io_context& ctx, TlsContext& tls,
+                          typename Message::factory& allocator, std::atomic< int >* refc,
+                          typename sessions::enable_for_client< R, std::nullptr_t >::type
+                              = nullptr )
+            : ctx_( ctx )
+            , read_strand_( ctx )
+            , stream_( ctx_, tls )
+            , allocator_( allocator )
+            , stats_( ctx )
+            , msg_pool_refc( refc ) {
+            status_set( status_t::BLOCKED );
+            ( *msg_pool_refc )++;
+        }
+
         /// constructor for server role
         template < typename R = Role >
         explicit session( typename Stream::next_layer_type&& next_layer,
                           boost::asio::io_context& ctx,
                           typename Message::factory& allocator, std::atomic< int >* refc,
                           typename sessions::enable_for_server< R, std::nullptr_t >::type
-                              dummyarg = nullptr )
+                              = nullptr )
             : ctx_( ctx )
             , read_strand_( ctx )
             , stream_( std::forward< typename Stream::next_layer_type >( next_layer ) )
@@ -149,6 +273,23 @@ namespace o {
             ( *msg_pool_refc )++;
         }
 
+        /// constructor for server role on a tls stream, takes the accepted socket
+        template < typename TlsContext, typename R = Role >
+        explicit session( boost::asio::ip::tcp::socket&& socket, TlsContext& tls,
+                          boost::asio::io_context& ctx,
+                          typename Message::factory& allocator, std::atomic< int >* refc,
+                          typename sessions::enable_for_server< R, std::nullptr_t >::type
+                              = nullptr )
+            : ctx_( ctx )
+            , read_strand_( ctx )
+            , stream_( std::move( socket ), tls )
+            , allocator_( allocator )
+            , stats_( ctx )
+            , msg_pool_refc( refc ) {
+            status_set( status_t::BLOCKED );
+            ( *msg_pool_refc )++;
+        }
+
         ~session() {
 
             DBG( "session destructor" );
@@ -160,7 +301,7 @@ namespace o {
                 }
             } else {
                 while ( msg_queue.size() > 0 ) {
-                    on_write_done_.value()( msg_queue.front() );
+                    allocator_.deallocate( msg_queue.front() );
                     msg_queue.pop_front();
                 }
             }
@@ -188,15 +329,165 @@ namespace o {
             on_write_done_ = boost::make_optional( handler );
         }
 
+        /**
+         * Answer plain http requests that arrive instead of a websocket upgrade
+         * (server only). The response starts out as 404, the handler fills it in.
+         * The connection is closed after the response was written and on_close
+         * is called instead of on_ready. Must be set before accept().
+         */
+        void on_http_request( http_request_handler_t handler ) {
+            on_http_request_ = boost::make_optional( handler );
+        }
+
+        /**
+         * Socket options for the connection. Applied once a client is connected,
+         * or right away if the socket already is. Server sessions start out with
+         * the options of their listener.
+         */
+        void set_socket_options( const socket_options& options ) {
+
+            {
+                std::lock_guard< std::mutex > lock{ socket_options_mutex_ };
+                socket_options_ = options;
+            }
+
+            quick_ack_ = options.quick_ack;
+
+            if ( tcp_socket().is_open() ) {
+                auto self = this->shared_from_this();
+                boost::asio::dispatch( read_strand_,
+                                       [self]() { self->apply_socket_options(); } );
+            }
+        }
+
+        /**
+         * Framing and buffer sizes of the websocket stream. The read buffer type
+         * can only be chosen before connect() / accept(), later changes of it are
+         * ignored. The rest also applies to a running session. Returns false if
+         * the read buffer type could not be changed anymore.
+         */
+        bool set_stream_tuning( const stream_tuning& tuning ) {
+
+            bool accepted = !started_ || tuning.read_buffer == requested_read_buffer_type_;
+
+            if ( !started_ )
+                requested_read_buffer_type_ = tuning.read_buffer;
+
+            auto self = this->shared_from_this();
+            boost::asio::dispatch( read_strand_,
+                                   [self, tuning]() { tuning.apply( self->stream_ ); } );
+
+            return accepted;
+        }
+
+        /**
+         * Name under which the traffic of this session is counted in the global
+         * stats registry. Defaults to host:port of the peer.
+         */
+        void set_stats_name( std::string name ) { stats_name_ = std::move( name ); }
+
+        /**
+         * Send a websocket ping every interval while the session is online and
+         * close the connection once max_missed pings in a row went unanswered.
+         * Round trip times of the pongs go into stats(). A zero interval turns
+         * keepalive off.
+         */
+        void set_keepalive( std::chrono::milliseconds interval, unsigned max_missed = 3 ) {
+
+            auto self = this->shared_from_this();
+
+            boost::asio::dispatch( read_strand_, [self, interval, max_missed]() {
+                self->keepalive_interval_ = interval;
+                self->keepalive_max_missed_ = std::max( max_missed, 1u );
+
+                if ( self->status() == status_t::ONLINE )
+                    self->start_keepalive();
+            } );
+        }
+
+        /**
+         * Send a latency probe every interval while the session is online, see
+         * latency_probe. The clock offset to the peer and the one-way latency
+         * and jitter of both directions go into stats(). A zero interval turns
+         * probing off. Probes of the peer are always answered.
+         */
+        void set_latency_probes( std::chrono::milliseconds interval ) {
+
+            auto self = this->shared_from_this();
+
+            boost::asio::dispatch( read_strand_, [self, interval]() {
+                self->probe_interval_ = interval;
+
+                if ( self->status() == status_t::ONLINE )
+                    self->start_probes();
+            } );
+        }
+
+        /**
+         * Put the send time in front of every message in both directions if the
+         * peer asks for it too, which is agreed on during the handshake. Must be
+         * set before connect() / accept(). The delay of every received message
+         * goes into stats().inbound().delays() and, for message types with
+         * set_send_time(), into the message. Delays are only meaningful with
+         * latency probes running on the receiving side or synchronised clocks.
+         */
+        void set_send_stamps( bool enabled ) { send_stamps_requested_ = enabled; }
+
+        /// true if both peers agreed on send stamps during the handshake
+        bool send_stamps() const { return send_stamps_.load(); }
+
+        /**
+         * Return the pooled read buffer of this session if no message arrived
+         * for the given time. Meant to be called periodically by servers with
+         * many sessions.
+         */
+        void trim_read_buffer( std::chrono::steady_clock::duration idle ) {
+
+            auto self = this->shared_from_this();
+
+            boost::asio::dispatch( read_strand_, [self, idle]() {
+                if ( self->pooled_buffer_.release_if_idle( idle ) )
+                    self->read_buffer_bytes_ = 0;
+            } );
+        }
+
+        /// memory held by the read buffer after the last message
+        size_t read_buffer_bytes() const { return read_buffer_bytes_.load(); }
+
+        /// number of messages waiting to be written, including the one in flight
+        size_t queue_depth() {
+            std::lock_guard< std::mutex > lock{ write_queue_mutex_ };
+            return msg_queue.size();
+        }
+
+        /**
+         * Offer (client) or accept (server) these codecs through the
+         * Sec-WebSocket-Protocol header, in order of preference. Must be set
+         * before connect() / accept(). Without codecs no subprotocol is
+         * negotiated and the session uses the default codec.
+         */
+        void set_codecs( std::vector< o::codec > codecs ) { codecs_ = std::move( codecs ); }
+
+        /**
+         * The codec that was negotiated during the handshake. write() stamps it
+         * onto messages that carry a codec, which have to be encoded with it.
+         */
+        o::codec codec() const { return codec_; }
+
         template < typename R = Role >
         typename sessions::enable_for_client< R >::type connect( net_url<> url ) {
 
             status_set( status_t::BLOCKED );
+            latch_read_buffer_type();
 
             assert( url.valid() );
             assert( url.is_resolved() );
 
-            boost::asio::async_connect( stream_.next_layer(), url.endpoints(),
+            if ( stats_name_.empty() )
+                stats_name_ =
+                    std::string( url.host_header() ).append( ":" ).append( url.port() );
+
+            boost::asio::async_connect( tcp_socket(), url.endpoints(),
                                         std::bind( &session::connect_handler,
                                                    this->shared_from_this(),
                                                    std::placeholders::_1, url ) );
@@ -204,14 +495,28 @@ namespace o {
 
         template < typename R = Role >
         typename sessions::enable_for_server< R >::type accept() {
-            stream_.async_accept( boost::asio::bind_executor(
-                read_strand_,
-                std::bind( &session::accepted_handler, this->shared_from_this(),
-                           std::placeholders::_1 ) ) );
+
+            latch_read_buffer_type();
+
+            if constexpr ( layer_traits::is_tls ) {
+                tls_started_ = std::chrono::steady_clock::now();
+                layer_traits::async_handshake(
+                    stream_.next_layer(), true,
+                    boost::asio::bind_executor(
+                        read_strand_,
+                        std::bind( &session::tls_server_handshake_handler,
+                                   this->shared_from_this(), std::placeholders::_1 ) ) );
+            } else {
+                accept_upgrade();
+            }
         }
 
         void write( const Message* message ) {
 
+            O_TRACE_INSTANT( "session::write", message );
+
+            optional_stamp_codec( message );
+
             std::lock_guard< std::mutex > write_q_lock{ write_queue_mutex_ };
 
             msg_queue.push_back( message );
@@ -225,6 +530,11 @@ namespace o {
 
             stats().set_enabled( false );
 
+            boost::asio::dispatch( read_strand_, [self = this->shared_from_this()]() {
+                self->ping_timer_.cancel();
+                self->probe_timer_.cancel();
+            } );
+
             close_tmt = std::make_unique< boost::asio::steady_timer >(
                 stream_.get_executor().context(), std::chrono::milliseconds( 500 ) );
 
@@ -234,15 +544,12 @@ namespace o {
                     try {
 
                         if ( stream_.is_open() ) {
-                            stream_.next_layer().cancel();
-                        }
-                        if ( stream_.next_layer().is_open() ) {
-                            stream_.next_layer().close();
+                            tcp_socket().cancel();
                         }
-                        if ( stream_.lowest_layer().is_open() ) {
-                            stream_.lowest_layer().close();
+                        if ( tcp_socket().is_open() ) {
+                            tcp_socket().close();
                         }
-                    } catch ( std::exception ex ) {
+                    } catch ( const std::exception& ex ) {
                         DBG( "exception on close timer callback: ", ex.what() );
                     }
                 }
@@ -270,25 +577,138 @@ namespace o {
         }
 
       private:
+        // fixes the read buffer type before the first operation of the session
+        void latch_read_buffer_type() {
+            started_ = true;
+            read_buffer_type_ = requested_read_buffer_type_;
+        }
+
         void connect_handler( boost::system::error_code ec, net_url<> url ) {
 
-            if ( !ec ) {
+            if ( ec ) {
+                connect_failed( ec );
+                return;
+            }
+
+            apply_socket_options();
+
+            if constexpr ( layer_traits::is_tls ) {
+                tls_started_ = std::chrono::steady_clock::now();
+                layer_traits::prepare_client( stream_.next_layer(), url.host(), url.port() );
+                layer_traits::async_handshake(
+                    stream_.next_layer(), false,
+                    boost::asio::bind_executor(
+                        read_strand_, std::bind( &session::tls_client_handshake_handler,
+                                                 this->shared_from_this(),
+                                                 std::placeholders::_1, url ) ) );
+            } else {
+                websocket_handshake( url );
+            }
+        }
+
+        void tls_client_handshake_handler( boost::system::error_code ec, net_url<> url ) {
+
+            if ( ec ) {
+                connect_failed( ec );
+                return;
+            }
+
+            tls_handshake_done();
+            websocket_handshake( url );
+        }
+
+        void tls_server_handshake_handler( boost::system::error_code ec ) {
+
+            if ( ec ) {
+                accepted_handler( ec );
+                return;
+            }
+
+            tls_handshake_done();
+            accept_upgrade();
+        }
+
+        void tls_handshake_done() {
+
+            auto elapsed = std::chrono::duration_cast< std::chrono::microseconds >(
+                               std::chrono::steady_clock::now() - tls_started_ )
+                               .count();
+            bool resumed = layer_traits::resumed( stream_.next_layer() );
+
+            O_LOG_DEBUG( "tls handshake with ", layer_traits::cipher( stream_.next_layer() ),
+                         resumed ? " (resumed) " : " ", elapsed, "us" );
+
+            std::lock_guard< std::mutex > stats_lock{ stats().mtx() };
+            stats().add_tls_handshake( elapsed, resumed );
+        }
+
+        void connect_failed( boost::system::error_code ec ) {
+            status_set( status_t::ABORTED );
+            stats_.set_enabled( false );
+            if ( on_ready_ != boost::none ) {
+                on_ready_.value()( ec );
+            }
+        }
+
+        void websocket_handshake( const net_url<>& url ) {
+
+            if ( !codecs_.empty() || send_stamps_requested_ ) {
+
+                auto offered = codec_list( codecs_ );
+
+                auto decorator = [offered, stamps = send_stamps_requested_](
+                                     boost::beast::websocket::request_type& req ) {
+                    if ( !offered.empty() )
+                        req.set( boost::beast::http::field::sec_websocket_protocol,
+                                 offered );
+                    if ( stamps )
+                        req.set( latency_probe::stamp_header, "1" );
+                };
+
+                auto handler = boost::asio::bind_executor(
+                    read_strand_,
+                    std::bind( &session::handshake_handler, this->shared_from_this(),
+                               std::placeholders::_1 ) );
+
+#if BOOST_VERSION >= 107000
+                stream_.set_option(
+                    boost::beast::websocket::stream_base::decorator( decorator ) );
+                stream_.async_handshake( upgrade_res_, beast_view( url.host_header() ),
+                                         beast_view( url.target() ), handler );
+#else
+                stream_.async_handshake_ex( upgrade_res_, beast_view( url.host_header() ),
+                                            beast_view( url.target() ), decorator, handler );
+#endif
+            } else {
                 stream_.async_handshake(
-                    url.host(), url.path(),
+                    beast_view( url.host_header() ), beast_view( url.target() ),
                     boost::asio::bind_executor( read_strand_,
                                                 std::bind( &session::handshake_handler,
                                                            this->shared_from_this(),
                                                            std::placeholders::_1 ) ) );
-            } else {
-                status_set( status_t::ABORTED );
-                stats_.set_enabled( false );
-                if ( on_ready_ != boost::none ) {
-                    on_ready_.value()( ec );
-                }
             }
         }
 
         void handshake_handler( boost::system::error_code ec ) {
+
+            if ( !ec && !codecs_.empty() ) {
+
+                auto selected =
+                    upgrade_res_[boost::beast::http::field::sec_websocket_protocol];
+
+                // servers without negotiation answer without a subprotocol and
+                // get the default codec, anything else must be one we offered
+                if ( !selected.empty() &&
+                     !codec_from_name(
+                         std::string_view( selected.data(), selected.size() ), codec_ ) ) {
+                    ec = boost::system::errc::make_error_code(
+                        boost::system::errc::protocol_error );
+                }
+            }
+
+            if ( !ec && send_stamps_requested_ )
+                send_stamps_ = upgrade_res_[latency_probe::stamp_header] == "1";
+
             if ( ec ) {
                 status_set( status_t::ABORTED );
                 stats_.set_enabled( false );
@@ -297,6 +717,7 @@ namespace o {
                 }
             } else {
                 status_set( status_t::ONLINE );
+                session_online();
 
                 if ( on_ready_ != boost::none ) {
                     on_ready_.value()( ec );
@@ -306,6 +727,116 @@ namespace o {
             }
         }
 
+        // the websocket part of accept(), after the tls handshake if there is one
+        void accept_upgrade() {
+
+            if ( codecs_.empty() && on_http_request_ == boost::none &&
+                 !send_stamps_requested_ ) {
+                stream_.async_accept( boost::asio::bind_executor(
+                    read_strand_,
+                    std::bind( &session::accepted_handler, this->shared_from_this(),
+                               std::placeholders::_1 ) ) );
+                return;
+            }
+
+            // read the upgrade request ourselves to look at the offered subprotocols
+            // or to answer plain http requests
+            boost::beast::http::async_read(
+                stream_.next_layer(), upgrade_buffer_, upgrade_req_,
+                boost::asio::bind_executor(
+                    read_strand_,
+                    std::bind( &session::upgrade_request_handler,
+                               this->shared_from_this(), std::placeholders::_1 ) ) );
+        }
+
+        void upgrade_request_handler( boost::system::error_code ec ) {
+
+            if ( ec ) {
+                accepted_handler( ec );
+                return;
+            }
+
+            if ( on_http_request_ != boost::none &&
+                 !boost::beast::websocket::is_upgrade( upgrade_req_ ) ) {
+                respond_http();
+                return;
+            }
+
+            // a client must not send frames before the handshake completed, bytes
+            // read past the request could not be handed to the websocket stream
+            bool left_over = upgrade_buffer_.size() > 0;
+            upgrade_buffer_ = boost::beast::flat_buffer{};
+
+            if ( left_over ) {
+                boost::system::error_code ignored;
+                tcp_socket().close( ignored );
+                accepted_handler( boost::beast::http::error::unexpected_body );
+                return;
+            }
+
+            auto offered = upgrade_req_[boost::beast::http::field::sec_websocket_protocol];
+            bool selected = codec_negotiate(
+                std::string_view( offered.data(), offered.size() ), codecs_, codec_ );
+
+            send_stamps_ = send_stamps_requested_ &&
+                           upgrade_req_[latency_probe::stamp_header] == "1";
+
+            // peers that offer nothing we know get the default codec without a
+            // subprotocol in the response
+            auto decorator = [selected, cd = codec_, stamps = send_stamps_.load()](
+                                 boost::beast::websocket::response_type& res ) {
+                if ( selected )
+                    res.set( boost::beast::http::field::sec_websocket_protocol,
+                             codec_name( cd ) );
+                if ( stamps )
+                    res.set( latency_probe::stamp_header, "1" );
+            };
+
+            auto handler = boost::asio::bind_executor(
+                read_strand_, std::bind( &session::accepted_handler,
+                                         this->shared_from_this(), std::placeholders::_1 ) );
+
+#if BOOST_VERSION >= 107000
+            stream_.set_option( boost::beast::websocket::stream_base::decorator( decorator ) );
+            stream_.async_accept( upgrade_req_, handler );
+#else
+            stream_.async_accept_ex( upgrade_req_, decorator, handler );
+#endif
+        }
+
+        void respond_http() {
+
+            http_res_ = http_response_t{ boost::beast::http::status::not_found,
+                                         upgrade_req_.version() };
+            http_res_.set( boost::beast::http::field::content_type, "text/plain" );
+
+            on_http_request_.value()( upgrade_req_, http_res_ );
+
+            http_res_.keep_alive( false );
+            http_res_.prepare_payload();
+
+            boost::beast::http::async_write(
+                stream_.next_layer(), http_res_,
+                boost::asio::bind_executor(
+                    read_strand_,
+                    std::bind( &session::http_response_handler,
+                               this->shared_from_this(), std::placeholders::_1 ) ) );
+        }
+
+        void http_response_handler( boost::system::error_code ec ) {
+
+            boost::system::error_code ignored;
+            tcp_socket().shutdown( boost::asio::ip::tcp::socket::shutdown_send, ignored );
+            tcp_socket().close( ignored );
+
+            status_set( status_t::OFFLINE );
+            stats_.set_enabled( false );
+
+            if ( on_close_ != boost::none ) {
+                on_close_.value()( ec );
+            }
+        }
+
         void accepted_handler( boost::system::error_code ec ) {
 
             if ( ec ) {
@@ -313,6 +844,7 @@ namespace o {
                 stats_.set_enabled( false );
             } else {
                 status_set( status_t::ONLINE );
+                session_online();
                 perform_read();
             }
 
@@ -321,46 +853,320 @@ namespace o {
             }
         }
 
+        // beast may use its own string_view type
+        static boost::beast::string_view beast_view( std::string_view str ) {
+            return { str.data(), str.size() };
+        }
+
+        void apply_socket_options() {
+            std::lock_guard< std::mutex > lock{ socket_options_mutex_ };
+            socket_options_.apply( tcp_socket() );
+        }
+
+        boost::asio::ip::tcp::socket& tcp_socket() {
+            return layer_traits::socket( stream_.next_layer() );
+        }
+
+        // runs on the strand once the handshake is done
+        void session_online() {
+
+            attach_registry();
+
+            stream_.control_callback(
+                [this]( boost::beast::websocket::frame_type kind,
+                        boost::beast::string_view payload ) {
+                    if ( kind == boost::beast::websocket::frame_type::ping ) {
+                        probe_request_received( payload );
+                    } else if ( kind == boost::beast::websocket::frame_type::pong ) {
+                        pong_received( payload );
+                        probe_reply_received( payload );
+                    }
+                } );
+
+            start_keepalive();
+            start_probes();
+        }
+
+        // ----------------   control frames
+
+        // beast allows only one ping or pong in flight, so they go out in order
+        void send_control( boost::beast::websocket::frame_type kind,
+                           const boost::beast::websocket::ping_data& payload ) {
+
+            control_queue_.emplace_back( kind, payload );
+
+            if ( control_queue_.size() == 1 )
+                write_control();
+        }
+
+        void write_control() {
+
+            auto& front = control_queue_.front();
+
+            auto handler = boost::asio::bind_executor(
+                read_strand_, std::bind( &session::control_written,
+                                         this->shared_from_this(), std::placeholders::_1 ) );
+
+            if ( front.first == boost::beast::websocket::frame_type::ping ) {
+                stream_.async_ping( front.second, handler );
+            } else {
+                if ( latency_probe::is_reply( front.second ) )
+                    latency_probe::stamp_reply( front.second, latency_probe::now() );
+                stream_.async_pong( front.second, handler );
+            }
+        }
+
+        void control_written( boost::system::error_code ec ) {
+
+            if ( ec ) {
+                control_queue_.clear();
+                return;
+            }
+
+            control_queue_.pop_front();
+
+            if ( !control_queue_.empty() )
+                write_control();
+        }
+
+        // ----------------   keepalive
+
+        void start_keepalive() {
+
+            if ( keepalive_interval_.count() <= 0 || keepalive_running_ )
+                return;
+
+            keepalive_running_ = true;
+            missed_pongs_ = 0;
+
+            schedule_ping();
+        }
+
+        void schedule_ping() {
+            ping_timer_.expires_after( keepalive_interval_ );
+            ping_timer_.async_wait( boost::asio::bind_executor(
+                read_strand_, std::bind( &session::ping_timer_handler,
+                                         this->shared_from_this(), std::placeholders::_1 ) ) );
+        }
+
+        void ping_timer_handler( boost::system::error_code ec ) {
+
+            if ( ec || status() != status_t::ONLINE || keepalive_interval_.count() <= 0 ) {
+                keepalive_running_ = false;
+                return;
+            }
+
+            if ( missed_pongs_ >= keepalive_max_missed_ ) {
+
+                O_LOG_INFO( "no pong for ", missed_pongs_, " pings, closing ", stats_name_ );
+
+                // the read fails with operation_aborted and reports the session as closed
+                keepalive_running_ = false;
+
+                boost::system::error_code ignored;
+                tcp_socket().shutdown( boost::asio::ip::tcp::socket::shutdown_both, ignored );
+                tcp_socket().close( ignored );
+                return;
+            }
+
+            ++missed_pongs_;
+
+            // the send time travels in the payload, so every pong carries its own rtt
+            std::int64_t sent = std::chrono::duration_cast< std::chrono::nanoseconds >(
+                                    std::chrono::steady_clock::now().time_since_epoch() )
+                                    .count();
+
+            boost::beast::websocket::ping_data payload;
+            payload.resize( sizeof( sent ) );
+            std::memcpy( payload.data(), &sent, sizeof( sent ) );
+
+            send_control( boost::beast::websocket::frame_type::ping, payload );
+
+            schedule_ping();
+        }
+
+        void pong_received( boost::beast::string_view payload ) {
+
+            std::int64_t sent;
+
+            if ( payload.size() != sizeof( sent ) )
+                return;
+
+            std::memcpy( &sent, payload.data(), sizeof( sent ) );
+
+            auto rtt = std::chrono::steady_clock::now().time_since_epoch() -
+                       std::chrono::nanoseconds( sent );
+
+            missed_pongs_ = 0;
+
+            std::lock_guard< std::mutex > stats_lock{ stats().mtx() };
+            stats().add_rtt(
+                std::chrono::duration_cast< std::chrono::microseconds >( rtt ).count() );
+        }
+
+        // ----------------   latency probes
+
+        void start_probes() {
+
+            if ( probe_interval_.count() <= 0 || probes_running_ )
+                return;
+
+            probes_running_ = true;
+
+            schedule_probe();
+        }
+
+        void schedule_probe() {
+            probe_timer_.expires_after( probe_interval_ );
+            probe_timer_.async_wait( boost::asio::bind_executor(
+                read_strand_, std::bind( &session::probe_timer_handler,
+                                         this->shared_from_this(), std::placeholders::_1 ) ) );
+        }
+
+        void probe_timer_handler( boost::system::error_code ec ) {
+
+            if ( ec || status() != status_t::ONLINE || probe_interval_.count() <= 0 ) {
+                probes_running_ = false;
+                return;
+            }
+
+            send_control( boost::beast::websocket::frame_type::ping,
+                          latency_probe::request( latency_probe::now() ) );
+
+            schedule_probe();
+        }
+
+        void probe_request_received( boost::beast::string_view payload ) {
+
+            auto t2 = latency_probe::now();
+            std::int64_t t1;
+
+            if ( !latency_probe::parse_request( { payload.data(), payload.size() }, t1 ) )
+                return;
+
+            // no writes from inside the control callback, the read is still going on
+            boost::asio::post( read_strand_, [self = this->shared_from_this(),
+                                              reply = latency_probe::reply( t1, t2 )]() {
+                self->send_control( boost::beast::websocket::frame_type::pong, reply );
+            } );
+        }
+
+        void probe_reply_received( boost::beast::string_view payload ) {
+
+            auto t4 = latency_probe::now();
+            std::int64_t t1, t2, t3;
+
+            if ( !latency_probe::parse_reply( { payload.data(), payload.size() }, t1, t2,
+                                              t3 ) )
+                return;
+
+            auto offset = clock_offset_.add( t1, t2, t3, t4 );
+
+            std::lock_guard< std::mutex > stats_lock{ stats().mtx() };
+            stats().set_clock_offset( offset / 1e3 );
+            stats().outbound().add_one_way( ( t2 - t1 - offset ) / 1e3 );
+            stats().inbound().add_one_way( ( t4 - t3 + offset ) / 1e3 );
+        }
+
+        // the send time of the peer in our clock, 0 if the stamp is broken
+        template < typename Buffer >
+        std::int64_t read_send_stamp( Buffer& buffer ) {
+
+            std::array< char, latency_probe::stamp_size > stamp;
+            boost::asio::buffer_copy( boost::asio::buffer( stamp ), buffer.data() );
+            buffer.consume( stamp.size() );
+
+            std::int64_t sent;
+
+            if ( !latency_probe::read_stamp( stamp.data(), sent ) )
+                return 0;
+
+            sent -= clock_offset_.offset();
+            stats().inbound().add_delay( ( latency_probe::now() - sent ) / 1e3 );
+
+            return sent;
+        }
+
+        void attach_registry() {
+
+            if ( stats_name_.empty() ) {
+                boost::system::error_code ec;
+                auto peer = tcp_socket().remote_endpoint( ec );
+                stats_name_ = ec ? std::string( "unknown" )
+                                 : peer.address().to_string() + ":" +
+                                       std::to_string( peer.port() );
+            }
+
+            registry_source_ = stats_registry::global().attach( stats_name_ );
+        }
+
         // ----------------   write operations
 
         void perform_write( const Message* msg ) {
-            if ( ctx_.get_executor().running_in_this_thread() ) {
-                stream_.async_write(
-                    boost::asio::buffer( msg->data(), msg->size() ),
-                    boost::asio::bind_executor(
-                        this->write_strand_,
-                        std::bind( &session::write_complete_handler,
-                                   this->shared_from_this(), std::placeholders::_1,
-                                   std::placeholders::_2, msg ) ) );
+
+            O_TRACE_SCOPE( "session::perform_write", msg );
+
+            if ( write_strand_.running_in_this_thread() ) {
+                start_write( msg );
             } else {
                 auto self = this->shared_from_this();
 
-                boost::asio::dispatch( write_strand_, [msg, self]() {
-                    self->stream_.async_write(
-                        boost::asio::buffer( msg->data(), msg->size() ),
-                        boost::asio::bind_executor(
-                            self->write_strand_,
-                            std::bind( &session::write_complete_handler,
-                                       self->shared_from_this(), std::placeholders::_1,
-                                       std::placeholders::_2, msg ) ) );
-                } );
+                boost::asio::dispatch( write_strand_,
+                                       [msg, self]() { self->start_write( msg ); } );
+            }
+        }
+
+        void start_write( const Message* msg ) {
+
+            write_started_ = std::chrono::steady_clock::now();
+            optional_set_text_mode( msg );
+
+            auto handler = boost::asio::bind_executor(
+                this->write_strand_,
+                std::bind( &session::write_complete_handler, this->shared_from_this(),
+                           std::placeholders::_1, std::placeholders::_2, msg ) );
+
+            if ( send_stamps_ ) {
+                latency_probe::write_stamp( send_stamp_.data(), latency_probe::now() );
+
+                std::array< boost::asio::const_buffer, 2 > buffers = {
+                    boost::asio::buffer( send_stamp_ ),
+                    boost::asio::buffer( msg->data(), msg->size() ) };
+
+                stream_.async_write( buffers, handler );
+            } else {
+                stream_.async_write( boost::asio::buffer( msg->data(), msg->size() ),
+                                     handler );
             }
         }
 
         void write_complete_handler( boost::system::error_code ec, std::size_t bytes,
                                      const Message* msg ) {
 
+            O_TRACE_SCOPE( "session::write_complete_handler", msg );
+
             std::unique_lock< std::mutex > lock{ write_queue_mutex_ };
             std::unique_lock< std::mutex > stats_lock{ stats().mtx() };
 
-            DBG( ec.message() );
+            if ( ec )
+                O_LOG_DEBUG( "write failed: ", ec.message() );
 
             stats().outbound().data().add( bytes );
             stats().outbound().msgs()++;
+            stats().outbound().sizes().add( bytes );
+            if ( registry_source_ )
+                registry_source_->outbound( bytes );
+            stats().outbound().latencies().add(
+                std::chrono::duration_cast< std::chrono::microseconds >(
+                    std::chrono::steady_clock::now() - write_started_ )
+                    .count() );
 
             if ( !msg_queue.empty() ) {
                 msg_queue.pop_front();
 
+                // hand the frame back to the pool of this io thread
+                optional_release_frame( msg );
+
                 if ( on_write_done_ != boost::none ) {
                     on_write_done_.value()( msg );
                 } else {
@@ -396,42 +1202,88 @@ namespace o {
                 auto self = this->shared_from_this();
 
                 boost::asio::dispatch( read_strand_, [self]() {
-                    self->stream_.async_read(
-                        self->buffer_,
-                        boost::asio::bind_executor(
-                            self->read_strand_,
-                            std::bind( &session::read_handler, self->shared_from_this(),
-                                       std::placeholders::_1, std::placeholders::_2 ) ) );
+                    self->with_read_buffer( [&self]( auto& buffer ) {
+                        self->stream_.async_read(
+                            buffer, boost::asio::bind_executor(
+                                        self->read_strand_,
+                                        std::bind( &session::read_handler,
+                                                   self->shared_from_this(),
+                                                   std::placeholders::_1,
+                                                   std::placeholders::_2 ) ) );
+                    } );
                 } );
             }
         }
 
+        template < typename Handler >
+        void with_read_buffer( Handler&& handler ) {
+            switch ( read_buffer_type_ ) {
+            case stream_tuning::read_buffer_type::flat:
+                handler( flat_buffer_ );
+                break;
+            case stream_tuning::read_buffer_type::pooled:
+                handler( pooled_buffer_ );
+                break;
+            default:
+                handler( buffer_ );
+            }
+        }
+
         void read_handler( boost::system::error_code ec, size_t bytes ) {
 
+            O_TRACE_SCOPE( "session::read_handler", nullptr );
+
             if ( !ec ) {
 
                 std::unique_lock< std::mutex > stats_lock{ stats().mtx() };
 
                 stats().inbound().data().add( bytes );
                 stats().inbound().msgs()++;
+                stats().inbound().sizes().add( bytes );
+                if ( registry_source_ )
+                    registry_source_->inbound( bytes );
 
-                if ( on_read_ != boost::none ) {
+                if ( quick_ack_ )
+                    socket_options::request_quick_ack( tcp_socket() );
 
-                    Message* new_msg = static_cast< Message* >( allocator_.allocate() );
+                with_read_buffer( [&]( auto& buffer ) {
+                    size_t size = bytes;
+                    std::int64_t sent = 0;
 
-                    optional_set_direction( false, new_msg );
+                    if ( send_stamps_ && size >= latency_probe::stamp_size ) {
+                        sent = read_send_stamp( buffer );
+                        size -= latency_probe::stamp_size;
+                    }
 
-                    Message::from_const_buffers( buffer_.data(), new_msg,
-                                                 stream_.got_text() );
+                    if ( on_read_ != boost::none ) {
 
-                    on_read_.value()( ec, new_msg, bytes );
-                }
+                        Message* new_msg = static_cast< Message* >( allocator_.allocate() );
+
+                        optional_set_direction( false, new_msg );
+                        optional_set_codec( new_msg );
+
+                        {
+                            O_TRACE_SCOPE( "from_const_buffers", new_msg );
+                            Message::from_const_buffers( buffer.data(), new_msg,
+                                                         stream_.got_text() );
+                        }
+
+                        if ( sent != 0 )
+                            optional_set_send_time( new_msg, sent );
+
+                        on_read_.value()( ec, new_msg, size );
+                    }
 
-                buffer_.consume( bytes );
+                    buffer.consume( size );
+                    read_buffer_bytes_ = buffer.capacity();
+                } );
 
                 perform_read();
             } else {
 
+                ping_timer_.cancel();
+                probe_timer_.cancel();
+
                 if ( ec != boost::beast::websocket::error::closed && ec.value() != 89 ) {
                     status_set( status_t::ABORTED );
                     stats_.set_enabled( false );
@@ -477,6 +1329,15 @@ namespace o {
         Stream stream_;
 
         boost::beast::multi_buffer buffer_;
+        boost::beast::flat_buffer flat_buffer_;
+        pooled_flat_buffer pooled_buffer_;
+        stream_tuning::read_buffer_type read_buffer_type_ =
+            stream_tuning::read_buffer_type::pooled;
+        // set by set_stream_tuning() until connect() / accept() takes it over
+        std::atomic< stream_tuning::read_buffer_type > requested_read_buffer_type_{
+            stream_tuning::read_buffer_type::pooled };
+        std::atomic< bool > started_{ false };
+        std::atomic< size_t > read_buffer_bytes_{ 0 };
 
         typename Message::factory& allocator_;
 
@@ -490,11 +1351,49 @@ namespace o {
         boost::optional< write_completion_handler_t > on_write_done_;
         boost::optional< basic_completion_handler_t > on_close_;
         boost::optional< basic_completion_handler_t > on_ready_;
+        boost::optional< http_request_handler_t > on_http_request_;
 
         std::mutex write_queue_mutex_;
         std::deque< const Message* > msg_queue;
-        boost::asio::io_context::strand write_strand_{ ctx_ };
+        // beast streams need all operations on one strand, so reads and writes share it
+        boost::asio::io_context::strand write_strand_{ read_strand_ };
+        std::chrono::steady_clock::time_point write_started_;
+        std::chrono::steady_clock::time_point tls_started_;
+
+        boost::asio::steady_timer ping_timer_{ ctx_ };
+        std::chrono::milliseconds keepalive_interval_{ 0 };
+        unsigned keepalive_max_missed_ = 3;
+        unsigned missed_pongs_ = 0;
+        bool keepalive_running_ = false;
+
+        std::deque< std::pair< boost::beast::websocket::frame_type,
+                               boost::beast::websocket::ping_data > >
+            control_queue_;
+
+        boost::asio::steady_timer probe_timer_{ ctx_ };
+        std::chrono::milliseconds probe_interval_{ 0 };
+        bool probes_running_ = false;
+        clock_offset_estimator<> clock_offset_;
+
+        bool send_stamps_requested_ = false;
+        std::atomic< bool > send_stamps_{ false };
+        std::array< char, latency_probe::stamp_size > send_stamp_;
+
+        std::mutex socket_options_mutex_;
+        socket_options socket_options_;
+        std::atomic< bool > quick_ack_{ false };
+
+        std::string stats_name_;
+        std::shared_ptr< stats_registry::source > registry_source_;
 
         std::atomic< int >* msg_pool_refc;
+
+        std::vector< o::codec > codecs_;
+        o::codec codec_ = o::codec::protobuf_v1;
+
+        boost::beast::flat_buffer upgrade_buffer_;
+        http_request_t upgrade_req_;
+        http_response_t http_res_;
+        boost::beast::websocket::response_type upgrade_res_;
     };
 } // namespace o
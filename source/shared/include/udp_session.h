@@ -0,0 +1,835 @@
+//
+// This file is part of the Max-Net Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "session.h"
+
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace o {
+
+    /**
+     * Wire format of udp_session. Every datagram starts with
+     *
+     *   'm' | kind | frame count (16 bit) | sequence number (32 bit)
+     *
+     * and data datagrams go on with count frames of a 16 bit length, a flags
+     * byte and the payload. Integers are little endian. Sequence numbers count
+     * the data datagrams of each direction and wrap around.
+     */
+    struct udp_framing {
+
+        enum class kind : std::uint8_t { data = 1, hello = 2, bye = 3 };
+
+        static constexpr char magic = 'm';
+        static constexpr size_t header_size = 8;
+        static constexpr size_t frame_header_size = 3;
+        static constexpr char text_flag = 1;
+
+        /// largest udp payload over ipv4
+        static constexpr size_t max_datagram = 65507;
+
+        /// largest message that fits into a datagram
+        static constexpr size_t max_message = max_datagram - header_size - frame_header_size;
+
+        /// datagrams this far behind come from a peer that restarted its sequence
+        static constexpr std::int32_t resync_distance = 1 << 16;
+
+        static void write_header( char* out, kind k, std::uint16_t count,
+                                  std::uint32_t sequence ) {
+            out[0] = magic;
+            out[1] = static_cast< char >( k );
+            put( out + 2, count, 2 );
+            put( out + 4, sequence, 4 );
+        }
+
+        static bool read_header( const char* in, size_t size, kind& k, std::uint16_t& count,
+                                 std::uint32_t& sequence ) {
+            if ( size < header_size || in[0] != magic )
+                return false;
+
+            k = static_cast< kind >( in[1] );
+            count = static_cast< std::uint16_t >( get( in + 2, 2 ) );
+            sequence = get( in + 4, 4 );
+            return true;
+        }
+
+        static void write_frame_header( char* out, size_t size, bool text ) {
+            put( out, static_cast< std::uint32_t >( size ), 2 );
+            out[2] = text ? text_flag : 0;
+        }
+
+        /// how far ahead of expected sequence is, negative for late datagrams
+        static std::int32_t distance( std::uint32_t expected, std::uint32_t sequence ) {
+            return static_cast< std::int32_t >( sequence - expected );
+        }
+
+        static void put( char* out, std::uint32_t value, size_t bytes ) {
+            for ( size_t i = 0; i < bytes; ++i )
+                out[i] = static_cast< char >( ( value >> ( 8 * i ) ) & 0xff );
+        }
+
+        static std::uint32_t get( const char* in, size_t bytes ) {
+            std::uint32_t v = 0;
+            for ( size_t i = 0; i < bytes; ++i )
+                v |= static_cast< std::uint32_t >( static_cast< unsigned char >( in[i] ) )
+                     << ( 8 * i );
+            return v;
+        }
+    };
+
+    /**
+     * A session over udp with the callbacks, write() and stats() of o::session,
+     * for high rate streams where a lost message hurts less than waiting for a
+     * retransmission. Messages are not retransmitted and may arrive out of
+     * order, sequence numbers let the receiver count loss and reordering.
+     *
+     * Clients send a hello to the peer of connect() and are online right away.
+     * Servers bind to their local endpoint in accept() and take the sender of
+     * the first datagram as their peer, or of a later hello if the peer
+     * reconnected. Servers greet a new peer and answer every hello with a
+     * hello. A hello restarts sequence tracking on the receiving side.
+     * close() sends a bye, which the peer reports as a read with
+     * boost::asio::error::eof.
+     */
+    template < typename Message, typename Role = sessions::roles::client >
+    class udp_session
+        : public std::enable_shared_from_this< udp_session< Message, Role > >,
+          public session_threaded_base< ccy::safe > {
+      public:
+        typedef std::function< void( boost::system::error_code ) >
+            basic_completion_handler_t;
+        typedef std::function< void( const Message* ) > write_completion_handler_t;
+        typedef std::function< void( boost::system::error_code, Message*, size_t ) >
+            read_completion_handler_t;
+
+        using status_t = status_codes;
+
+        using endpoint_type = boost::asio::ip::udp::endpoint;
+
+        /// constructor for client role
+        template < typename R = Role >
+        explicit udp_session( boost::asio::io_context& ctx,
+                              typename Message::factory& allocator, std::atomic< int >* refc,
+                              typename sessions::enable_for_client< R, std::nullptr_t >::type
+                                  dummyarg = nullptr )
+            : ctx_( ctx )
+            , strand_( ctx )
+            , socket_( ctx )
+            , allocator_( allocator )
+            , stats_( ctx )
+            , msg_pool_refc( refc ) {
+            status_set( status_t::BLOCKED );
+            ( *msg_pool_refc )++;
+        }
+
+        /// constructor for server role, accept() binds to local
+        template < typename R = Role >
+        explicit udp_session( const endpoint_type& local, boost::asio::io_context& ctx,
+                              typename Message::factory& allocator, std::atomic< int >* refc,
+                              typename sessions::enable_for_server< R, std::nullptr_t >::type
+                                  dummyarg = nullptr )
+            : ctx_( ctx )
+            , strand_( ctx )
+            , socket_( ctx )
+            , local_( local )
+            , allocator_( allocator )
+            , stats_( ctx )
+            , msg_pool_refc( refc ) {
+            status_set( status_t::BLOCKED );
+            ( *msg_pool_refc )++;
+        }
+
+        ~udp_session() {
+
+            while ( !pending_.empty() ) {
+                release( pending_.front() );
+                pending_.pop_front();
+            }
+
+            ( *msg_pool_refc )--;
+        }
+
+        std::string status_string() const {
+            switch ( status_get() ) {
+            case status_codes::OFFLINE:
+                return "offline";
+            case status_codes::ONLINE:
+                return "online";
+            case status_codes::BLOCKED:
+                return "blocked";
+            case status_codes::ABORTED:
+                return "aborted";
+            default:
+                return "undefined";
+            }
+        }
+
+        status_t status() const { return status_get(); }
+
+        void on_ready( basic_completion_handler_t handler ) {
+            on_ready_ = boost::make_optional( handler );
+        }
+
+        void on_read( read_completion_handler_t handler ) {
+            on_read_ = boost::make_optional( handler );
+        }
+
+        void on_close( basic_completion_handler_t handler ) {
+            on_close_ = boost::make_optional( handler );
+        }
+
+        /// called once a message was copied into a datagram or dropped
+        void on_write_done( write_completion_handler_t handler ) {
+            on_write_done_ = boost::make_optional( handler );
+        }
+
+        /// buffer sizes, dscp and busy polling of the socket, see socket_options
+        void set_socket_options( const socket_options& options ) {
+
+            auto self = this->shared_from_this();
+
+            boost::asio::dispatch( strand_, [self, options]() {
+                self->socket_options_ = options;
+                if ( self->socket_.is_open() )
+                    self->socket_options_.apply( self->socket_ );
+            } );
+        }
+
+        /// defaults to host:port of the peer, see session::set_stats_name
+        void set_stats_name( std::string name ) { stats_name_ = std::move( name ); }
+
+        /// there is no handshake, so both peers have to use the same codec
+        void set_codec( o::codec codec ) { codec_ = codec; }
+
+        o::codec codec() const { return codec_; }
+
+        /**
+         * Latest-value semantics for streams of absolute values like sensor
+         * readings or joint positions, where only the newest one counts: a write
+         * replaces the messages that are still waiting for the socket, and
+         * datagrams that arrive after a newer one are dropped instead of being
+         * delivered late.
+         */
+        void set_latest_value( bool enabled ) {
+            auto self = this->shared_from_this();
+            boost::asio::dispatch( strand_,
+                                   [self, enabled]() { self->latest_value_ = enabled; } );
+        }
+
+        /**
+         * Pack the messages that are written while a datagram is in flight into
+         * the next one, up to max_bytes per datagram. With a delay, messages also
+         * wait up to that long for company. Zero max_bytes sends every message in
+         * a datagram of its own. Stay below the path mtu, 1200 bytes fit nearly
+         * everywhere, or the datagrams get fragmented.
+         */
+        void set_batching( size_t max_bytes,
+                           std::chrono::microseconds delay = std::chrono::microseconds( 0 ) ) {
+
+            auto self = this->shared_from_this();
+
+            boost::asio::dispatch( strand_, [self, max_bytes, delay]() {
+                self->batch_bytes_ = std::min( max_bytes, udp_framing::max_datagram );
+                self->batch_delay_ = delay;
+            } );
+        }
+
+        /// number of messages waiting for the socket
+        size_t queue_depth() const { return queued_.load(); }
+
+        size_t read_buffer_bytes() const { return read_buffer_.size(); }
+
+        template < typename R = Role >
+        typename sessions::enable_for_client< R >::type connect( net_url<> url ) {
+
+            status_set( status_t::BLOCKED );
+
+            assert( url.valid() );
+            assert( url.is_resolved() );
+
+            if ( stats_name_.empty() )
+                stats_name_ =
+                    std::string( url.host_header() ).append( ":" ).append( url.port() );
+
+            auto& target = url.endpoints().front();
+            endpoint_type peer{ target.address(), target.port() };
+
+            boost::asio::dispatch( strand_, [self = this->shared_from_this(), peer]() {
+                boost::system::error_code ec;
+
+                self->socket_.open( peer.protocol(), ec );
+
+                // a connected socket only receives from the peer
+                if ( !ec )
+                    self->socket_.connect( peer, ec );
+
+                if ( ec ) {
+                    self->failed( ec );
+                    return;
+                }
+
+                self->peer_ = peer;
+                self->connected_ = true;
+                self->socket_options_.apply( self->socket_ );
+                self->send_control( udp_framing::kind::hello );
+                self->online();
+            } );
+        }
+
+        template < typename R = Role >
+        typename sessions::enable_for_server< R >::type accept() {
+
+            boost::asio::dispatch( strand_, [self = this->shared_from_this()]() {
+                boost::system::error_code ec;
+
+                self->socket_.open( self->local_.protocol(), ec );
+
+                if ( !ec )
+                    self->socket_.bind( self->local_, ec );
+
+                if ( ec ) {
+                    self->failed( ec );
+                    return;
+                }
+
+                self->socket_options_.apply( self->socket_ );
+                self->perform_read();
+            } );
+        }
+
+        void write( const Message* message ) {
+
+            O_TRACE_INSTANT( "udp_session::write", message );
+
+            auto self = this->shared_from_this();
+            boost::asio::dispatch( strand_,
+                                   [self, message]() { self->enqueue( message ); } );
+        }
+
+        void close() {
+            boost::asio::dispatch( strand_, [self = this->shared_from_this()]() {
+                self->shutdown( true );
+
+                if ( self->on_close_ != boost::none )
+                    self->on_close_.value()( boost::system::error_code{} );
+            } );
+        }
+
+        boost::asio::ip::udp::socket& socket() { return socket_; }
+
+        session_stats< unsigned long long, std::chrono::system_clock >& stats() {
+            return stats_;
+        }
+
+      private:
+        // ----------------   state
+
+        void online() {
+
+            if ( stats_name_.empty() )
+                stats_name_ = peer_.address().to_string() + ":" + std::to_string( peer_.port() );
+
+            registry_source_ = stats_registry::global().attach( stats_name_ );
+
+            status_set( status_t::ONLINE );
+
+            if ( on_ready_ != boost::none )
+                on_ready_.value()( boost::system::error_code{} );
+
+            if ( connected_ )
+                perform_read();
+        }
+
+        void failed( boost::system::error_code ec ) {
+
+            status_set( status_t::ABORTED );
+            stats_.set_enabled( false );
+
+            if ( on_ready_ != boost::none )
+                on_ready_.value()( ec );
+        }
+
+        void shutdown( bool notify_peer ) {
+
+            if ( notify_peer && status() == status_t::ONLINE )
+                send_control( udp_framing::kind::bye );
+
+            status_set( status_t::OFFLINE );
+            stats_.set_enabled( false );
+
+            batch_timer_.cancel();
+
+            while ( !pending_.empty() ) {
+                release( pending_.front() );
+                pending_.pop_front();
+            }
+
+            pending_bytes_ = 0;
+            queued_ = 0;
+
+            boost::system::error_code ignored;
+            socket_.close( ignored );
+        }
+
+        // hello and bye are a header only and go out right away
+        void send_control( udp_framing::kind k ) {
+
+            std::array< char, udp_framing::header_size > datagram;
+            udp_framing::write_header( datagram.data(), k, 0, 0 );
+
+            boost::system::error_code ignored;
+
+            if ( connected_ )
+                socket_.send( boost::asio::buffer( datagram ), 0, ignored );
+            else
+                socket_.send_to( boost::asio::buffer( datagram ), peer_, 0, ignored );
+        }
+
+        // ----------------   write operations
+
+        void enqueue( const Message* msg ) {
+
+            if ( status() != status_t::ONLINE || msg->size() > udp_framing::max_message ) {
+                if ( msg->size() > udp_framing::max_message )
+                    O_LOG_WARN( "message of ", msg->size(),
+                                " bytes does not fit into a datagram" );
+                release( msg );
+                return;
+            }
+
+            if ( latest_value_ && !pending_.empty() ) {
+
+                {
+                    std::lock_guard< std::mutex > stats_lock{ stats().mtx() };
+                    stats().add_superseded( pending_.size() );
+                }
+
+                while ( !pending_.empty() ) {
+                    release( pending_.front() );
+                    pending_.pop_front();
+                }
+
+                pending_bytes_ = 0;
+            }
+
+            pending_.push_back( msg );
+            pending_bytes_ += udp_framing::frame_header_size + msg->size();
+            queued_ = pending_.size();
+
+            maybe_flush();
+        }
+
+        void maybe_flush() {
+
+            if ( pending_.empty() || sending_ )
+                return;
+
+            bool full = udp_framing::header_size + pending_bytes_ >= batch_bytes_;
+
+            if ( batch_bytes_ == 0 || batch_delay_.count() <= 0 || full ) {
+                flush();
+                return;
+            }
+
+            if ( batch_timer_armed_ )
+                return;
+
+            batch_timer_armed_ = true;
+            batch_timer_.expires_after( batch_delay_ );
+            batch_timer_.async_wait( boost::asio::bind_executor(
+                strand_, [self = this->shared_from_this()]( boost::system::error_code ec ) {
+                    self->batch_timer_armed_ = false;
+                    if ( !ec )
+                        self->flush();
+                } ) );
+        }
+
+        // copy as many pending messages as fit into one datagram and send it
+        void flush() {
+
+            if ( pending_.empty() || sending_ || status() != status_t::ONLINE )
+                return;
+
+            if ( batch_timer_armed_ )
+                batch_timer_.cancel();
+
+            O_TRACE_SCOPE( "udp_session::flush", pending_.front() );
+
+            size_t limit = batch_bytes_ > 0 ? batch_bytes_ : udp_framing::max_datagram;
+            size_t used = udp_framing::header_size;
+            std::uint16_t count = 0;
+
+            if ( write_buffer_.size() < udp_framing::max_datagram )
+                write_buffer_.resize( udp_framing::max_datagram );
+
+            std::unique_lock< std::mutex > stats_lock{ stats().mtx() };
+
+            while ( !pending_.empty() && count < 0xffff ) {
+
+                auto msg = pending_.front();
+                size_t frame = udp_framing::frame_header_size + msg->size();
+
+                if ( count > 0 && used + frame > limit )
+                    break;
+
+                udp_framing::write_frame_header( write_buffer_.data() + used, msg->size(),
+                                                 is_text( msg ) );
+                std::memcpy( write_buffer_.data() + used + udp_framing::frame_header_size,
+                             msg->data(), msg->size() );
+
+                stats().outbound().sizes().add( msg->size() );
+
+                used += frame;
+                pending_bytes_ -= frame;
+                ++count;
+
+                pending_.pop_front();
+                release( msg );
+
+                if ( batch_bytes_ == 0 )
+                    break;
+            }
+
+            stats().outbound().msgs().add( count );
+            stats_lock.unlock();
+
+            queued_ = pending_.size();
+
+            udp_framing::write_header( write_buffer_.data(), udp_framing::kind::data, count,
+                                       send_sequence_++ );
+
+            sending_ = true;
+            write_started_ = std::chrono::steady_clock::now();
+
+            auto handler = boost::asio::bind_executor(
+                strand_, std::bind( &udp_session::write_complete_handler,
+                                    this->shared_from_this(), std::placeholders::_1,
+                                    std::placeholders::_2 ) );
+
+            if ( connected_ )
+                socket_.async_send( boost::asio::buffer( write_buffer_.data(), used ),
+                                    handler );
+            else
+                socket_.async_send_to( boost::asio::buffer( write_buffer_.data(), used ),
+                                       peer_, handler );
+        }
+
+        void write_complete_handler( boost::system::error_code ec, std::size_t bytes ) {
+
+            sending_ = false;
+
+            if ( ec == boost::asio::error::operation_aborted )
+                return;
+
+            // a refused or unreachable peer may come up later, udp carries on
+            if ( ec )
+                O_LOG_DEBUG( "udp send failed: ", ec.message() );
+
+            {
+                std::lock_guard< std::mutex > stats_lock{ stats().mtx() };
+
+                stats().outbound().data().add( bytes );
+                stats().outbound().latencies().add(
+                    std::chrono::duration_cast< std::chrono::microseconds >(
+                        std::chrono::steady_clock::now() - write_started_ )
+                        .count() );
+            }
+
+            if ( registry_source_ )
+                registry_source_->outbound( bytes );
+
+            maybe_flush();
+        }
+
+        void release( const Message* msg ) {
+
+            if constexpr ( has_release_frame< Message >::value )
+                msg->release_frame();
+
+            if ( on_write_done_ != boost::none )
+                on_write_done_.value()( msg );
+            else
+                allocator_.deallocate( msg );
+        }
+
+        static bool is_text( const Message* msg ) {
+            if constexpr ( has_text_mode< Message >::value )
+                return msg->is_text();
+            else
+                return false;
+        }
+
+        // ----------------   read operations
+
+        void perform_read() {
+
+            if ( read_buffer_.empty() )
+                read_buffer_.resize( udp_framing::max_datagram + 1 );
+
+            auto handler = boost::asio::bind_executor(
+                strand_,
+                std::bind( &udp_session::read_handler, this->shared_from_this(),
+                           std::placeholders::_1, std::placeholders::_2 ) );
+
+            if ( connected_ )
+                socket_.async_receive( boost::asio::buffer( read_buffer_ ), handler );
+            else
+                socket_.async_receive_from( boost::asio::buffer( read_buffer_ ), sender_,
+                                            handler );
+        }
+
+        void read_handler( boost::system::error_code ec, size_t bytes ) {
+
+            O_TRACE_SCOPE( "udp_session::read_handler", nullptr );
+
+            if ( ec == boost::asio::error::operation_aborted || !socket_.is_open() )
+                return;
+
+            // icmp for an earlier datagram, the peer may still come up
+            if ( ec == boost::asio::error::connection_refused ) {
+                perform_read();
+                return;
+            }
+
+            if ( ec ) {
+                status_set( status_t::ABORTED );
+                stats_.set_enabled( false );
+
+                if ( on_read_ != boost::none )
+                    on_read_.value()( ec, nullptr, bytes );
+                return;
+            }
+
+            if ( !connected_ ) {
+
+                bool hello = is_hello( read_buffer_.data(), bytes );
+
+                if ( status() != status_t::ONLINE ) {
+                    peer_ = sender_;
+                    online();
+                    send_control( udp_framing::kind::hello );
+                } else if ( sender_ != peer_ && !hello ) {
+                    perform_read();
+                    return;
+                } else if ( hello ) {
+                    peer_ = sender_;
+                    send_control( udp_framing::kind::hello );
+                }
+            }
+
+            handle_datagram( read_buffer_.data(), bytes );
+
+            if ( status() == status_t::ONLINE )
+                perform_read();
+        }
+
+        static bool is_hello( const char* data, size_t bytes ) {
+
+            udp_framing::kind k;
+            std::uint16_t count;
+            std::uint32_t sequence;
+
+            return udp_framing::read_header( data, bytes, k, count, sequence ) &&
+                   k == udp_framing::kind::hello;
+        }
+
+        void handle_datagram( const char* data, size_t bytes ) {
+
+            udp_framing::kind k;
+            std::uint16_t count;
+            std::uint32_t sequence;
+
+            if ( !udp_framing::read_header( data, bytes, k, count, sequence ) )
+                return;
+
+            if ( k == udp_framing::kind::hello ) {
+                has_sequence_ = false;
+                return;
+            }
+
+            if ( k == udp_framing::kind::bye ) {
+
+                shutdown( false );
+
+                if ( on_read_ != boost::none )
+                    on_read_.value()( boost::asio::error::eof, nullptr, 0 );
+                return;
+            }
+
+            if ( k != udp_framing::kind::data || !accept_sequence( sequence ) )
+                return;
+
+            {
+                std::lock_guard< std::mutex > stats_lock{ stats().mtx() };
+                stats().inbound().data().add( bytes );
+            }
+
+            if ( registry_source_ )
+                registry_source_->inbound( bytes );
+
+            size_t offset = udp_framing::header_size;
+
+            for ( std::uint16_t i = 0; i < count; ++i ) {
+
+                if ( offset + udp_framing::frame_header_size > bytes )
+                    break;
+
+                size_t size = udp_framing::get( data + offset, 2 );
+                bool text = ( data[offset + 2] & udp_framing::text_flag ) != 0;
+
+                offset += udp_framing::frame_header_size;
+
+                if ( offset + size > bytes )
+                    break;
+
+                deliver( data + offset, size, text );
+                offset += size;
+            }
+        }
+
+        // count loss and reordering, false if the datagram should be dropped
+        bool accept_sequence( std::uint32_t sequence ) {
+
+            if ( !has_sequence_ ) {
+                has_sequence_ = true;
+                next_sequence_ = sequence + 1;
+                received_ = 1;
+                return true;
+            }
+
+            auto ahead = udp_framing::distance( next_sequence_, sequence );
+
+            // a restarted peer that missed its hello
+            if ( ahead < -udp_framing::resync_distance ) {
+                has_sequence_ = false;
+                return accept_sequence( sequence );
+            }
+
+            std::lock_guard< std::mutex > stats_lock{ stats().mtx() };
+
+            if ( ahead >= 0 ) {
+                stats().add_lost( static_cast< unsigned long long >( ahead ) );
+                next_sequence_ = sequence + 1;
+                received_ = ahead < 63 ? ( received_ << ( ahead + 1 ) ) | 1 : 1;
+                return true;
+            }
+
+            // bit n of received_ stands for next_sequence_ - 1 - n
+            auto behind = -static_cast< std::int64_t >( ahead ) - 1;
+
+            if ( behind < 64 ) {
+                auto bit = std::uint64_t( 1 ) << behind;
+
+                // duplicates neither fill a gap nor get delivered twice
+                if ( received_ & bit )
+                    return false;
+
+                received_ |= bit;
+            }
+
+            stats().add_reordered();
+            return !latest_value_;
+        }
+
+        void deliver( const char* data, size_t size, bool text ) {
+
+            {
+                std::lock_guard< std::mutex > stats_lock{ stats().mtx() };
+                stats().inbound().msgs()++;
+                stats().inbound().sizes().add( size );
+            }
+
+            if ( on_read_ == boost::none )
+                return;
+
+            Message* msg = static_cast< Message* >( allocator_.allocate() );
+
+            if constexpr ( has_codec_support< Message >::value )
+                msg->set_codec( codec_ );
+
+            Message::from_const_buffers( boost::asio::buffer( data, size ), msg, text );
+
+            on_read_.value()( boost::system::error_code{}, msg, size );
+        }
+
+        boost::asio::io_context& ctx_;
+        boost::asio::io_context::strand strand_;
+
+        boost::asio::ip::udp::socket socket_;
+        endpoint_type local_;
+        endpoint_type peer_;
+        endpoint_type sender_;
+        bool connected_ = false;
+
+        typename Message::factory& allocator_;
+
+        session_stats< unsigned long long, std::chrono::system_clock > stats_;
+        std::string stats_name_;
+        std::shared_ptr< stats_registry::source > registry_source_;
+
+        boost::optional< read_completion_handler_t > on_read_;
+        boost::optional< write_completion_handler_t > on_write_done_;
+        boost::optional< basic_completion_handler_t > on_close_;
+        boost::optional< basic_completion_handler_t > on_ready_;
+
+        std::deque< const Message* > pending_;
+        size_t pending_bytes_ = 0;
+        std::atomic< size_t > queued_{ 0 };
+        std::vector< char > write_buffer_;
+        bool sending_ = false;
+        std::uint32_t send_sequence_ = 0;
+        std::chrono::steady_clock::time_point write_started_;
+
+        bool latest_value_ = false;
+        size_t batch_bytes_ = 0;
+        std::chrono::microseconds batch_delay_{ 0 };
+        boost::asio::steady_timer batch_timer_{ ctx_ };
+        bool batch_timer_armed_ = false;
+
+        std::vector< char > read_buffer_;
+        bool has_sequence_ = false;
+        std::uint32_t next_sequence_ = 0;
+        std::uint64_t received_ = 0;
+
+        socket_options socket_options_;
+
+        std::atomic< int >* msg_pool_refc;
+
+        o::codec codec_ = o::codec::protobuf_v1;
+    };
+} // namespace o
@@ -26,8 +26,10 @@
 #pragma once
 
 #include "c74_min.h"
+#include "codecs/json_atoms.h"
 #include "ohlano.h"
 #include "proto_message_base.h"
+#include "wire_atoms_decoder.h"
 #include "generated/generic_max.pb.h"
 
 namespace o {
@@ -65,6 +67,12 @@ namespace o {
       public:
         typedef max_message_allocator factory;
 
+        /// decoders for binary (protobuf) and text (JSON) frames
+        struct atoms_decoder {
+            wire_atoms_decoder wire;
+            json_atoms_decoder json;
+        };
+
         void push_atom( c74::min::atom atom_in ) {
 
             auto new_atom = proto()->add_atom();
@@ -163,5 +171,32 @@ namespace o {
 
             return out_atoms;
         }
+
+        /// decode the wire data into out without calling deserialize() first
+        bool decode_atoms( atoms_decoder& decoder, c74::min::atoms& out ) const {
+            if ( is_text() )
+                return decoder.json.decode( data(), size(), out );
+
+            return decoder.wire.decode( data(), size(), out );
+        }
+
+        /// decode the message and pass the atoms to handler
+        template < typename Handler >
+        bool visit_atoms( atoms_decoder& decoder, c74::min::atoms& out,
+                          Handler&& handler ) const {
+            if ( !decode_atoms( decoder, out ) )
+                return false;
+
+            handler( out );
+            return true;
+        }
+
+        /// write atms as a JSON array text frame instead of a protobuf message
+        void serialize_json( const c74::min::atoms& atms ) {
+            release_frame();
+            storage().clear();
+            json_encode_atoms( atms, storage() );
+            set_text( true );
+        }
     };
 }
@@ -68,7 +68,7 @@ class iiwa_movement_message : public proto_message_base< iiwa::Movement > {
     template < typename T, typename... Ts >
     void add_joints( T current, Ts... rest ) {
         proto()->mutable_jointpositions()->add_joints( current );
-        set_joints( rest... );
+        add_joints( rest... );
     }
 
     void set_direction( bool direction ) const {}
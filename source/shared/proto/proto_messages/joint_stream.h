@@ -0,0 +1,283 @@
+//
+// This file is part of the Max Network Extensions Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../proto/generated/JointStream.pb.h"
+#include "../proto/generated/Movement.pb.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace iiwa = de::hsmainz::iiwa::messages::protocolbuffers;
+
+namespace o {
+
+    /// quantized joint positions of one frame of a joint stream
+    template < size_t Joints >
+    struct joint_stream_frame {
+        std::uint32_t sequence = 0;
+        std::array< std::int32_t, Joints > positions{};
+    };
+
+    /**
+     * Encodes consecutive joint positions as deltas of fixed-point quantized
+     * values against a reference frame.
+     *
+     * Over a reliable, ordered transport (websockets) every frame can be
+     * referenced as soon as it was sent. For lossy transports set
+     * wait_for_ack so that only frames confirmed with acknowledge() are used
+     * as reference. A keyframe with absolute positions is sent whenever no
+     * reference is available and every keyframe_interval frames for resync.
+     * The quantum is only sent in keyframes.
+     */
+    template < size_t Joints = 7 >
+    class joint_stream_encoder {
+      public:
+        using frame = joint_stream_frame< Joints >;
+
+        static constexpr size_t history_size = 64;
+
+        /// quantized positions are clamped to this, so deltas between them fit into int32
+        static constexpr std::int32_t max_quantized =
+            std::numeric_limits< std::int32_t >::max() / 2;
+
+        /// joint positions up to this many radians must be representable
+        static constexpr double max_position = 6.283185307179586;
+
+        /// false if quantum is too small to represent +-2 pi, the old quantum stays in place
+        bool set_quantum( double quantum ) {
+
+            if ( !( quantum * max_quantized >= max_position ) )
+                return false;
+
+            if ( quantum != quantum_ ) {
+                quantum_ = quantum;
+                reset();
+            }
+
+            return true;
+        }
+
+        double quantum() const { return quantum_; }
+
+        void set_keyframe_interval( std::uint32_t interval ) { keyframe_interval_ = interval; }
+
+        void set_wait_for_ack( bool wait ) {
+            wait_for_ack_ = wait;
+            reset();
+        }
+
+        /// the next frame will be a keyframe
+        void reset() {
+            has_reference_ = false;
+            since_keyframe_ = 0;
+        }
+
+        /// mark a sent frame as received by the peer
+        void acknowledge( std::uint32_t sequence ) {
+
+            // ignore acks for frames older than the current reference
+            if ( has_reference_ &&
+                 static_cast< std::int32_t >( sequence - reference_.sequence ) <= 0 )
+                return;
+
+            const frame& sent = history_[sequence % history_size];
+
+            if ( sent.sequence == sequence && sequence_ - sequence <= history_size ) {
+                reference_ = sent;
+                has_reference_ = true;
+            }
+        }
+
+        /**
+         * encode positions into out. Joint and filter parameters are only
+         * included in keyframes or if they changed since the last frame.
+         */
+        void encode( const std::array< double, Joints >& positions,
+                     const iiwa::Movement::JointParameter& joint_params,
+                     const iiwa::Movement::FilterParameter& filter_params,
+                     iiwa::JointStream* out ) {
+
+            frame current;
+            current.sequence = ++sequence_;
+
+            for ( size_t i = 0; i < Joints; ++i ) {
+                double quantized = std::round( positions[i] / quantum_ );
+
+                // nan ends up as 0, anything out of range at the limit
+                current.positions[i] =
+                    quantized == quantized
+                        ? static_cast< std::int32_t >( std::clamp(
+                              quantized, -double( max_quantized ), double( max_quantized ) ) )
+                        : 0;
+            }
+
+            bool keyframe = !has_reference_ || ( keyframe_interval_ > 0 &&
+                                                 since_keyframe_ >= keyframe_interval_ );
+
+            out->Clear();
+            out->set_sequence( current.sequence );
+            out->set_keyframe( keyframe );
+
+            auto values = out->mutable_positions();
+            values->Reserve( static_cast< int >( Joints ) );
+
+            if ( keyframe ) {
+                out->set_quantum( quantum_ );
+                for ( auto value : current.positions )
+                    values->AddAlreadyReserved( value );
+                since_keyframe_ = 0;
+            } else {
+                out->set_reference( reference_.sequence );
+                for ( size_t i = 0; i < Joints; ++i )
+                    values->AddAlreadyReserved( current.positions[i] -
+                                                reference_.positions[i] );
+            }
+
+            ++since_keyframe_;
+
+            if ( keyframe || !equal_params( joint_params, last_joint_params_ ) ) {
+                *out->mutable_jointparameter() = joint_params;
+                last_joint_params_ = joint_params;
+            }
+
+            if ( keyframe || !equal_params( filter_params, last_filter_params_ ) ) {
+                *out->mutable_filterparameter() = filter_params;
+                last_filter_params_ = filter_params;
+            }
+
+            history_[current.sequence % history_size] = current;
+
+            if ( !wait_for_ack_ ) {
+                reference_ = current;
+                has_reference_ = true;
+            }
+        }
+
+      private:
+        static bool equal_params( const iiwa::Movement::JointParameter& lhs,
+                                  const iiwa::Movement::JointParameter& rhs ) {
+            return lhs.jointvelocity() == rhs.jointvelocity() &&
+                   lhs.jointaccelerationrel() == rhs.jointaccelerationrel() &&
+                   lhs.jointjerkrel() == rhs.jointjerkrel() &&
+                   lhs.blendingrel() == rhs.blendingrel();
+        }
+
+        static bool equal_params( const iiwa::Movement::FilterParameter& lhs,
+                                  const iiwa::Movement::FilterParameter& rhs ) {
+            return lhs.stepsize() == rhs.stepsize() && lhs.friction() == rhs.friction() &&
+                   lhs.epsilon() == rhs.epsilon();
+        }
+
+        double quantum_ = 1e-5;
+        std::uint32_t keyframe_interval_ = 500;
+        bool wait_for_ack_ = false;
+
+        std::uint32_t sequence_ = 0;
+        std::uint32_t since_keyframe_ = 0;
+
+        bool has_reference_ = false;
+        frame reference_;
+
+        std::array< frame, history_size > history_{};
+
+        iiwa::Movement::JointParameter last_joint_params_;
+        iiwa::Movement::FilterParameter last_filter_params_;
+    };
+
+    /// the receiving side of a joint stream, mirrors joint_stream_encoder
+    template < size_t Joints = 7 >
+    class joint_stream_decoder {
+      public:
+        using frame = joint_stream_frame< Joints >;
+
+        static constexpr size_t history_size = 64;
+
+        /**
+         * apply a frame and write the positions to out. Returns false if the
+         * frame is malformed or refers to a frame we do not know; the caller
+         * should then wait for the next keyframe. Deltas use the quantum of
+         * the last keyframe. Positions beyond max_quantized are malformed.
+         */
+        bool decode( const iiwa::JointStream& in, std::array< double, Joints >& out ) {
+
+            if ( in.positions_size() != static_cast< int >( Joints ) )
+                return false;
+
+            frame current;
+            current.sequence = in.sequence();
+
+            if ( in.keyframe() ) {
+                if ( in.quantum() <= 0 )
+                    return false;
+
+                quantum_ = in.quantum();
+
+                for ( size_t i = 0; i < Joints; ++i ) {
+                    if ( !in_range( in.positions( static_cast< int >( i ) ) ) )
+                        return false;
+                    current.positions[i] = in.positions( static_cast< int >( i ) );
+                }
+            } else {
+                const frame& reference = history_[in.reference() % history_size];
+
+                if ( !has_frames_ || reference.sequence != in.reference() )
+                    return false;
+
+                for ( size_t i = 0; i < Joints; ++i ) {
+                    // deltas come off the wire, add them without overflowing
+                    std::int64_t position =
+                        std::int64_t( reference.positions[i] ) +
+                        std::int64_t( in.positions( static_cast< int >( i ) ) );
+                    if ( !in_range( position ) )
+                        return false;
+                    current.positions[i] = static_cast< std::int32_t >( position );
+                }
+            }
+
+            for ( size_t i = 0; i < Joints; ++i )
+                out[i] = current.positions[i] * quantum_;
+
+            history_[current.sequence % history_size] = current;
+            has_frames_ = true;
+
+            return true;
+        }
+
+      private:
+        static bool in_range( std::int64_t position ) {
+            constexpr auto max_quantized = joint_stream_encoder< Joints >::max_quantized;
+            return position >= -max_quantized && position <= max_quantized;
+        }
+
+        bool has_frames_ = false;
+        double quantum_ = 0;
+        std::array< frame, history_size > history_{};
+    };
+} // namespace o
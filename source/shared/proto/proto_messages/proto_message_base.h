@@ -25,13 +25,22 @@
 
 #pragma once
 
+#include "devices/frame_buffer_pool.h"
+#include "devices/small_buffer.h"
+#include "devices/trace.h"
+
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/buffers_iterator.hpp>
+#include <boost/beast/core.hpp>
 #include <google/protobuf/message.h>
 
-template < typename ProtoMessage > class proto_message_base {
+#include <climits>
+
+/// message storage stays inline up to InlineCapacity bytes and spills to the heap above
+template < typename ProtoMessage, size_t InlineCapacity = 128 > class proto_message_base {
   public:
     using proto_msg_type = ProtoMessage;
+    using storage_type = o::small_buffer< InlineCapacity >;
 
     proto_message_base() { mess_ = new ProtoMessage(); }
 
@@ -41,39 +50,81 @@ template < typename ProtoMessage > class proto_message_base {
     static void from_const_buffers(ConstBufferSequence buffers, proto_message_base* msg,
                                    bool text) {
 
-        if (!text) {
-            msg->data_.reserve(boost::asio::buffer_size(buffers));
-
-            for (const auto& buffer : boost::beast::detail::buffers_range(buffers)) {
-                std::copy(boost::asio::buffers_begin(buffer),
-                          boost::asio::buffers_end(buffer),
-                          std::back_inserter(msg->data_));
-            }
-        }
+        msg->release_frame();
+        msg->text_ = text;
+        msg->data_.resize(boost::asio::buffer_size(buffers));
+        boost::asio::buffer_copy(
+            boost::asio::buffer(msg->data_.data(), msg->data_.size()), buffers);
     }
 
-    std::string& vect() { return data_; }
+    /// true if the data is a text frame (JSON) instead of a serialized protobuf
+    bool is_text() const { return text_; }
+
+    void set_text(bool text) { text_ = text; }
+
+    storage_type& vect() { return data_; }
+
+    storage_type& storage() { return data_; }
 
     ProtoMessage*& proto() { return mess_; }
 
     ProtoMessage* const& const_proto() const { return mess_; }
 
-    const std::string::value_type* data() const { return data_.data(); }
+    const char* data() const { return frame_ ? frame_.data() : data_.data(); }
 
-    size_t size() const { return data_.size(); }
+    size_t size() const { return frame_ ? frame_size_ : data_.size(); }
 
+    /// serialize into the inline storage if the message is small enough or into
+    /// a frame buffer borrowed from the calling threads pool otherwise
     bool serialize() {
-        data_.reserve(mess_->ByteSizeLong());
-        return mess_->SerializeToString(&data_);
+
+        release_frame();
+        text_ = false;
+
+        // computes and caches the sizes of all submessages
+        size_t size = mess_->ByteSizeLong();
+
+        if (size > INT_MAX)
+            return false;
+
+        google::protobuf::uint8* target;
+
+        if (size <= InlineCapacity) {
+            data_.resize(size);
+            target = reinterpret_cast<google::protobuf::uint8*>(data_.data());
+        } else {
+            frame_ = o::frame_buffer_pool::local().acquire(size);
+            frame_size_ = size;
+            target = reinterpret_cast<google::protobuf::uint8*>(frame_.data());
+        }
+
+        mess_->SerializeWithCachedSizesToArray(target);
+
+        return true;
     }
 
     bool deserialize() {
-        return mess_->ParsePartialFromArray(data_.data(), (int)data_.size());
+        O_TRACE_SCOPE("deserialize", this);
+        return !text_ && mess_->ParsePartialFromArray(data(), (int)size());
+    }
+
+    /// return the frame buffer to the pool of the calling thread. The session
+    /// calls this from its write strand once the frame was written.
+    void release_frame() const {
+        if (frame_) {
+            o::frame_buffer_pool::local().release(std::move(frame_));
+            frame_size_ = 0;
+        }
     }
 
   private:
     ProtoMessage* mess_;
-    std::string data_;
+    storage_type data_;
+
+    mutable o::frame_buffer frame_;
+    mutable size_t frame_size_ = 0;
+
+    bool text_ = false;
 };
 
 class basic_proto_message {
@@ -0,0 +1,242 @@
+//
+// This file is part of the Max Network Extensions Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "c74_min.h"
+#include "generated/generic_max.pb.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <string>
+
+namespace o {
+
+    /**
+     * Decodes serialized generic_max messages straight into a c74::min::atoms
+     * vector without materializing the protobuf object tree. Reuse one decoder
+     * and one atoms vector per output to avoid allocations after warm-up.
+     */
+    class wire_atoms_decoder {
+
+        using wire = google::protobuf::internal::WireFormatLite;
+        using input_stream = google::protobuf::io::CodedInputStream;
+
+        // field numbers from generic_max.proto
+        enum fields : int {
+            GENERIC_MAX_ATOM = 1,
+            ATOM_TYPE = 1,
+            ATOM_INT = 2,
+            ATOM_FLOAT = 3,
+            ATOM_STRING = 4,
+            ATOM_INT_ARRAY = 5,
+            ATOM_FLOAT_ARRAY = 6,
+            ARRAY_VALUES = 1
+        };
+
+      public:
+        wire_atoms_decoder() { scratch_.reserve( 64 ); }
+
+        /// decode the wire bytes in data into out, out is cleared first
+        bool decode( const void* data, size_t size, c74::min::atoms& out ) {
+
+            out.clear();
+
+            input_stream input( static_cast< const google::protobuf::uint8* >( data ),
+                                static_cast< int >( size ) );
+
+            while ( auto tag = input.ReadTag() ) {
+
+                if ( wire::GetTagFieldNumber( tag ) == GENERIC_MAX_ATOM &&
+                     wire::GetTagWireType( tag ) ==
+                         wire::WIRETYPE_LENGTH_DELIMITED ) {
+
+                    if ( !decode_atom( input, out ) )
+                        return false;
+
+                } else if ( !wire::SkipField( &input, tag ) ) {
+                    return false;
+                }
+            }
+
+            return input.ConsumedEntireMessage();
+        }
+
+      private:
+        bool decode_atom( input_stream& input, c74::min::atoms& out ) {
+
+            google::protobuf::uint32 length;
+
+            if ( !input.ReadVarint32( &length ) )
+                return false;
+
+            auto limit = input.PushLimit( static_cast< int >( length ) );
+
+            int type = A_LONG;
+            bool has_data = false;
+
+            while ( auto tag = input.ReadTag() ) {
+
+                google::protobuf::uint32 value;
+
+                switch ( wire::GetTagFieldNumber( tag ) ) {
+                case ATOM_TYPE:
+                    if ( !input.ReadVarint32( &value ) )
+                        return false;
+                    type = static_cast< int >( value );
+                    break;
+                case ATOM_INT:
+                    if ( !input.ReadVarint32( &value ) )
+                        return false;
+                    out.emplace_back( static_cast< c74::max::t_atom_long >(
+                        wire::ZigZagDecode32( value ) ) );
+                    has_data = true;
+                    break;
+                case ATOM_FLOAT:
+                    if ( !input.ReadLittleEndian32( &value ) )
+                        return false;
+                    out.emplace_back(
+                        static_cast< c74::max::t_atom_float >( wire::DecodeFloat( value ) ) );
+                    has_data = true;
+                    break;
+                case ATOM_STRING:
+                    if ( !input.ReadVarint32( &value ) ||
+                         !input.ReadString( &scratch_, static_cast< int >( value ) ) )
+                        return false;
+                    out.emplace_back( c74::min::symbol( scratch_.c_str() ) );
+                    has_data = true;
+                    break;
+                case ATOM_INT_ARRAY:
+                    if ( !decode_array( input, out, false ) )
+                        return false;
+                    has_data = true;
+                    break;
+                case ATOM_FLOAT_ARRAY:
+                    if ( !decode_array( input, out, true ) )
+                        return false;
+                    has_data = true;
+                    break;
+                default:
+                    if ( !wire::SkipField( &input, tag ) )
+                        return false;
+                }
+            }
+
+            if ( !input.ConsumedEntireMessage() )
+                return false;
+
+            input.PopLimit( limit );
+
+            // proto3 omits default values, mirror max_message::get_atoms() here
+            if ( !has_data ) {
+                switch ( type ) {
+                case A_LONG:
+                    out.emplace_back( static_cast< c74::max::t_atom_long >( 0 ) );
+                    break;
+                case A_FLOAT:
+                    out.emplace_back( static_cast< c74::max::t_atom_float >( 0 ) );
+                    break;
+                case A_SYMBOL:
+                    out.emplace_back( c74::min::symbol( "" ) );
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            return true;
+        }
+
+        bool decode_array( input_stream& input, c74::min::atoms& out, bool floats ) {
+
+            google::protobuf::uint32 length;
+
+            if ( !input.ReadVarint32( &length ) )
+                return false;
+
+            auto limit = input.PushLimit( static_cast< int >( length ) );
+
+            while ( auto tag = input.ReadTag() ) {
+
+                if ( wire::GetTagFieldNumber( tag ) != ARRAY_VALUES ) {
+                    if ( !wire::SkipField( &input, tag ) )
+                        return false;
+                    continue;
+                }
+
+                if ( wire::GetTagWireType( tag ) == wire::WIRETYPE_LENGTH_DELIMITED ) {
+
+                    // packed encoding, the default for repeated scalars in proto3
+                    google::protobuf::uint32 packed_length;
+
+                    if ( !input.ReadVarint32( &packed_length ) )
+                        return false;
+
+                    auto packed_limit = input.PushLimit( static_cast< int >( packed_length ) );
+
+                    if ( floats )
+                        out.reserve( out.size() + packed_length / 4 );
+
+                    while ( input.BytesUntilLimit() > 0 ) {
+                        if ( !read_array_value( input, out, floats ) )
+                            return false;
+                    }
+
+                    input.PopLimit( packed_limit );
+
+                } else if ( !read_array_value( input, out, floats ) ) {
+                    return false;
+                }
+            }
+
+            if ( !input.ConsumedEntireMessage() )
+                return false;
+
+            input.PopLimit( limit );
+            return true;
+        }
+
+        bool read_array_value( input_stream& input, c74::min::atoms& out, bool floats ) {
+
+            if ( floats ) {
+                google::protobuf::uint32 value;
+                if ( !input.ReadLittleEndian32( &value ) )
+                    return false;
+                out.emplace_back(
+                    static_cast< c74::max::t_atom_float >( wire::DecodeFloat( value ) ) );
+            } else {
+                google::protobuf::uint64 value;
+                if ( !input.ReadVarint64( &value ) )
+                    return false;
+                out.emplace_back( static_cast< c74::max::t_atom_long >( value ) );
+            }
+
+            return true;
+        }
+
+        std::string scratch_;
+    };
+} // namespace o
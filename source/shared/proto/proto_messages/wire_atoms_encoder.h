@@ -0,0 +1,139 @@
+//
+// This file is part of the Max Network Extensions Project
+//
+// Copyright (c) 2019, Jonas Ohland
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "c74_min.h"
+#include "generated/generic_max.pb.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <cstring>
+
+namespace o {
+
+    /**
+     * Encodes atoms as a serialized generic_max message without building the
+     * protobuf object, the counterpart of wire_atoms_decoder. Longs are
+     * truncated to the 32 bit int_ field just like max_message::push_atom().
+     */
+    class wire_atoms_encoder {
+
+        using wire = google::protobuf::internal::WireFormatLite;
+        using output_stream = google::protobuf::io::CodedOutputStream;
+        using uint8 = google::protobuf::uint8;
+        using uint32 = google::protobuf::uint32;
+
+      public:
+        /// resize storage to the encoded size and write atms into it
+        template < typename Storage >
+        static void encode( const c74::min::atoms& atms, Storage& storage ) {
+
+            size_t size = 0;
+
+            for ( const auto& atm : atms ) {
+                if ( !is_supported( atm ) )
+                    continue;
+                size_t inner = atom_size( atm );
+                size += 1 + output_stream::VarintSize32( static_cast< uint32 >( inner ) ) +
+                        inner;
+            }
+
+            storage.resize( size );
+
+            auto out = reinterpret_cast< uint8* >( storage.data() );
+
+            for ( const auto& atm : atms ) {
+                if ( is_supported( atm ) )
+                    out = write_atom( atm, out );
+            }
+        }
+
+      private:
+        static bool is_supported( const c74::min::atom& atm ) {
+            return atm.a_type == c74::max::e_max_atomtypes::A_LONG ||
+                   atm.a_type == c74::max::e_max_atomtypes::A_FLOAT ||
+                   atm.a_type == c74::max::e_max_atomtypes::A_SYM;
+        }
+
+        static uint32 zigzag( const c74::min::atom& atm ) {
+            return wire::ZigZagEncode32(
+                static_cast< google::protobuf::int32 >( static_cast< long long >( atm ) ) );
+        }
+
+        static size_t atom_size( const c74::min::atom& atm ) {
+
+            switch ( atm.a_type ) {
+            case c74::max::e_max_atomtypes::A_LONG:
+                return 1 + output_stream::VarintSize32( zigzag( atm ) );
+            case c74::max::e_max_atomtypes::A_FLOAT:
+                return 2 + 1 + 4;
+            case c74::max::e_max_atomtypes::A_SYM: {
+                c74::min::symbol sym = atm;
+                auto length = static_cast< uint32 >( std::strlen( sym.c_str() ) );
+                return 2 + 1 + output_stream::VarintSize32( length ) + length;
+            }
+            default:
+                return 0;
+            }
+        }
+
+        static uint8* write_atom( const c74::min::atom& atm, uint8* out ) {
+
+            out = wire::WriteTagToArray( 1, wire::WIRETYPE_LENGTH_DELIMITED, out );
+            out = output_stream::WriteVarint32ToArray(
+                static_cast< uint32 >( atom_size( atm ) ), out );
+
+            switch ( atm.a_type ) {
+            case c74::max::e_max_atomtypes::A_LONG:
+                // A_LONG is the default type and therefore omitted
+                out = wire::WriteTagToArray( 2, wire::WIRETYPE_VARINT, out );
+                out = output_stream::WriteVarint32ToArray( zigzag( atm ), out );
+                break;
+            case c74::max::e_max_atomtypes::A_FLOAT:
+                out = wire::WriteTagToArray( 1, wire::WIRETYPE_VARINT, out );
+                out = output_stream::WriteVarint32ToArray( A_FLOAT, out );
+                out = wire::WriteFloatToArray( 3, static_cast< float >( atm ), out );
+                break;
+            case c74::max::e_max_atomtypes::A_SYM: {
+                c74::min::symbol sym = atm;
+                auto length = static_cast< uint32 >( std::strlen( sym.c_str() ) );
+                out = wire::WriteTagToArray( 1, wire::WIRETYPE_VARINT, out );
+                out = output_stream::WriteVarint32ToArray( A_SYMBOL, out );
+                out = wire::WriteTagToArray( 4, wire::WIRETYPE_LENGTH_DELIMITED, out );
+                out = output_stream::WriteVarint32ToArray( length, out );
+                std::memcpy( out, sym.c_str(), length );
+                out += length;
+                break;
+            }
+            default:
+                break;
+            }
+
+            return out;
+        }
+    };
+} // namespace o
@@ -23,12 +23,14 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <fstream>
 #include <mutex>
 #include <thread>
 
 #include "devices/protobuf_decoder_worker.h"
 #include "net_url.h"
 #include "session.h"
+#include "udp_session.h"
 
 #include "proto_messages/generic_max_message.h"
 #include "proto_messages/proto_message_base.h"
@@ -50,6 +52,7 @@ class websocketclient : public object< websocketclient > {
     using websocket_connection =
         o::session< boost::beast::websocket::stream< boost::asio::ip::tcp::socket >,
                          o::max_message, o::sessions::roles::client >;
+    using udp_connection = o::udp_session< o::max_message, o::sessions::roles::client >;
 
     MIN_DESCRIPTION{ "WebSockets for Max! (Client)" };
     MIN_TAGS{ "net" };
@@ -120,7 +123,7 @@ class websocketclient : public object< websocketclient > {
 
                 client_thread_ptr = std::make_unique< std::thread >( [this]() {
                     io_context_.run();
-                    cout << "finished running network io worker thread" << endl;
+                    console_adapter( "finished running network io worker thread" );
                 } );
 
                 make_connection( url );
@@ -137,10 +140,10 @@ class websocketclient : public object< websocketclient > {
 
         if ( !url.is_resolved() ) {
             resolver.resolve( url, [=]( boost::system::error_code ec, net_url<> _url ) {
-                cout << "resolver results: " << c74::min::endl;
+                console_adapter( "resolver results:" );
 
                 for ( auto& endp : _url.endpoints() ) {
-                    cout << endp.address().to_string() << c74::min::endl;
+                    console_adapter( endp.address().to_string() );
                 }
 
                 perform_connect( _url );
@@ -152,38 +155,70 @@ class websocketclient : public object< websocketclient > {
 
     void perform_connect( net_url<> url ) {
 
+        if ( transport_udp_ ) {
+            perform_udp_connect( url );
+            return;
+        }
+
         connection_ =
             std::make_shared< websocket_connection >( io_context_, allocator_, &refc );
 
+        connection_->set_socket_options( socket_options_ );
+        connection_->set_stream_tuning( stream_tuning_ );
+        connection_->set_keepalive( std::chrono::milliseconds( ping_interval_ms_ ),
+                                    max_missed_pongs_ );
+        connection_->set_latency_probes( std::chrono::milliseconds( latency_probe_ms_ ) );
+        connection_->set_send_stamps( send_stamps_ );
+        connection_->set_codecs( codecs_ );
+
         connection_->on_ready( [=,
                                 con = connection_.get()]( boost::system::error_code ec ) {
-            cout << "session is ready status: " << con->status_string() << c74::min::endl;
+            console_adapter( "session is ready status:", con->status_string(),
+                             "codec:", o::codec_name( con->codec() ) );
         } );
 
         connection_->on_close( [=]( boost::system::error_code ec ) {
-            cout << "session closed: " << ec.value() << c74::min::endl;
+            console_adapter( "session closed:", ec.value() );
         } );
 
-        connection_->on_read(
-            [=]( boost::system::error_code ec, o::max_message* msg, size_t bytes ) {
-                if ( ec ) {
-                    cerr << "read operation failed: " << ec.message() << c74::min::endl;
-                    return;
-                }
+        connection_->on_read( std::bind( &websocketclient::handle_read, this, _1, _2, _3 ) );
 
-                try {
-                    if ( !msg->deserialize() ) {
-                        cerr << "could not deserialize message" << c74::min::endl;
-                    }
-                } catch ( ... ) {
-                    cerr << "could not deserialize message" << c74::min::endl;
-                }
+        connection_->connect( url );
+    }
 
-                output_.write( msg );
-                allocator_.deallocate( msg );
-            } );
+    void perform_udp_connect( net_url<> url ) {
 
-        connection_->connect( url );
+        udp_connection_ = std::make_shared< udp_connection >( io_context_, allocator_, &refc );
+
+        udp_connection_->set_socket_options( socket_options_ );
+        udp_connection_->set_latest_value( latest_value_ );
+        udp_connection_->set_batching( batching_bytes_ );
+
+        udp_connection_->on_ready( [=, con = udp_connection_.get()](
+                                       boost::system::error_code ec ) {
+            console_adapter( "udp session is ready status:", con->status_string() );
+        } );
+
+        udp_connection_->on_close( [=]( boost::system::error_code ec ) {
+            console_adapter( "udp session closed:", ec.value() );
+        } );
+
+        udp_connection_->on_read( std::bind( &websocketclient::handle_read, this, _1, _2, _3 ) );
+
+        udp_connection_->connect( url );
+    }
+
+    void handle_read( boost::system::error_code ec, o::max_message* msg, size_t bytes ) {
+        if ( ec ) {
+            console_error_adapter( "read operation failed:", ec.message() );
+            return;
+        }
+
+        if ( !output_.write( msg ) ) {
+            console_error_adapter( "could not decode message" );
+        }
+
+        allocator_.deallocate( msg );
     }
 
     ~websocketclient() {
@@ -192,6 +227,10 @@ class websocketclient : public object< websocketclient > {
             connection_->close();
         }
 
+        if ( udp_connection_ ) {
+            udp_connection_->close();
+        }
+
         if ( work.owns_work() ) {
             work.reset();
         }
@@ -208,14 +247,121 @@ class websocketclient : public object< websocketclient > {
     atoms report_status( const atoms& args, int inlet ) {
         if ( connection_ ) {
             status_out.send( connection_->status_string() );
+        } else if ( udp_connection_ ) {
+            status_out.send( udp_connection_->status_string() );
         } else {
             status_out.send( "no_connection" );
         }
         return args;
     }
 
+    // trace 1 / trace 0 starts and stops recording, trace dump <file> writes chrome trace json
+    atoms handle_trace( const atoms& args, int inlet ) {
+#ifdef MAXNET_ENABLE_TRACING
+        if ( args.empty() )
+            return args;
+
+        if ( args[0].a_type != c74::max::e_max_atomtypes::A_SYM ) {
+            o::trace::set_enabled( static_cast< int >( args[0] ) != 0 );
+            return args;
+        }
+
+        std::string command = args[0];
+
+        if ( command == "clear" ) {
+            o::trace::global_ring().clear();
+        } else if ( command == "dump" && args.size() > 1 ) {
+
+            std::string path = args[1];
+            std::ofstream file{ path };
+
+            if ( !file ) {
+                cerr << "could not open " << path << c74::min::endl;
+                return args;
+            }
+
+            o::trace::write_chrome_json( file );
+            cout << "wrote " << o::trace::global_ring().recorded() << " trace events to "
+                 << path << c74::min::endl;
+        }
+#else
+        cerr << "this build was made without MAXNET_ENABLE_TRACING" << c74::min::endl;
+#endif
+        return args;
+    }
+
+    // stats [n] sends the process-wide traffic totals and the n busiest peers as a dict
+    // out of the status outlet, stats reset clears them
+    atoms report_stats( const atoms& args, int inlet ) {
+
+        size_t top_n = 10;
+
+        if ( !args.empty() ) {
+            if ( args[0].a_type == c74::max::e_max_atomtypes::A_SYM ) {
+                if ( std::string( args[0] ) == "reset" )
+                    o::stats_registry::global().reset();
+                return args;
+            }
+
+            top_n = static_cast< size_t >( std::max( static_cast< int >( args[0] ), 0 ) );
+        }
+
+        auto report = o::stats_registry::global().snapshot( top_n );
+
+        dict out{ symbol( true ) };
+
+        out["sessions"] = static_cast< c74::max::t_atom_long >( report.sessions );
+        out["in_bytes"] = static_cast< c74::max::t_atom_long >( report.in_bytes );
+        out["in_msgs"] = static_cast< c74::max::t_atom_long >( report.in_msgs );
+        out["out_bytes"] = static_cast< c74::max::t_atom_long >( report.out_bytes );
+        out["out_msgs"] = static_cast< c74::max::t_atom_long >( report.out_msgs );
+        out["read_buffer_bytes"] =
+            static_cast< c74::max::t_atom_long >( report.read_buffer_bytes );
+
+        if ( connection_ ) {
+            std::lock_guard< std::mutex > lock{ connection_->stats().mtx() };
+            out["rtt_ms"] = connection_->stats().smoothed_rtt() / 1000.;
+            out["clock_offset_ms"] = connection_->stats().clock_offset() / 1000.;
+            out["jitter_in_ms"] = connection_->stats().inbound().jitter() / 1000.;
+            out["jitter_out_ms"] = connection_->stats().outbound().jitter() / 1000.;
+        }
+
+        if ( udp_connection_ ) {
+            auto& session_stats = udp_connection_->stats();
+            std::lock_guard< std::mutex > lock{ session_stats.mtx() };
+            out["jitter_in_ms"] = session_stats.inbound().jitter() / 1000.;
+            out["lost"] = static_cast< c74::max::t_atom_long >( session_stats.lost() );
+            out["reordered"] = static_cast< c74::max::t_atom_long >( session_stats.reordered() );
+            out["superseded"] =
+                static_cast< c74::max::t_atom_long >( session_stats.superseded() );
+        }
+
+        // the top list as parallel arrays, busiest first
+        atoms names;
+        atoms bytes;
+        atoms errors;
+
+        for ( auto& hitter : report.top ) {
+            names.emplace_back( symbol( hitter.key ) );
+            bytes.emplace_back( static_cast< c74::max::t_atom_long >( hitter.count ) );
+            errors.emplace_back( static_cast< c74::max::t_atom_long >( hitter.error ) );
+        }
+
+        out["top_names"] = names;
+        out["top_bytes"] = bytes;
+        out["top_errors"] = errors;
+
+        status_out.send( "dictionary", out.name() );
+
+        return args;
+    }
+
     message<> status{ this, "status", "report status",
                       min_wrap_member( &websocketclient::report_status ) };
+    message<> stats{ this, "stats", "output traffic stats of all sessions as dict",
+                     min_wrap_member( &websocketclient::report_stats ) };
+    message<> trace{ this, "trace", "record message pipeline trace events",
+                     min_wrap_member( &websocketclient::handle_trace ) };
     message<> version{ this, "anything", "print version number",
                        [=]( const atoms& args, int inlet ) -> atoms {
 
@@ -229,10 +375,318 @@ class websocketclient : public object< websocketclient > {
                            return args;
                        } };
 
-  private:
+    c74::min::symbol multi_sym{ "multi" };
+    c74::min::symbol flat_sym{ "flat" };
+    c74::min::symbol pooled_sym{ "pooled" };
+    c74::min::symbol websocket_sym{ "websocket" };
+    c74::min::symbol udp_sym{ "udp" };
+
     /** The executor that will provide io functionality */
     boost::asio::io_context io_context_;
 
+    // the attribute setters below forward to the connections while constructing
+    std::shared_ptr< websocket_connection > connection_;
+
+    std::shared_ptr< udp_connection > udp_connection_;
+
+    // constructed before the socket option, stream tuning, keepalive and probe attributes
+    o::socket_options socket_options_;
+    o::stream_tuning stream_tuning_;
+    int ping_interval_ms_ = 0;
+    int max_missed_pongs_ = 3;
+    int latency_probe_ms_ = 0;
+    bool send_stamps_ = false;
+    std::vector< o::codec > codecs_;
+    bool transport_udp_ = false;
+    bool latest_value_ = false;
+    size_t batching_bytes_ = 0;
+
+    // ------------------------- socket options
+
+    // negative values are clamped to 0, which leaves the system default in place
+    template < typename T, T o::socket_options::*Option >
+    c74::min::atoms handle_socket_option( c74::min::atoms args, int inlet ) {
+
+        int value = std::max( static_cast< int >( args[0] ), 0 );
+
+        socket_options_.*Option = static_cast< T >( value );
+
+        if ( connection_ )
+            connection_->set_socket_options( socket_options_ );
+
+        if ( udp_connection_ )
+            udp_connection_->set_socket_options( socket_options_ );
+
+        return { value };
+    }
+
+    c74::min::attribute< bool > nodelay{
+        this, "nodelay", true, c74::min::description{ "disable Nagle's algorithm" },
+        min_wrap_member( ( &websocketclient::handle_socket_option<
+                           bool, &o::socket_options::no_delay > ) )
+    };
+
+    c74::min::attribute< bool > quickack{
+        this, "quickack", false,
+        c74::min::description{ "acknowledge received data immediately (linux only)" },
+        min_wrap_member( ( &websocketclient::handle_socket_option<
+                           bool, &o::socket_options::quick_ack > ) )
+    };
+
+    c74::min::attribute< int > sndbuf{
+        this, "sndbuf", 0,
+        c74::min::description{ "socket send buffer size in bytes, 0 for system default" },
+        min_wrap_member( ( &websocketclient::handle_socket_option<
+                           int, &o::socket_options::send_buffer > ) )
+    };
+
+    c74::min::attribute< int > rcvbuf{
+        this, "rcvbuf", 0,
+        c74::min::description{ "socket receive buffer size in bytes, 0 for system default" },
+        min_wrap_member( ( &websocketclient::handle_socket_option<
+                           int, &o::socket_options::receive_buffer > ) )
+    };
+
+    c74::min::attribute< int > dscp{
+        this, "dscp", 0,
+        c74::min::description{ "DSCP class (0 - 63) written into the IP TOS field" },
+        min_wrap_member( ( &websocketclient::handle_socket_option<
+                           int, &o::socket_options::dscp > ) )
+    };
+
+    c74::min::attribute< int > busy_poll{
+        this, "busy_poll", 0,
+        c74::min::description{ "busy poll the network device for n microseconds on reads "
+                               "(linux only)" },
+        min_wrap_member( ( &websocketclient::handle_socket_option<
+                           int, &o::socket_options::busy_poll > ) )
+    };
+
+    // ------------------------- stream tuning
+
+    template < typename T, T o::stream_tuning::*Option >
+    c74::min::atoms handle_stream_tuning( c74::min::atoms args, int inlet ) {
+
+        int value = std::max( static_cast< int >( args[0] ), 0 );
+
+        stream_tuning_.*Option = static_cast< T >( value );
+
+        if ( connection_ )
+            connection_->set_stream_tuning( stream_tuning_ );
+
+        return { value };
+    }
+
+    c74::min::atoms handle_read_buffer( c74::min::atoms args, int inlet ) {
+
+        if ( args[0] == flat_sym )
+            stream_tuning_.read_buffer = o::stream_tuning::read_buffer_type::flat;
+        else if ( args[0] == multi_sym )
+            stream_tuning_.read_buffer = o::stream_tuning::read_buffer_type::multi;
+        else
+            stream_tuning_.read_buffer = o::stream_tuning::read_buffer_type::pooled;
+
+        if ( connection_ && !connection_->set_stream_tuning( stream_tuning_ ) )
+            cwarn << "read_buffer applies from the next connection" << c74::min::endl;
+
+        switch ( stream_tuning_.read_buffer ) {
+        case o::stream_tuning::read_buffer_type::flat:
+            return { flat_sym };
+        case o::stream_tuning::read_buffer_type::multi:
+            return { multi_sym };
+        default:
+            return { pooled_sym };
+        }
+    }
+
+    c74::min::attribute< bool > auto_fragment{
+        this, "auto_fragment", true,
+        c74::min::description{ "split outgoing messages into frames of write_buffer bytes" },
+        min_wrap_member( ( &websocketclient::handle_stream_tuning<
+                           bool, &o::stream_tuning::auto_fragment > ) )
+    };
+
+    c74::min::attribute< int > write_buffer{
+        this, "write_buffer", 4096,
+        c74::min::description{ "size of the websocket write buffer in bytes" },
+        min_wrap_member( ( &websocketclient::handle_stream_tuning<
+                           std::size_t, &o::stream_tuning::write_buffer_bytes > ) )
+    };
+
+    c74::min::attribute< int > read_message_max{
+        this, "read_message_max", 16 * 1024 * 1024,
+        c74::min::description{ "largest accepted incoming message in bytes, 0 for no limit" },
+        min_wrap_member( ( &websocketclient::handle_stream_tuning<
+                           std::size_t, &o::stream_tuning::read_message_max > ) )
+    };
+
+    c74::min::attribute< c74::min::symbol > read_buffer{
+        this, "read_buffer", "pooled",
+        c74::min::description{
+            "read buffer type: pooled, flat or multi, used by the next connection" },
+        min_wrap_member( &websocketclient::handle_read_buffer )
+    };
+
+    // ------------------------- keepalive
+
+    c74::min::atoms handle_ping_interval( c74::min::atoms args, int inlet ) {
+
+        ping_interval_ms_ = std::max( static_cast< int >( args[0] ), 0 );
+
+        if ( connection_ )
+            connection_->set_keepalive( std::chrono::milliseconds( ping_interval_ms_ ),
+                                        max_missed_pongs_ );
+
+        return { ping_interval_ms_ };
+    }
+
+    c74::min::atoms handle_max_missed_pongs( c74::min::atoms args, int inlet ) {
+
+        max_missed_pongs_ = std::max( static_cast< int >( args[0] ), 1 );
+
+        if ( connection_ )
+            connection_->set_keepalive( std::chrono::milliseconds( ping_interval_ms_ ),
+                                        max_missed_pongs_ );
+
+        return { max_missed_pongs_ };
+    }
+
+    c74::min::attribute< int > ping_interval{
+        this, "ping_interval", 0,
+        c74::min::description{ "send a websocket ping every n milliseconds, 0 to disable" },
+        min_wrap_member( &websocketclient::handle_ping_interval )
+    };
+
+    c74::min::attribute< int > max_missed_pongs{
+        this, "max_missed_pongs", 3,
+        c74::min::description{ "close the connection after n unanswered pings" },
+        min_wrap_member( &websocketclient::handle_max_missed_pongs )
+    };
+
+    // ------------------------- latency probes
+
+    c74::min::atoms handle_latency_probe( c74::min::atoms args, int inlet ) {
+
+        latency_probe_ms_ = std::max( static_cast< int >( args[0] ), 0 );
+
+        if ( connection_ )
+            connection_->set_latency_probes( std::chrono::milliseconds( latency_probe_ms_ ) );
+
+        return { latency_probe_ms_ };
+    }
+
+    c74::min::atoms handle_send_stamps( c74::min::atoms args, int inlet ) {
+
+        send_stamps_ = static_cast< bool >( args[0] );
+
+        return { send_stamps_ };
+    }
+
+    c74::min::attribute< int > latency_probe{
+        this, "latency_probe", 0,
+        c74::min::description{ "measure clock offset and one-way latency to the peer every "
+                               "n milliseconds, 0 to disable" },
+        min_wrap_member( &websocketclient::handle_latency_probe )
+    };
+
+    c74::min::attribute< bool > send_stamps{
+        this, "send_stamps", false,
+        c74::min::description{ "stamp messages with their send time if the peer agrees, "
+                               "applies to the next connection" },
+        min_wrap_member( &websocketclient::handle_send_stamps )
+    };
+
+    // ------------------------- codecs
+
+    // max_message decodes protobuf frames and json text frames, osc is left out
+    c74::min::atoms handle_codecs( c74::min::atoms args, int inlet ) {
+
+        std::vector< o::codec > codecs;
+        std::string names;
+
+        for ( auto& arg : args ) {
+
+            o::codec cd;
+            std::string name = arg;
+
+            if ( !o::codec_parse( name, cd ) || cd == o::codec::osc ) {
+                cerr << "unsupported codec " << name << ", use protobuf or json"
+                     << c74::min::endl;
+                continue;
+            }
+
+            codecs.push_back( cd );
+            names.append( names.empty() ? "" : " " ).append( name );
+        }
+
+        codecs_ = std::move( codecs );
+
+        return { c74::min::symbol( names ) };
+    }
+
+    c74::min::attribute< c74::min::symbol > codecs{
+        this, "codecs", "",
+        c74::min::description{ "codecs to offer in order of preference: protobuf, json. "
+                               "Empty offers none, used by the next connection" },
+        min_wrap_member( &websocketclient::handle_codecs )
+    };
+
+    // ------------------------- transport
+
+    // anything but udp selects websocket
+    c74::min::atoms handle_transport( c74::min::atoms args, int inlet ) {
+
+        transport_udp_ = args[0] == udp_sym;
+
+        return { transport_udp_ ? udp_sym : websocket_sym };
+    }
+
+    c74::min::atoms handle_latest_value( c74::min::atoms args, int inlet ) {
+
+        latest_value_ = static_cast< bool >( args[0] );
+
+        if ( udp_connection_ )
+            udp_connection_->set_latest_value( latest_value_ );
+
+        return { latest_value_ };
+    }
+
+    c74::min::atoms handle_batching( c74::min::atoms args, int inlet ) {
+
+        int value = std::clamp( static_cast< int >( args[0] ), 0,
+                                static_cast< int >( o::udp_framing::max_datagram ) );
+
+        batching_bytes_ = static_cast< size_t >( value );
+
+        if ( udp_connection_ )
+            udp_connection_->set_batching( batching_bytes_ );
+
+        return { value };
+    }
+
+    c74::min::attribute< c74::min::symbol > transport{
+        this, "transport", "websocket",
+        c74::min::description{
+            "websocket or udp, udp trades delivery and order for latency, used by the "
+            "next connection" },
+        min_wrap_member( &websocketclient::handle_transport )
+    };
+
+    c74::min::attribute< bool > latest_value{
+        this, "latest_value", false,
+        c74::min::description{
+            "udp only, unsent and late messages are dropped in favour of newer ones" },
+        min_wrap_member( &websocketclient::handle_latest_value )
+    };
+
+    c74::min::attribute< int > batching{
+        this, "batching", 0,
+        c74::min::description{
+            "udp only, pack queued messages into datagrams of up to n bytes, 0 to disable" },
+        min_wrap_member( &websocketclient::handle_batching )
+    };
+
+  private:
     /** This object will keep the io_context alive as long as the object exists */
     boost::asio::executor_work_guard< boost::asio::io_context::executor_type > work{
         io_context_.get_executor()
@@ -243,8 +697,6 @@ class websocketclient : public object< websocketclient > {
 
     o::max_message::factory allocator_;
 
-    std::shared_ptr< websocket_connection > connection_;
-
     std::unique_ptr< std::thread > client_thread_ptr;
 
     o::protobuf_decoder_worker< o::max_message > dec_worker_{};
@@ -255,11 +707,24 @@ class websocketclient : public object< websocketclient > {
 
     std::mutex post_mtx;
 
+    // io threads only format into the line queues, the Max main thread posts them
+    o::default_console_line_queue console_lines_;
+    o::default_console_line_queue console_error_lines_;
+
+    c74::min::queue<> console_flush_{
+        this, [this]( const atoms& args, int inlet ) -> atoms {
+            console_lines_.drain( [this]( std::string_view line ) { cout << line << endl; } );
+            console_error_lines_.drain(
+                [this]( std::string_view line ) { cerr << line << endl; } );
+            return {};
+        }
+    };
+
     o::console_stream_adapter console_adapter{
-        [this]( std::string str ) { cout << str << endl; }, true
+        console_lines_, [this]() { console_flush_.set(); }, true
     };
     o::console_stream_adapter console_error_adapter{
-        [this]( std::string str ) { cerr << str << endl; }, true
+        console_error_lines_, [this]() { console_flush_.set(); }, true
     };
 };
 
@@ -29,11 +29,13 @@
 #include "c74_min.h"
 #include "client.h"
 #include "devices/devices.h"
+#include "devices/send_scheduler.h"
 #include "generated/Movement.pb.h"
 #include "min_utils.h"
 #include "net_url.h"
 #include "o.h"
 #include "ohlano_min.h"
+#include "proto_messages/joint_stream.h"
 #include "session.h"
 
 #define CHECKED_PTR_USE_TEMPLATE_HASH
@@ -76,6 +78,7 @@ class websocketclient_iiwa
 
     virtual ~websocketclient_iiwa() {
 
+        scheduler_.stop();
         session_close();
 
         this->app_allow_exit();
@@ -92,6 +95,10 @@ class websocketclient_iiwa
     void on_ready( boost::system::error_code ec ) override {
         cout << "session is ready" << c74::min::endl;
         session()->stream().binary( true );
+
+        // the peer has no reference frames yet
+        std::lock_guard< std::mutex > lock{ movement_lock };
+        joint_encoder_.reset();
     }
 
     void on_close( boost::system::error_code ec ) override {
@@ -104,6 +111,26 @@ class websocketclient_iiwa
         cout << "finished running network worker" << c74::min::endl;
     }
 
+    // constructed before the attributes, their setters may run during construction.
+    // movements are encoded only once they are sent, so the joint stream encoder never
+    // references a frame that the scheduler dropped
+    o::latest_value_scheduler< o::io::messages::bytes_message > scheduler_{
+        this->context(), factory(), [this]( const o::io::messages::bytes_message* msg ) {
+            if ( session() )
+                send( encode_joint_stream( msg ) );
+            else
+                factory().deallocate( msg );
+        }
+    };
+
+    // constructed before the socket option, stream tuning, keepalive and probe attributes
+    o::socket_options socket_options_;
+    o::stream_tuning stream_tuning_;
+    int ping_interval_ms_ = 0;
+    int max_missed_pongs_ = 3;
+    int latency_probe_ms_ = 0;
+    bool send_stamps_ = false;
+
     c74::min::atoms send_msg( const c74::min::atoms& args, int inlet ) { return args; }
 
     c74::min::symbol joint_sym{ "JOINT" };
@@ -112,6 +139,10 @@ class websocketclient_iiwa
     c74::min::symbol circle_sym{ "CIRCLE" };
     c74::min::symbol bezier_sym{ "BEZIER" };
     c74::min::symbol batch_sym{ "BATCH" };
+    c74::min::symbol reset_sym{ "reset" };
+    c74::min::symbol multi_sym{ "multi" };
+    c74::min::symbol flat_sym{ "flat" };
+    c74::min::symbol pooled_sym{ "pooled" };
 
     message< threadsafe::yes > new_mv_msg{
         this, "iiwa_move", "send new iiwa move msg",
@@ -126,7 +157,7 @@ class websocketclient_iiwa
 
                 mv_ptr->SerializeToArray( msg->data(), msg->size() );
 
-                send( msg );
+                scheduler_.push( msg );
 
             } catch ( std::exception& ex ) {
                 cerr << ex.what() << c74::min::endl;
@@ -137,6 +168,23 @@ class websocketclient_iiwa
         }
     };
 
+    message<> jitter{ this, "jitter", "print send scheduler timing",
+                      [=]( const atoms& args, int inlet ) -> atoms {
+                          auto st = scheduler_.stats();
+
+                          cout << "sent: " << st.sent << " superseded: " << st.superseded
+                               << " overruns: " << st.overruns << c74::min::endl;
+                          cout << "jitter mean: " << st.jitter_mean_us()
+                               << "us max: " << st.jitter_max_us
+                               << "us p99: " << st.jitter.percentile_bound( 0.99 ) << "us"
+                               << c74::min::endl;
+
+                          if ( !args.empty() && args[0] == reset_sym )
+                              scheduler_.reset_stats();
+
+                          return args;
+                      } };
+
     // message<> status{ this, "status", "report status",
     // min_wrap_member(&websocketclient_iiwa::report_status) };
     message<> version{ this, "anything", "print version number",
@@ -154,8 +202,284 @@ class websocketclient_iiwa
 
     };
 
+    // ------------------------- max attributes
+
+    c74::min::attribute< double > rate{
+        this, "rate", 0.,
+        c74::min::description{
+            "send only the newest movement at this rate in Hz, 0 sends immediately" },
+        min_wrap_member( &websocketclient_iiwa::handle_rate_change )
+    };
+
+    c74::min::atoms handle_rate_change( c74::min::atoms args, int inlet ) {
+
+        double hz = std::max( 0., std::min( static_cast< double >( args[0] ), 1000. ) );
+        scheduler_.set_rate( hz );
+
+        return { hz };
+    }
+
+    c74::min::attribute< bool > joint_stream{
+        this, "joint_stream", false,
+        c74::min::description{ "send joint movements as delta-encoded JointStream frames" }
+    };
+
+    c74::min::attribute< double > joint_quantum{
+        this, "joint_quantum", 1e-5,
+        c74::min::description{ "quantization step for streamed joint positions in radians" },
+        min_wrap_member( &websocketclient_iiwa::handle_joint_quantum )
+    };
+
+    // the quantized positions have to cover +-2 pi, smaller quanta keep the old value
+    c74::min::atoms handle_joint_quantum( c74::min::atoms args, int inlet ) {
+
+        using encoder_type = o::joint_stream_encoder< joint_count >;
+
+        double quantum = args[0];
+
+        if ( !( quantum * encoder_type::max_quantized >= encoder_type::max_position ) ) {
+            cerr << "joint_quantum " << quantum << " is too small to represent +-2 pi"
+                 << c74::min::endl;
+            return { static_cast< double >( joint_quantum ) };
+        }
+
+        return { quantum };
+    }
+
+    c74::min::attribute< int > keyframe_interval{
+        this, "keyframe_interval", 500,
+        c74::min::description{ "send absolute joint positions every n frames, 0 to disable" }
+    };
+
+    // ------------------------- socket options
+
+    // negative values are clamped to 0, which leaves the system default in place
+    template < typename T, T o::socket_options::*Option >
+    c74::min::atoms handle_socket_option( c74::min::atoms args, int inlet ) {
+
+        int value = std::max( static_cast< int >( args[0] ), 0 );
+
+        socket_options_.*Option = static_cast< T >( value );
+        set_socket_options( socket_options_ );
+
+        return { value };
+    }
+
+    c74::min::attribute< bool > nodelay{
+        this, "nodelay", true, c74::min::description{ "disable Nagle's algorithm" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_socket_option<
+                           bool, &o::socket_options::no_delay > ) )
+    };
+
+    c74::min::attribute< bool > quickack{
+        this, "quickack", false,
+        c74::min::description{ "acknowledge received data immediately (linux only)" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_socket_option<
+                           bool, &o::socket_options::quick_ack > ) )
+    };
+
+    c74::min::attribute< int > sndbuf{
+        this, "sndbuf", 0,
+        c74::min::description{ "socket send buffer size in bytes, 0 for system default" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_socket_option<
+                           int, &o::socket_options::send_buffer > ) )
+    };
+
+    c74::min::attribute< int > rcvbuf{
+        this, "rcvbuf", 0,
+        c74::min::description{ "socket receive buffer size in bytes, 0 for system default" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_socket_option<
+                           int, &o::socket_options::receive_buffer > ) )
+    };
+
+    c74::min::attribute< int > dscp{
+        this, "dscp", 0,
+        c74::min::description{ "DSCP class (0 - 63) written into the IP TOS field" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_socket_option<
+                           int, &o::socket_options::dscp > ) )
+    };
+
+    c74::min::attribute< int > busy_poll{
+        this, "busy_poll", 0,
+        c74::min::description{ "busy poll the network device for n microseconds on reads "
+                               "(linux only)" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_socket_option<
+                           int, &o::socket_options::busy_poll > ) )
+    };
+
+    // ------------------------- stream tuning
+
+    template < typename T, T o::stream_tuning::*Option >
+    c74::min::atoms handle_stream_tuning( c74::min::atoms args, int inlet ) {
+
+        int value = std::max( static_cast< int >( args[0] ), 0 );
+
+        stream_tuning_.*Option = static_cast< T >( value );
+
+        set_stream_tuning( stream_tuning_ );
+
+        return { value };
+    }
+
+    c74::min::atoms handle_read_buffer( c74::min::atoms args, int inlet ) {
+
+        if ( args[0] == flat_sym )
+            stream_tuning_.read_buffer = o::stream_tuning::read_buffer_type::flat;
+        else if ( args[0] == multi_sym )
+            stream_tuning_.read_buffer = o::stream_tuning::read_buffer_type::multi;
+        else
+            stream_tuning_.read_buffer = o::stream_tuning::read_buffer_type::pooled;
+
+        if ( !set_stream_tuning( stream_tuning_ ) )
+            cwarn << "read_buffer applies from the next connection" << c74::min::endl;
+
+        switch ( stream_tuning_.read_buffer ) {
+        case o::stream_tuning::read_buffer_type::flat:
+            return { flat_sym };
+        case o::stream_tuning::read_buffer_type::multi:
+            return { multi_sym };
+        default:
+            return { pooled_sym };
+        }
+    }
+
+    c74::min::attribute< bool > auto_fragment{
+        this, "auto_fragment", true,
+        c74::min::description{ "split outgoing messages into frames of write_buffer bytes" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_stream_tuning<
+                           bool, &o::stream_tuning::auto_fragment > ) )
+    };
+
+    c74::min::attribute< int > write_buffer{
+        this, "write_buffer", 4096,
+        c74::min::description{ "size of the websocket write buffer in bytes" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_stream_tuning<
+                           std::size_t, &o::stream_tuning::write_buffer_bytes > ) )
+    };
+
+    c74::min::attribute< int > read_message_max{
+        this, "read_message_max", 16 * 1024 * 1024,
+        c74::min::description{ "largest accepted incoming message in bytes, 0 for no limit" },
+        min_wrap_member( ( &websocketclient_iiwa::handle_stream_tuning<
+                           std::size_t, &o::stream_tuning::read_message_max > ) )
+    };
+
+    c74::min::attribute< c74::min::symbol > read_buffer{
+        this, "read_buffer", "pooled",
+        c74::min::description{
+            "read buffer type: pooled, flat or multi, used by the next connection" },
+        min_wrap_member( &websocketclient_iiwa::handle_read_buffer )
+    };
+
+    // ------------------------- keepalive
+
+    c74::min::atoms handle_ping_interval( c74::min::atoms args, int inlet ) {
+
+        ping_interval_ms_ = std::max( static_cast< int >( args[0] ), 0 );
+        set_keepalive( std::chrono::milliseconds( ping_interval_ms_ ), max_missed_pongs_ );
+
+        return { ping_interval_ms_ };
+    }
+
+    c74::min::atoms handle_max_missed_pongs( c74::min::atoms args, int inlet ) {
+
+        max_missed_pongs_ = std::max( static_cast< int >( args[0] ), 1 );
+        set_keepalive( std::chrono::milliseconds( ping_interval_ms_ ), max_missed_pongs_ );
+
+        return { max_missed_pongs_ };
+    }
+
+    c74::min::attribute< int > ping_interval{
+        this, "ping_interval", 0,
+        c74::min::description{ "send a websocket ping every n milliseconds, 0 to disable" },
+        min_wrap_member( &websocketclient_iiwa::handle_ping_interval )
+    };
+
+    c74::min::attribute< int > max_missed_pongs{
+        this, "max_missed_pongs", 3,
+        c74::min::description{ "close the connection after n unanswered pings" },
+        min_wrap_member( &websocketclient_iiwa::handle_max_missed_pongs )
+    };
+
+    // ------------------------- latency probes
+
+    c74::min::atoms handle_latency_probe( c74::min::atoms args, int inlet ) {
+
+        latency_probe_ms_ = std::max( static_cast< int >( args[0] ), 0 );
+
+        set_latency_probes( std::chrono::milliseconds( latency_probe_ms_ ) );
+
+        return { latency_probe_ms_ };
+    }
+
+    c74::min::atoms handle_send_stamps( c74::min::atoms args, int inlet ) {
+
+        send_stamps_ = static_cast< bool >( args[0] );
+        set_send_stamps( send_stamps_ );
+
+        return { send_stamps_ };
+    }
+
+    c74::min::attribute< int > latency_probe{
+        this, "latency_probe", 0,
+        c74::min::description{ "measure clock offset and one-way latency to the peer every "
+                               "n milliseconds, 0 to disable" },
+        min_wrap_member( &websocketclient_iiwa::handle_latency_probe )
+    };
+
+    c74::min::attribute< bool > send_stamps{
+        this, "send_stamps", false,
+        c74::min::description{ "stamp messages with their send time if the peer agrees, "
+                               "applies to the next connection" },
+        min_wrap_member( &websocketclient_iiwa::handle_send_stamps )
+    };
+
   private:
+    // replace a serialized JOINT movement by a JointStream frame if streaming is enabled,
+    // called from the io thread right before the message is sent
+    const o::io::messages::bytes_message*
+    encode_joint_stream( const o::io::messages::bytes_message* msg ) {
+
+        if ( !joint_stream || !stream_movement_.ParseFromArray(
+                                   msg->data(), static_cast< int >( msg->size() ) ) )
+            return msg;
+
+        auto& mv = stream_movement_;
+
+        if ( mv.movetype() != iiwa::Movement::JOINT ||
+             mv.jointpositions().joints_size() != joint_count )
+            return msg;
+
+        std::array< double, joint_count > positions;
+        std::copy_n( mv.jointpositions().joints().begin(), joint_count, positions.begin() );
+
+        auto frame = new_msg();
+
+        {
+            std::lock_guard< std::mutex > lock{ movement_lock };
+
+            joint_encoder_.set_quantum( joint_quantum );
+            joint_encoder_.set_keyframe_interval( static_cast< std::uint32_t >(
+                std::max( 0, static_cast< int >( keyframe_interval ) ) ) );
+
+            joint_encoder_.encode( positions, mv.jointparameter(), mv.filterparameter(),
+                                   &joint_frame_ );
+
+            frame->storage().resize( joint_frame_.ByteSizeLong() );
+            joint_frame_.SerializeWithCachedSizesToArray(
+                reinterpret_cast< google::protobuf::uint8* >( frame->data() ) );
+        }
+
+        factory().deallocate( msg );
+        return frame;
+    }
+
+    static constexpr size_t joint_count = 7;
+
     std::mutex movement_lock;
+    o::joint_stream_encoder< joint_count > joint_encoder_;
+    iiwa::JointStream joint_frame_;
+    iiwa::Movement stream_movement_;
 };
 
 void ext_main( void* r ) {
@@ -30,8 +30,7 @@
 
 #include "session.h"
 
-#include "proto_messages/generic_max_message.h"
-#include "proto_messages/proto_message_base.h"
+#include "codecs/codec_message.h"
 
 #include "devices/devices.h"
 
@@ -46,8 +45,8 @@ class websocketserver : public c74::min::object< websocketserver > {
     struct server_session;
     struct iolet;
 
-    // the type used
-    using message_type = o::max_message;
+    // the type used, the codec is negotiated per session
+    using message_type = o::codec_message;
 
     // the websocket session type
     using websocket_session_type =
@@ -83,9 +82,10 @@ class websocketserver : public c74::min::object< websocketserver > {
     struct server_session {
 
         template < typename... Ts >
-        server_session( iolet*, Ts&&... args ) {
+        server_session( iolet*, const std::vector< o::codec >& codecs, Ts&&... args ) {
             session_ = std::make_shared< websocket_session_type >(
                 std::forward< Ts >( args )... );
+            session_->set_codecs( codecs );
         }
 
         iolet* iolet_;
@@ -200,6 +200,101 @@ class websocketserver : public c74::min::object< websocketserver > {
         return attr_check_ip( address, args );
     }
 
+    // ------------------------- codecs
+
+    // accepted sessions are created with these, see server_session
+    std::vector< o::codec > codecs_;
+
+    c74::min::atoms handle_codecs( c74::min::atoms args, int inlet ) {
+
+        std::vector< o::codec > codecs;
+        std::string names;
+
+        for ( auto& arg : args ) {
+
+            o::codec cd;
+            std::string name = arg;
+
+            if ( !o::codec_parse( name, cd ) ) {
+                cerr << "unknown codec " << name << ", use protobuf, osc or json"
+                     << c74::min::endl;
+                continue;
+            }
+
+            codecs.push_back( cd );
+            names.append( names.empty() ? "" : " " ).append( name );
+        }
+
+        codecs_ = std::move( codecs );
+
+        return { c74::min::symbol( names ) };
+    }
+
+    c74::min::attribute< c74::min::symbol > codecs{
+        this, "codecs", "",
+        c74::min::description{ "codecs to accept in order of preference: protobuf, osc, "
+                               "json. Empty negotiates nothing" },
+        min_wrap_member( &websocketserver::handle_codecs )
+    };
+
+    o::socket_options socket_options_;
+
+    // ------------------------- socket options of accepted connections
+
+    // negative values are clamped to 0, which leaves the system default in place
+    template < typename T, T o::socket_options::*Option >
+    c74::min::atoms handle_socket_option( c74::min::atoms args, int inlet ) {
+
+        int value = std::max( static_cast< int >( args[0] ), 0 );
+
+        socket_options_.*Option = static_cast< T >( value );
+        listener_.set_socket_options( socket_options_ );
+
+        return { value };
+    }
+
+    c74::min::attribute< bool > nodelay{
+        this, "nodelay", true, c74::min::description{ "disable Nagle's algorithm" },
+        min_wrap_member( ( &websocketserver::handle_socket_option<
+                           bool, &o::socket_options::no_delay > ) )
+    };
+
+    c74::min::attribute< bool > quickack{
+        this, "quickack", false,
+        c74::min::description{ "acknowledge received data immediately (linux only)" },
+        min_wrap_member( ( &websocketserver::handle_socket_option<
+                           bool, &o::socket_options::quick_ack > ) )
+    };
+
+    c74::min::attribute< int > sndbuf{
+        this, "sndbuf", 0,
+        c74::min::description{ "socket send buffer size in bytes, 0 for system default" },
+        min_wrap_member( ( &websocketserver::handle_socket_option<
+                           int, &o::socket_options::send_buffer > ) )
+    };
+
+    c74::min::attribute< int > rcvbuf{
+        this, "rcvbuf", 0,
+        c74::min::description{ "socket receive buffer size in bytes, 0 for system default" },
+        min_wrap_member( ( &websocketserver::handle_socket_option<
+                           int, &o::socket_options::receive_buffer > ) )
+    };
+
+    c74::min::attribute< int > dscp{
+        this, "dscp", 0,
+        c74::min::description{ "DSCP class (0 - 63) written into the IP TOS field" },
+        min_wrap_member( ( &websocketserver::handle_socket_option<
+                           int, &o::socket_options::dscp > ) )
+    };
+
+    c74::min::attribute< int > busy_poll{
+        this, "busy_poll", 0,
+        c74::min::description{ "busy poll the network device for n microseconds on reads "
+                               "(linux only)" },
+        min_wrap_member( ( &websocketserver::handle_socket_option<
+                           int, &o::socket_options::busy_poll > ) )
+    };
+
     // check if input atoms[0] is long type and restrict it to attribute range.
     // if type check fails, we fall back to the old atom arg
     template < typename T >